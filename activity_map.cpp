@@ -0,0 +1,82 @@
+﻿#include "activity_map.h"
+#include "wave.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ZAPOCTAK_ACTIVITY_SSE2
+#endif
+
+ActivityMap::ActivityMap(double threshold) : threshold(threshold), channels(0), blocks(0), skipped(0)
+{
+}
+
+void ActivityMap::reset(size_t channels, size_t blocks)
+{
+    this->channels = channels;
+    this->blocks = blocks;
+    peaks.assign(channels * blocks, 0);
+    skipped = 0;
+}
+
+void ActivityMap::scan(const Wave &wave)
+{
+    const size_t SampleRate = wave.fchunk.SampleRate;
+    const size_t samples = wave.PData[0].size();
+    reset(wave.fchunk.NumChannels, (samples + SampleRate - 1) / SampleRate);
+    ThreadPool::instance().run(channels * blocks, [&](size_t task, size_t) {
+        size_t ch = task / blocks;
+        size_t from = (task % blocks) * SampleRate;
+        record(ch, task % blocks, peak(&wave.PData[ch][from], std::min(SampleRate, samples - from)));
+    });
+}
+
+bool ActivityMap::active(size_t first, size_t count, size_t block) const
+{
+    for(size_t ch = first; ch != first + count; ++ch)
+        if(active(ch, block))
+            return true;
+    return false;
+}
+
+bool ActivityMap::zero(size_t block) const
+{
+    for(size_t ch = 0; ch != channels; ++ch)
+        if(peaks[ch * blocks + block] != 0)
+            return false;
+    return true;
+}
+
+void ActivityMap::printStats(std::ostream &out) const
+{
+    size_t total = channels * blocks;
+    out << "Ticho: " << skipped << " z " << total << " bloku kanalu preskoceno ("
+        << (total ? 100. * skipped / total : 0.) << " %)." << std::endl;
+}
+
+double ActivityMap::peak(const complex *data, size_t count)
+{
+    /* Reálná a imaginární část leží v paměti za sebou, prochází se jako pole doublů */
+    const double *values = reinterpret_cast<const double*>(data);
+    size_t n = 2 * count;
+    size_t i = 0;
+    double result = 0;
+#ifdef ZAPOCTAK_ACTIVITY_SSE2
+    const __m128d sign = _mm_set1_pd(-0.);
+    __m128d m0 = _mm_setzero_pd();
+    __m128d m1 = _mm_setzero_pd();
+    for(; i + 4 <= n; i += 4)
+    {
+        m0 = _mm_max_pd(m0, _mm_andnot_pd(sign, _mm_loadu_pd(values + i)));
+        m1 = _mm_max_pd(m1, _mm_andnot_pd(sign, _mm_loadu_pd(values + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_max_pd(m0, m1));
+    result = std::max(lanes[0], lanes[1]);
+#endif
+    for(; i != n; ++i)
+        result = std::max(result, std::fabs(values[i]));
+    return result;
+}
@@ -0,0 +1,110 @@
+﻿#ifndef ACTIVITY_MAP_H
+#define ACTIVITY_MAP_H
+#include "complex.h"
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+class Wave;
+
+/**
+ * @brief Mapa aktivity bloků equalizace, podle ní se tiché bloky přeskočí.
+ *
+ * Pro každý kanál a blok (SampleRate samplů, stejné bloky jako při equalizaci) drží největší
+ * absolutní hodnotu samplu. Blok je tichý, pokud tato špička nepřesáhne práh. Bloky equalizace
+ * se nepřekrývají a filtr se počítá pro každý blok zvlášť, dozvuk filtru se tedy do dalšího bloku
+ * nepřenáší a tichý blok lze beze ztráty přeskočit: z nulového bloku vyjdou zase nuly. S nenulovým
+ * prahem se téměř tichý blok nechá beze změny místo filtrování.
+ *
+ * Špičky se hledají v SSE2 po dvou hodnotách, bloky paralelně na poolu vláken.
+ */
+class ActivityMap
+{
+public:
+    /**
+     * @brief           Konstruktor.
+     * @param threshold Práh jako podíl plného rozsahu, 0 = přeskočí se jen digitální ticho.
+     */
+    explicit ActivityMap(double threshold = 0);
+
+    /**
+     * @brief               Připraví mapu pro daný počet kanálů a bloků, všechny bloky jsou tiché.
+     * @param channels      Počet kanálů.
+     * @param blocks        Počet bloků v kanálu.
+     */
+    void reset(size_t channels, size_t blocks);
+
+    /**
+     * @brief           Projde rozparsovaná data wavu a zjistí špičky všech bloků.
+     * @param wave      Rozparsovaný wave.
+     */
+    void scan(const Wave &wave);
+
+    /**
+     * @brief           Zapíše špičku bloku, různé bloky lze zapisovat z různých vláken.
+     * @param channel   Kanál.
+     * @param block     Blok.
+     * @param peak      Největší absolutní hodnota samplu v bloku.
+     */
+    void record(size_t channel, size_t block, double peak) { peaks[channel * blocks + block] = peak; }
+
+    /**
+     * @brief           Zjistí, jestli blok kanálu přesahuje práh a musí se zpracovat.
+     * @param channel   Kanál.
+     * @param block     Blok.
+     */
+    bool active(size_t channel, size_t block) const { return peaks[channel * blocks + block] > threshold; }
+
+    /**
+     * @brief           Zjistí, jestli je aktivní některý z několika sousedních kanálů.
+     * @param first     První kanál.
+     * @param count     Počet kanálů.
+     * @param block     Blok.
+     */
+    bool active(size_t first, size_t count, size_t block) const;
+
+    /**
+     * @brief           Zjistí, jestli jsou všechny kanály bloku úplně nulové.
+     * @param block     Blok.
+     *
+     * Nulový blok zůstane nulový po jakékoliv změně hlasitosti, lze ho tedy rovnou vyplnit.
+     */
+    bool zero(size_t block) const;
+
+    /**
+     * @brief           Započítá přeskočené bloky do statistiky, volat lze z více vláken.
+     * @param count     Počet přeskočených bloků kanálů.
+     */
+    void skip(size_t count) { skipped += count; }
+
+    /**
+     * @brief   Počet přeskočených bloků kanálů.
+     */
+    size_t skippedCount() const { return skipped; }
+
+    /**
+     * @brief       Vypíše, jaká část bloků se přeskočila.
+     * @param out   Výstupní stream.
+     */
+    void printStats(std::ostream &out) const;
+
+    /**
+     * @brief           Největší absolutní hodnota reálných i imaginárních částí.
+     * @param data      Komplexní čísla.
+     * @param count     Počet čísel.
+     */
+    static double peak(const complex *data, size_t count);
+
+private:
+    ActivityMap(const ActivityMap&);
+    ActivityMap& operator=(const ActivityMap&);
+
+    double threshold;               /**< Práh tichého bloku. */
+    size_t channels;                /**< Počet kanálů. */
+    size_t blocks;                  /**< Počet bloků v kanálu. */
+    std::vector<double> peaks;      /**< Špičky bloků, po kanálech. */
+    std::atomic<size_t> skipped;    /**< Počet přeskočených bloků kanálů. */
+};
+
+#endif // ACTIVITY_MAP_H
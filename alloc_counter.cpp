@@ -0,0 +1,74 @@
+﻿#include "alloc_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local size_t allocations = 0;
+    std::atomic<size_t> steadyState(0);
+}
+
+#ifdef ZAPOCTAK_COUNT_ALLOCATIONS
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if(void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+bool AllocCounter::enabled()
+{
+    return true;
+}
+
+#else
+
+bool AllocCounter::enabled()
+{
+    return false;
+}
+
+#endif
+
+size_t AllocCounter::count()
+{
+    return allocations;
+}
+
+void AllocCounter::reportSteadyState(size_t count)
+{
+    steadyState += count;
+}
+
+size_t AllocCounter::steadyStateAllocations()
+{
+    return steadyState;
+}
@@ -0,0 +1,41 @@
+﻿#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+#include <cstddef>
+
+/**
+ * @brief Počítadlo alokací na haldě pro kontrolu ustáleného stavu.
+ *
+ * Pokud je program přeložen s definicí ZAPOCTAK_COUNT_ALLOCATIONS, nahradí se
+ * globální operator new a každá alokace se započítá do počítadla aktuálního vlákna.
+ * Bez této definice počítadlo vždy vrací 0 a nic nestojí.
+ */
+struct AllocCounter
+{
+    /**
+     * @brief   Zjistí, jestli se alokace opravdu počítají.
+     * @return  Vrací true, pokud je program přeložen s počítáním alokací.
+     */
+    static bool enabled();
+
+    /**
+     * @brief   Počet alokací provedených aktuálním vláknem.
+     * @return  Vrací počet volání operator new v tomto vlákně.
+     */
+    static size_t count();
+
+    /**
+     * @brief           Zaznamená alokace v ustáleném stavu.
+     * @param count     Počet alokací, které by tam neměly být.
+     *
+     * Volá se ze zpracování bloků po zahřátí, výsledky se sčítají přes všechna vlákna.
+     */
+    static void reportSteadyState(size_t count);
+
+    /**
+     * @brief   Počet alokací v ustáleném stavu ze všech vláken.
+     * @return  Vrací součet hodnot z reportSteadyState().
+     */
+    static size_t steadyStateAllocations();
+};
+
+#endif // ALLOC_COUNTER_H
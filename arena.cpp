@@ -0,0 +1,229 @@
+﻿#include "arena.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if defined(SYS_mbind)
+#define ZAPOCTAK_HAVE_MBIND
+#endif
+#endif
+#endif
+
+Arena::Options Arena::options;
+
+namespace
+{
+    /* Stav alokátoru, velké buffery se alokují z více vláken (vokodér, více výstupů) */
+    std::mutex lock;
+    std::unordered_map<void*, size_t> mapped;   /* Přímo namapované buffery a jejich délka */
+    std::multimap<size_t, void*> retained;      /* Uvolněné namapované buffery podle délky */
+    size_t retainedBytes = 0;
+    bool bindWarned = false;
+
+    inline size_t roundUp(size_t x, size_t to) { return (x + to - 1) / to * to; }
+
+    void* heapAllocate(size_t bytes)
+    {
+#ifdef _WIN32
+        return _aligned_malloc(bytes, Arena::Alignment);
+#else
+        void *p = 0;
+        return posix_memalign(&p, Arena::Alignment, bytes) == 0 ? p : 0;
+#endif
+    }
+
+    void heapRelease(void *p)
+    {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+#ifndef _WIN32
+#ifdef ZAPOCTAK_HAVE_MBIND
+    /* Maska NUMA uzlů ze seznamu online uzlů, např. "0-1,4" */
+    std::vector<unsigned long> onlineNodes()
+    {
+        const size_t Bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(1, 1);
+        std::ifstream in("/sys/devices/system/node/online");
+        std::string list;
+        if(!(in >> list))
+            return mask;
+        mask[0] = 0;
+        for(size_t pos = 0; pos < list.size();)
+        {
+            size_t end = list.find(',', pos);
+            if(end == std::string::npos)
+                end = list.size();
+            std::string range = list.substr(pos, end - pos);
+            size_t dash = range.find('-');
+            unsigned long first = std::stoul(range.substr(0, dash));
+            unsigned long last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            for(unsigned long node = first; node <= last; ++node)
+            {
+                if(node / Bits >= mask.size())
+                    mask.resize(node / Bits + 1, 0);
+                mask[node / Bits] |= 1ul << (node % Bits);
+            }
+            pos = end + 1;
+        }
+        return mask;
+    }
+#endif
+
+    /* Sváže stránky s NUMA uzlem, nebo je rozloží po všech. Musí se volat před prvním zápisem. */
+    void bindNodes(void *p, size_t length)
+    {
+        if(Arena::options.node < 0 && !Arena::options.interleave)
+            return;
+#ifdef ZAPOCTAK_HAVE_MBIND
+        const size_t Bits = 8 * sizeof(unsigned long);
+        const int MpolBind = 2;
+        const int MpolInterleave = 3;
+        std::vector<unsigned long> mask;
+        if(Arena::options.interleave)
+            mask = onlineNodes();
+        else
+        {
+            mask.assign(Arena::options.node / Bits + 1, 0);
+            mask[Arena::options.node / Bits] = 1ul << (Arena::options.node % Bits);
+        }
+        if(syscall(SYS_mbind, p, length, Arena::options.interleave ? MpolInterleave : MpolBind,
+                   &mask[0], mask.size() * Bits + 1, 0) == 0)
+            return;
+#else
+        (void)p;
+        (void)length;
+#endif
+        if(!bindWarned)
+            std::cerr << "ERROR: Pamet nelze svazat s NUMA uzlem, pouziva se vychozi umisteni." << std::endl;
+        bindWarned = true;
+    }
+
+    /* Namapuje anonymní paměť zarovnanou na velkou stránku, délka je násobkem velké stránky */
+    void* mapAligned(size_t length)
+    {
+        const int Protection = PROT_READ | PROT_WRITE;
+        const int Flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+        if(Arena::options.hugePages == Arena::Explicit)
+        {
+            void *p = mmap(0, length, Protection, Flags | MAP_HUGETLB, -1, 0);
+            if(p != MAP_FAILED)
+                return p;
+        }
+#endif
+        /* Namapuje se o stránku víc a přebytek před a za zarovnaným začátkem se vrátí */
+        char *raw = static_cast<char*>(mmap(0, length + Arena::HugePage, Protection, Flags, -1, 0));
+        if(raw == MAP_FAILED)
+            return 0;
+        char *p = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(raw), Arena::HugePage));
+        if(p != raw)
+            munmap(raw, p - raw);
+        if(p + length != raw + length + Arena::HugePage)
+            munmap(p + length, raw + Arena::HugePage - p);
+#ifdef MADV_HUGEPAGE
+        if(Arena::options.hugePages != Arena::Off)
+            madvise(p, length, MADV_HUGEPAGE);
+#endif
+        return p;
+    }
+#endif
+}
+
+void* Arena::allocate(size_t bytes, bool zero)
+{
+    if(bytes == 0)
+        bytes = 1;
+#ifndef _WIN32
+    if(bytes >= options.threshold)
+    {
+        size_t length = roundUp(bytes, HugePage);
+        std::unique_lock<std::mutex> guard(lock);
+
+        /* Nejmenší držený buffer, do kterého se požadavek vejde a nebude v něm ležet ladem víc než polovina */
+        std::multimap<size_t, void*>::iterator it = retained.lower_bound(length);
+        if(it != retained.end() && it->first <= 2 * length)
+        {
+            void *p = it->second;
+            retainedBytes -= it->first;
+            retained.erase(it);
+            guard.unlock();
+            if(zero)
+                std::memset(p, 0, bytes);
+            return p;
+        }
+
+        void *p = mapAligned(length);
+        if(p)
+        {
+            bindNodes(p, length);
+            mapped[p] = length;
+            /* Čerstvě namapované stránky jsou vynulované */
+            return p;
+        }
+    }
+#endif
+    void *p = heapAllocate(bytes);
+    if(!p)
+        throw std::bad_alloc();
+    if(zero)
+        std::memset(p, 0, bytes);
+    return p;
+}
+
+void Arena::release(void *p)
+{
+    if(!p)
+        return;
+#ifndef _WIN32
+    std::lock_guard<std::mutex> guard(lock);
+    std::unordered_map<void*, size_t>::iterator it = mapped.find(p);
+    if(it != mapped.end())
+    {
+        if(retainedBytes + it->second <= options.retain)
+        {
+            retained.insert(std::make_pair(it->second, p));
+            retainedBytes += it->second;
+        }
+        else
+        {
+            munmap(p, it->second);
+            mapped.erase(it);
+        }
+        return;
+    }
+#endif
+    heapRelease(p);
+}
+
+void Arena::releaseAll()
+{
+#ifndef _WIN32
+    std::lock_guard<std::mutex> guard(lock);
+    for(std::multimap<size_t, void*>::iterator it = retained.begin(); it != retained.end(); ++it)
+    {
+        munmap(it->second, it->first);
+        mapped.erase(it->second);
+    }
+    retained.clear();
+    retainedBytes = 0;
+#endif
+}
@@ -0,0 +1,96 @@
+﻿#ifndef ARENA_H
+#define ARENA_H
+#include "complex.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Alokátor velkých bufferů (raw data a PData) po stránkách z jádra.
+ *
+ * Buffery od Threshold výš se mapují přímo (mmap) zarovnané na 2 MB, aby je jádro mohlo
+ * pokrýt velkými stránkami, buď transparentními (madvise), nebo vyhrazenými (MAP_HUGETLB).
+ * Na víceprocesorových strojích je lze svázat s jedním NUMA uzlem, nebo je rozložit
+ * po všech uzlech. Menší buffery se alokují z haldy. Všechny buffery jsou zarovnané
+ * alespoň na Alignment.
+ *
+ * Uvolněné velké buffery se nevracejí jádru hned, ale drží se pro další alokace stejné úlohy
+ * (změna délky, tempo, další výstupy), jejichž stránky tak už jsou namapované. Jádru se vrátí
+ * hromadně na konci úlohy metodou releaseAll(), nebo když jich je víc než Options::retain.
+ * Na Windows se vše alokuje z haldy se zarovnáním.
+ */
+class Arena
+{
+public:
+    static const size_t Alignment = 64;             /**< Zaručené zarovnání, stačí pro SSE i AVX-512. */
+    static const size_t HugePage = 2 << 20;         /**< Velikost velké stránky. */
+
+    /**
+     * @brief Použití velkých stránek.
+     */
+    enum HugePages
+    {
+        Off,            /**< Jen běžné stránky. */
+        Transparent,    /**< Transparentní velké stránky (madvise), pokud je jádro podporuje. */
+        Explicit        /**< Vyhrazené velké stránky (MAP_HUGETLB), když nejsou, tak transparentní. */
+    };
+
+    /**
+     * @brief Nastavení alokátoru.
+     */
+    struct Options
+    {
+        HugePages hugePages;    /**< Použití velkých stránek. */
+        int node;               /**< NUMA uzel pro velké buffery, -1 bez vazby. */
+        bool interleave;        /**< Rozložit velké buffery po všech NUMA uzlech. */
+        size_t threshold;       /**< Od jaké velikosti v Bajtech se buffer mapuje přímo. */
+        size_t retain;          /**< Kolik Bajtů uvolněných bufferů se nejvýš drží pro další alokace. */
+
+        Options() : hugePages(Transparent), node(-1), interleave(false), threshold(HugePage), retain(size_t(1) << 30) {}
+    };
+
+    static Options options;     /**< Globální nastavení, čte se při každé alokaci. */
+
+    /**
+     * @brief           Alokuje buffer.
+     * @param bytes     Velikost v Bajtech.
+     * @param zero      Jestli má být buffer vynulovaný.
+     * @return          Vrací zarovnaný buffer, při nedostatku paměti vyhodí std::bad_alloc.
+     */
+    static void* allocate(size_t bytes, bool zero = false);
+
+    /**
+     * @brief       Uvolní buffer z allocate().
+     * @param p     Buffer, nebo 0.
+     */
+    static void release(void *p);
+
+    /**
+     * @brief   Vrátí jádru všechny držené uvolněné buffery. Volá se na konci úlohy.
+     */
+    static void releaseAll();
+};
+
+/**
+ * @brief Alokátor pro std::vector nad Arena.
+ */
+template<class T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    ArenaAllocator() {}
+    template<class U> ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(Arena::allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t) { Arena::release(p); }
+
+    template<class U> bool operator==(const ArenaAllocator<U>&) const { return true; }
+    template<class U> bool operator!=(const ArenaAllocator<U>&) const { return false; }
+};
+
+/**
+ * @brief Kanál rozparsovaných dat.
+ */
+typedef std::vector<complex, ArenaAllocator<complex> > ChannelData;
+
+#endif // ARENA_H
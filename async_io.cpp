@@ -0,0 +1,563 @@
+﻿#include "async_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <stdlib.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define ZAPOCTAK_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+AsyncIO::Options AsyncIO::options;
+
+namespace
+{
+    /* Zarovnání bufferů a pozic pro O_DIRECT */
+    const size_t Alignment = 4096;
+
+    inline uint64_t alignDown(uint64_t x) { return x / Alignment * Alignment; }
+    inline uint64_t alignUp(uint64_t x) { return (x + Alignment - 1) / Alignment * Alignment; }
+
+    char* allocAligned(size_t size)
+    {
+#ifdef _WIN32
+        return static_cast<char*>(_aligned_malloc(size, Alignment));
+#else
+        void *p = 0;
+        return posix_memalign(&p, Alignment, size) == 0 ? static_cast<char*>(p) : 0;
+#endif
+    }
+
+    void freeAligned(char *p)
+    {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    /* Otevře soubor, O_DIRECT zkusí jen pokud je požadován a vrátí, jestli se povedl */
+    int openFile(const std::string &filename, bool write, bool &direct)
+    {
+        int flags = write ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+#ifdef _WIN32
+        direct = false;
+        return _open(filename.c_str(), flags | _O_BINARY, 0644);
+#else
+#ifdef O_DIRECT
+        if(direct)
+        {
+            int fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+            if(fd >= 0)
+                return fd;
+            /* Některé souborové systémy (tmpfs) O_DIRECT nepodporují */
+            std::cerr << "ERROR: O_DIRECT neni podporovano, ctu/zapisuju pres page cache." << std::endl;
+        }
+#endif
+        direct = false;
+        return open(filename.c_str(), flags, 0644);
+#endif
+    }
+
+    void closeFile(int fd)
+    {
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+    }
+
+    /* Blokující čtení nebo zápis na dané pozici, dokud se nepřenese vše nebo nenastane konec souboru */
+    long transfer(int fd, const AsyncIO::Request &r)
+    {
+        size_t total = 0;
+        while(total < r.size)
+        {
+#ifdef _WIN32
+            /* Pozici sdílí celý deskriptor, ale pracuje s ním jen jedno I/O vlákno */
+            _lseeki64(fd, r.offset + total, SEEK_SET);
+            long n = r.write ? _write(fd, r.buffer + total, unsigned(r.size - total))
+                             : _read(fd, r.buffer + total, unsigned(r.size - total));
+#else
+            long n = r.write ? pwrite(fd, r.buffer + total, r.size - total, r.offset + total)
+                             : pread(fd, r.buffer + total, r.size - total, r.offset + total);
+#endif
+            if(n < 0)
+                return total ? long(total) : -1;
+            if(n == 0)
+                break;
+            total += n;
+        }
+        return long(total);
+    }
+
+    /**
+     * @brief Engine s jedním pomocným vláknem, které provádí operace postupně.
+     */
+    class ThreadEngine : public AsyncIO::Engine
+    {
+    public:
+        ThreadEngine() : stop(false), worker(&ThreadEngine::loop, this) {}
+
+        ~ThreadEngine()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+
+        bool submit(int fd, const AsyncIO::Request &request)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.push_back(std::make_pair(fd, request));
+            }
+            wake.notify_one();
+            return true;
+        }
+
+        bool wait(size_t &tag, long &result)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this] { return !completed.empty(); });
+            tag = completed.front().first;
+            result = completed.front().second;
+            completed.pop_front();
+            return true;
+        }
+
+    private:
+        void loop()
+        {
+            for(;;)
+            {
+                std::pair<int, AsyncIO::Request> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [this] { return stop || !pending.empty(); });
+                    if(pending.empty())
+                        return;
+                    job = pending.front();
+                    pending.pop_front();
+                }
+                long result = transfer(job.first, job.second);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    completed.push_back(std::make_pair(job.second.tag, result));
+                }
+                done.notify_one();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        std::deque<std::pair<int, AsyncIO::Request> > pending;
+        std::deque<std::pair<size_t, long> > completed;
+        bool stop;
+        std::thread worker;
+    };
+
+#ifdef ZAPOCTAK_HAVE_IO_URING
+    /**
+     * @brief Engine nad io_uring, operace zpracovává přímo jádro bez pomocných vláken.
+     */
+    class UringEngine : public AsyncIO::Engine
+    {
+    public:
+        explicit UringEngine(size_t depth) : ring(-1), sqPtr(MAP_FAILED), cqPtr(MAP_FAILED), sqes(MAP_FAILED), sqSize(0), cqSize(0), sqesSize(0)
+        {
+            io_uring_params p;
+            std::memset(&p, 0, sizeof(p));
+            ring = syscall(__NR_io_uring_setup, unsigned(depth), &p);
+            if(ring < 0)
+                return;
+
+            sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            if(p.features & IORING_FEAT_SINGLE_MMAP)
+                sqSize = cqSize = std::max(sqSize, cqSize);
+            sqPtr = mmap(0, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+            if(sqPtr == MAP_FAILED)
+                return;
+            if(p.features & IORING_FEAT_SINGLE_MMAP)
+                cqPtr = sqPtr;
+            else
+                cqPtr = mmap(0, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+            sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+            sqes = mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+            if(cqPtr == MAP_FAILED || sqes == MAP_FAILED)
+                return;
+
+            char *sq = static_cast<char*>(sqPtr);
+            char *cq = static_cast<char*>(cqPtr);
+            sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+            sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+            cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+            cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        }
+
+        ~UringEngine()
+        {
+            if(sqes != MAP_FAILED)
+                munmap(sqes, sqesSize);
+            if(cqPtr != MAP_FAILED && cqPtr != sqPtr)
+                munmap(cqPtr, cqSize);
+            if(sqPtr != MAP_FAILED)
+                munmap(sqPtr, sqSize);
+            if(ring >= 0)
+                close(ring);
+        }
+
+        bool valid() const
+        {
+            return ring >= 0 && sqPtr != MAP_FAILED && cqPtr != MAP_FAILED && sqes != MAP_FAILED;
+        }
+
+        bool submit(int fd, const AsyncIO::Request &request)
+        {
+            unsigned tail = *sqTail;
+            unsigned index = tail & *sqMask;
+            io_uring_sqe *sqe = static_cast<io_uring_sqe*>(sqes) + index;
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<unsigned long long>(request.buffer);
+            sqe->len = unsigned(request.size);
+            sqe->off = request.offset;
+            sqe->user_data = request.tag;
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            return syscall(__NR_io_uring_enter, ring, 1, 0, 0, 0, 0) == 1;
+        }
+
+        bool wait(size_t &tag, long &result)
+        {
+            for(;;)
+            {
+                unsigned head = *cqHead;
+                if(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+                {
+                    const io_uring_cqe &cqe = cqes[head & *cqMask];
+                    tag = size_t(cqe.user_data);
+                    result = cqe.res;
+                    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                    return true;
+                }
+                if(syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0 && errno != EINTR)
+                    return false;
+            }
+        }
+
+    private:
+        int ring;
+        void *sqPtr;
+        void *cqPtr;
+        void *sqes;
+        size_t sqSize;
+        size_t cqSize;
+        size_t sqesSize;
+        unsigned *sqTail;
+        unsigned *sqMask;
+        unsigned *sqArray;
+        unsigned *cqHead;
+        unsigned *cqTail;
+        unsigned *cqMask;
+        io_uring_cqe *cqes;
+    };
+#endif
+}
+
+AsyncIO::Engine* AsyncIO::Engine::create(size_t depth)
+{
+#ifdef ZAPOCTAK_HAVE_IO_URING
+    /* io_uring může být zakázané (starší jádro, seccomp), pak se použije vlákno */
+    UringEngine *uring = new UringEngine(depth);
+    if(uring->valid())
+        return uring;
+    delete uring;
+#endif
+    return new ThreadEngine();
+}
+
+AsyncReader::AsyncReader(const std::string &filename, uint64_t offset, char *dest, uint64_t length)
+    : engine(0), fd(-1), dest(dest), offset(offset), length(length), base(offset), chunkSize(alignUp(AsyncIO::options.chunkSize)),
+      chunks(0), submitted(0), inFlight(0), readyChunks(0), direct(AsyncIO::options.direct), failed(false)
+{
+    fd = openFile(filename, false, direct);
+    if(fd < 0)
+    {
+        failed = true;
+        return;
+    }
+    /* S O_DIRECT se čte po zarovnaných blocích do pomocných bufferů */
+    if(direct)
+        base = alignDown(offset);
+    chunks = length ? size_t((offset + length - base + chunkSize - 1) / chunkSize) : 0;
+    done.assign(chunks, 0);
+    progress.assign(chunks, 0);
+    slotOf.assign(chunks, 0);
+    if(direct)
+        for(size_t i = 0; i != AsyncIO::options.depth; ++i)
+        {
+            staging.push_back(allocAligned(chunkSize));
+            freeSlots.push_back(i);
+        }
+    engine = AsyncIO::Engine::create(AsyncIO::options.depth);
+    submitNext();
+}
+
+AsyncReader::~AsyncReader()
+{
+    /* Před uvolněním bufferů se musí dokončit všechna rozpracovaná čtení */
+    while(inFlight && engine)
+    {
+        size_t tag;
+        long result;
+        if(!engine->wait(tag, result))
+            break;
+        --inFlight;
+    }
+    delete engine;
+    for(size_t i = 0; i != staging.size(); ++i)
+        freeAligned(staging[i]);
+    if(fd >= 0)
+        closeFile(fd);
+}
+
+uint64_t AsyncReader::chunkNeeded(size_t chunk) const
+{
+    uint64_t start = base + uint64_t(chunk) * chunkSize;
+    return std::min<uint64_t>(start + chunkSize, offset + length) - start;
+}
+
+void AsyncReader::submitChunk(size_t chunk)
+{
+    uint64_t start = base + uint64_t(chunk) * chunkSize;
+    AsyncIO::Request r;
+    r.write = false;
+    r.offset = start + progress[chunk];
+    r.tag = chunk;
+    if(direct)
+    {
+        r.buffer = staging[slotOf[chunk]] + progress[chunk];
+        r.size = chunkSize - progress[chunk];
+    }
+    else
+    {
+        r.buffer = dest + (start - offset) + progress[chunk];
+        r.size = chunkNeeded(chunk) - progress[chunk];
+    }
+    if(engine->submit(fd, r))
+        ++inFlight;
+    else
+        failed = true;
+}
+
+void AsyncReader::submitNext()
+{
+    while(!failed && inFlight < AsyncIO::options.depth && submitted < chunks && (!direct || !freeSlots.empty()))
+    {
+        if(direct)
+        {
+            slotOf[submitted] = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        submitChunk(submitted++);
+    }
+}
+
+void AsyncReader::complete(size_t chunk, long result)
+{
+    --inFlight;
+    if(result < 0)
+    {
+        failed = true;
+        return;
+    }
+    progress[chunk] += result;
+    if(progress[chunk] < chunkNeeded(chunk))
+    {
+        /* Konec souboru dřív, než se čekalo, jinak jen zkrácené čtení, které se dočte */
+        if(result == 0)
+            failed = true;
+        else
+            submitChunk(chunk);
+        return;
+    }
+
+    if(direct)
+    {
+        /* Zkopíruji z bloku jen tu část, která patří do úseku */
+        uint64_t start = base + uint64_t(chunk) * chunkSize;
+        uint64_t from = std::max(start, offset);
+        uint64_t to = start + chunkNeeded(chunk);
+        std::memcpy(dest + (from - offset), staging[slotOf[chunk]] + (from - start), to - from);
+        freeSlots.push_back(slotOf[chunk]);
+    }
+    done[chunk] = 1;
+    while(readyChunks < chunks && done[readyChunks])
+        ++readyChunks;
+    submitNext();
+}
+
+uint64_t AsyncReader::ready() const
+{
+    if(readyChunks == chunks)
+        return length;
+    uint64_t end = base + uint64_t(readyChunks) * chunkSize;
+    return end > offset ? end - offset : 0;
+}
+
+uint64_t AsyncReader::wait(uint64_t bytes)
+{
+    bytes = std::min(bytes, length);
+    while(!failed && ready() < bytes && inFlight)
+    {
+        size_t tag;
+        long result;
+        if(!engine->wait(tag, result))
+        {
+            failed = true;
+            break;
+        }
+        complete(tag, result);
+    }
+    return ready();
+}
+
+AsyncWriter::AsyncWriter(const std::string &filename)
+    : engine(0), fd(-1), chunkSize(alignUp(AsyncIO::options.chunkSize)), current(0), fill(0), position(0), inFlight(0),
+      direct(AsyncIO::options.direct), failed(false)
+{
+    fd = openFile(filename, true, direct);
+    if(fd < 0)
+    {
+        failed = true;
+        return;
+    }
+    for(size_t i = 0; i != AsyncIO::options.depth + 1; ++i)
+    {
+        slots.push_back(allocAligned(chunkSize));
+        freeSlots.push_back(i);
+    }
+    current = freeSlots.back();
+    freeSlots.pop_back();
+    engine = AsyncIO::Engine::create(AsyncIO::options.depth);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    if(fd >= 0)
+        finish();
+    delete engine;
+    for(size_t i = 0; i != slots.size(); ++i)
+        freeAligned(slots[i]);
+}
+
+bool AsyncWriter::reap()
+{
+    size_t tag;
+    long result;
+    if(!engine->wait(tag, result))
+        return !(failed = true);
+    --inFlight;
+    /* Zápis do souboru na disku se nezkracuje, pokud se nezapsalo vše, je to chyba */
+    if(result < 0 || size_t(result) != pending[tag])
+        failed = true;
+    freeSlots.push_back(tag);
+    return !failed;
+}
+
+bool AsyncWriter::flushSlot()
+{
+    if(fill == 0)
+        return true;
+    AsyncIO::Request r;
+    r.write = true;
+    r.buffer = slots[current];
+    /* S O_DIRECT musí být velikost zarovnaná, přebytek se na konci usekne */
+    r.size = direct ? alignUp(fill) : fill;
+    r.offset = position;
+    r.tag = current;
+    if(r.size != fill)
+        std::memset(slots[current] + fill, 0, r.size - fill);
+    pending.resize(slots.size());
+    pending[current] = r.size;
+    if(!engine->submit(fd, r))
+        return !(failed = true);
+    ++inFlight;
+    position += fill;
+    fill = 0;
+
+    /* Další buffer, případně počkám, až se nějaký uvolní */
+    while(freeSlots.empty() && !failed)
+        reap();
+    if(failed)
+        return false;
+    current = freeSlots.back();
+    freeSlots.pop_back();
+    return true;
+}
+
+bool AsyncWriter::write(const char *data, size_t size)
+{
+    while(size && !failed)
+    {
+        size_t n = std::min(size, chunkSize - fill);
+        std::memcpy(slots[current] + fill, data, n);
+        fill += n;
+        data += n;
+        size -= n;
+        if(fill == chunkSize && !flushSlot())
+            return false;
+    }
+    return !failed;
+}
+
+bool AsyncWriter::finish()
+{
+    if(fd < 0)
+        return !failed;
+    uint64_t total = position + fill;
+    if(!failed)
+        flushSlot();
+    while(inFlight && reap())
+        ;
+#ifndef _WIN32
+    /* Oříznutí zarovnávacích nul za koncem dat */
+    if(direct && ftruncate(fd, total) != 0)
+        failed = true;
+#endif
+    closeFile(fd);
+    fd = -1;
+    return !failed;
+}
@@ -0,0 +1,190 @@
+﻿#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Asynchronní čtení a zápis souborů po blocích.
+ *
+ * Čtení a zápis běží na pozadí, zatímco program zpracovává již načtená data,
+ * respektive připravuje další data k zápisu. Na Linuxu se používá io_uring,
+ * pokud ho jádro podporuje, jinak jedno pomocné vlákno s blokujícím I/O.
+ * Najednou je rozpracováno nejvýše options.depth bloků velikosti options.chunkSize.
+ */
+struct AsyncIO
+{
+    /**
+     * @brief Nastavení asynchronního I/O.
+     */
+    struct Options
+    {
+        size_t depth;       /**< Počet bloků rozpracovaných najednou. */
+        size_t chunkSize;   /**< Velikost bloku v Bajtech, zaokrouhlí se na násobek 4096. */
+        bool direct;        /**< Jestli obejít page cache (O_DIRECT), vhodné pro velmi velké soubory. */
+
+        Options() : depth(4), chunkSize(1 << 20), direct(false) {}
+    };
+
+    static Options options; /**< Globální nastavení, čte se při vytvoření čtečky nebo zapisovače. */
+
+    /**
+     * @brief Jedna I/O operace předaná jádru nebo pomocnému vláknu.
+     */
+    struct Request
+    {
+        bool write;         /**< Zápis, jinak čtení. */
+        char *buffer;       /**< Buffer s daty, respektive pro data. */
+        size_t size;        /**< Velikost v Bajtech. */
+        uint64_t offset;    /**< Pozice v souboru. */
+        size_t tag;         /**< Identifikace požadavku pro volajícího. */
+    };
+
+    /**
+     * @brief Rozhraní pro provádění I/O operací na pozadí.
+     */
+    class Engine
+    {
+    public:
+        virtual ~Engine() {}
+
+        /**
+         * @brief           Zařadí operaci ke zpracování.
+         * @param fd        Deskriptor souboru.
+         * @param request   Operace.
+         * @return          Vrací, jestli se operaci podařilo zařadit.
+         */
+        virtual bool submit(int fd, const Request &request) = 0;
+
+        /**
+         * @brief               Počká na dokončení některé operace.
+         * @param[out] tag      Identifikace dokončené operace.
+         * @param[out] result   Počet přenesených Bajtů, nebo záporný kód chyby.
+         * @return              Vrací false při chybě samotného čekání.
+         */
+        virtual bool wait(size_t &tag, long &result) = 0;
+
+        /**
+         * @brief   Vytvoří nejlepší dostupný engine.
+         * @param depth Maximální počet rozpracovaných operací.
+         * @return  Vrací io_uring engine, pokud je k dispozici, jinak engine s pomocným vláknem.
+         */
+        static Engine* create(size_t depth);
+    };
+};
+
+/**
+ * @brief Čte souvislý úsek souboru do paměti s předčítáním.
+ *
+ * Úsek se čte po blocích postupně od začátku, volající může zpracovávat začátek úseku,
+ * zatímco se čte zbytek.
+ */
+class AsyncReader
+{
+public:
+    /**
+     * @brief           Konstruktor, rovnou zahájí čtení.
+     * @param filename  Jméno souboru.
+     * @param offset    Začátek úseku v souboru.
+     * @param dest      Buffer, kam se úsek načte.
+     * @param length    Délka úseku.
+     */
+    AsyncReader(const std::string &filename, uint64_t offset, char *dest, uint64_t length);
+    ~AsyncReader();
+
+    /**
+     * @brief           Počká, až bude načteno alespoň bytes Bajtů od začátku úseku.
+     * @param bytes     Požadovaný počet Bajtů.
+     * @return          Vrací počet souvisle načtených Bajtů, při chybě nebo konci souboru může být menší.
+     */
+    uint64_t wait(uint64_t bytes);
+
+    /**
+     * @brief   Zjistí, jestli nenastala chyba.
+     */
+    bool ok() const { return !failed; }
+
+private:
+    AsyncReader(const AsyncReader&);
+    AsyncReader& operator=(const AsyncReader&);
+
+    void submitNext();
+    void submitChunk(size_t chunk);
+    void complete(size_t chunk, long result);
+    uint64_t chunkNeeded(size_t chunk) const;
+    uint64_t ready() const;
+
+    AsyncIO::Engine *engine;        /**< Engine provádějící čtení. */
+    int fd;                         /**< Deskriptor souboru. */
+    char *dest;                     /**< Cílový buffer. */
+    uint64_t offset;                /**< Začátek úseku v souboru. */
+    uint64_t length;                /**< Délka úseku. */
+    uint64_t base;                  /**< Pozice prvního bloku v souboru (zarovnaná pro O_DIRECT). */
+    size_t chunkSize;               /**< Velikost bloku. */
+    size_t chunks;                  /**< Počet bloků. */
+    size_t submitted;               /**< Počet zahájených bloků. */
+    size_t inFlight;                /**< Počet rozpracovaných bloků. */
+    size_t readyChunks;             /**< Počet souvisle načtených bloků od začátku. */
+    std::vector<char> done;         /**< Které bloky jsou načtené. */
+    std::vector<uint64_t> progress; /**< Kolik Bajtů bloku už je načteno. */
+    std::vector<size_t> slotOf;     /**< Pomocný buffer, do kterého se blok čte. */
+    std::vector<char*> staging;     /**< Zarovnané buffery pro O_DIRECT, jeden na rozpracovaný blok. */
+    std::vector<size_t> freeSlots;  /**< Volné pomocné buffery. */
+    bool direct;                    /**< Jestli se čte s O_DIRECT. */
+    bool failed;                    /**< Jestli nastala chyba. */
+};
+
+/**
+ * @brief Zapisuje soubor postupně od začátku, zápis běží na pozadí.
+ */
+class AsyncWriter
+{
+public:
+    /**
+     * @brief           Konstruktor, vytvoří (přepíše) soubor.
+     * @param filename  Jméno souboru.
+     */
+    explicit AsyncWriter(const std::string &filename);
+    ~AsyncWriter();
+
+    /**
+     * @brief       Připojí data na konec souboru.
+     * @param data  Data, po návratu je lze hned přepsat.
+     * @param size  Velikost dat.
+     * @return      Vrací, jestli nenastala chyba.
+     */
+    bool write(const char *data, size_t size);
+
+    /**
+     * @brief   Zapíše zbytek dat, počká na dokončení všech zápisů a zavře soubor.
+     * @return  Vrací, jestli celý zápis proběhl bez chyby.
+     */
+    bool finish();
+
+    /**
+     * @brief   Zjistí, jestli nenastala chyba.
+     */
+    bool ok() const { return !failed; }
+
+private:
+    AsyncWriter(const AsyncWriter&);
+    AsyncWriter& operator=(const AsyncWriter&);
+
+    bool flushSlot();
+    bool reap();
+
+    AsyncIO::Engine *engine;        /**< Engine provádějící zápis. */
+    int fd;                         /**< Deskriptor souboru. */
+    size_t chunkSize;               /**< Velikost bloku. */
+    std::vector<char*> slots;       /**< Zarovnané buffery bloků. */
+    std::vector<size_t> freeSlots;  /**< Volné buffery. */
+    std::vector<size_t> pending;    /**< Velikost rozpracovaného zápisu každého bufferu. */
+    size_t current;                 /**< Plněný buffer. */
+    size_t fill;                    /**< Zaplnění plněného bufferu. */
+    uint64_t position;              /**< Pozice plněného bufferu v souboru. */
+    size_t inFlight;                /**< Počet rozpracovaných zápisů. */
+    bool direct;                    /**< Jestli se zapisuje s O_DIRECT. */
+    bool failed;                    /**< Jestli nastala chyba. */
+};
+
+#endif // ASYNC_IO_H
@@ -0,0 +1,159 @@
+﻿#include "batch_fft.h"
+#include "complex.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ZAPOCTAK_BATCH_SSE2
+#endif
+
+size_t BatchFFT::maxLanes = BatchFFT::MaxLanes;
+
+namespace
+{
+    /**
+     * @brief Motýlek pro Lanes kanálů: Product = Factor * Data[Match],
+     * Data[Match] = Data[Pair] - Product, Data[Pair] += Product.
+     */
+    template<size_t Lanes>
+    inline void butterfly(double *pair, double *match, double fr, double fi)
+    {
+        double *pr = pair, *pi = pair + Lanes;
+        double *mr = match, *mi = match + Lanes;
+        size_t l = 0;
+#ifdef ZAPOCTAK_BATCH_SSE2
+        const __m128d vfr = _mm_set1_pd(fr), vfi = _mm_set1_pd(fi);
+        for(; l + 2 <= Lanes; l += 2)
+        {
+            __m128d c = _mm_loadu_pd(mr + l), d = _mm_loadu_pd(mi + l);
+            __m128d xr = _mm_sub_pd(_mm_mul_pd(vfr, c), _mm_mul_pd(vfi, d));
+            __m128d xi = _mm_add_pd(_mm_mul_pd(vfr, d), _mm_mul_pd(vfi, c));
+            __m128d ar = _mm_loadu_pd(pr + l), ai = _mm_loadu_pd(pi + l);
+            _mm_storeu_pd(mr + l, _mm_sub_pd(ar, xr));
+            _mm_storeu_pd(mi + l, _mm_sub_pd(ai, xi));
+            _mm_storeu_pd(pr + l, _mm_add_pd(ar, xr));
+            _mm_storeu_pd(pi + l, _mm_add_pd(ai, xi));
+        }
+#endif
+        for(; l != Lanes; ++l)
+        {
+            /* Stejné pořadí operací jako complex::operator* */
+            const double xr = fr * mr[l] - fi * mi[l];
+            const double xi = fr * mi[l] + fi * mr[l];
+            mr[l] = pr[l] - xr;
+            mi[l] = pi[l] - xi;
+            pr[l] += xr;
+            pi[l] += xi;
+        }
+    }
+
+    /* Faktory aktuální úrovně, každé vlákno má své. Alokují se jen při první (největší) FFT. */
+    thread_local std::vector<complex> factors;
+}
+
+template<size_t Lanes>
+void BatchFFT::rearrange(double *data, size_t N)
+{
+    /* Bitová reverze jako v CFFT, prohazují se celé prvky se všemi kanály */
+    const size_t Width = 2 * Lanes;
+    size_t Target = 0;
+    for(size_t Position = 0; Position < N; ++Position)
+    {
+        if(Target > Position)
+            std::swap_ranges(data + Position * Width, data + (Position + 1) * Width, data + Target * Width);
+        size_t Mask = N;
+        while(Target & (Mask >>= 1))
+            Target &= ~Mask;
+        Target |= Mask;
+    }
+}
+
+template<size_t Lanes>
+void BatchFFT::perform(double *data, size_t N, bool inverse)
+{
+    const size_t Width = 2 * Lanes;
+    const double pi = inverse ? 3.14159265358979323846 : -3.14159265358979323846;
+    if(factors.size() < N / 2)
+        factors.resize(N / 2);
+    for(size_t Step = 1; Step < N; Step <<= 1)
+    {
+        const size_t Jump = Step << 1;
+        const double delta = pi / double(Step);
+        const double Sine = sin(delta * .5);
+        /* Faktory stejnou rekurencí jako v CFFT, jen předem pro celou úroveň */
+        const complex Multiplier(-2. * Sine * Sine, sin(delta));
+        complex Factor(1.);
+        for(size_t Group = 0; Group < Step; ++Group)
+        {
+            factors[Group] = Factor;
+            Factor = Multiplier * Factor + Factor;
+        }
+        /* Motýlky jedné úrovně jsou nezávislé, procházím je tedy sekvenčně po paměti */
+        for(size_t Base = 0; Base < N; Base += Jump)
+        {
+            double *pair = data + Base * Width;
+            double *match = pair + Step * Width;
+            for(size_t Group = 0; Group < Step; ++Group)
+                butterfly<Lanes>(pair + Group * Width, match + Group * Width, factors[Group].re(), factors[Group].im());
+        }
+    }
+}
+
+bool BatchFFT::run(double *data, size_t N, size_t lanes, bool inverse)
+{
+    if(!data || N < 1 || (N & (N - 1)))
+        return false;
+    switch(lanes)
+    {
+    case 1: rearrange<1>(data, N); perform<1>(data, N, inverse); break;
+    case 2: rearrange<2>(data, N); perform<2>(data, N, inverse); break;
+    case 4: rearrange<4>(data, N); perform<4>(data, N, inverse); break;
+    case 8: rearrange<8>(data, N); perform<8>(data, N, inverse); break;
+    default: return false;
+    }
+    return true;
+}
+
+bool BatchFFT::forward(double *data, size_t N, size_t lanes)
+{
+    return run(data, N, lanes, false);
+}
+
+bool BatchFFT::inverse(double *data, size_t N, size_t lanes, bool scale)
+{
+    if(!run(data, N, lanes, true))
+        return false;
+    if(scale)
+    {
+        const double Factor = 1. / double(N);
+        for(size_t i = 0; i != N * 2 * lanes; ++i)
+            data[i] *= Factor;
+    }
+    return true;
+}
+
+void BatchFFT::filter(double *data, const double *preset, size_t N, size_t lanes)
+{
+    /* Horní polovina spektra je zrcadlová k dolní, proto se preset čte odzadu (jako Wave::applyFilter) */
+    const size_t max_freq = N / 2;
+    for(size_t k = 0; k != N; ++k)
+    {
+        const double b = preset[k < max_freq ? k : N - 1 - k];
+        double *element = data + k * 2 * lanes;
+        for(size_t l = 0; l != 2 * lanes; ++l)
+            element[l] *= b;
+    }
+}
+
+size_t BatchFFT::lanesFor(size_t channels, size_t threads)
+{
+    /* Kolik kanálů připadne na jedno vlákno */
+    threads = std::max<size_t>(threads, 1);
+    size_t perThread = (channels + threads - 1) / threads;
+    size_t lanes = MaxLanes;
+    while(lanes > 1 && (lanes > perThread || lanes > maxLanes))
+        lanes /= 2;
+    return lanes;
+}
@@ -0,0 +1,76 @@
+﻿#ifndef BATCH_FFT_H
+#define BATCH_FFT_H
+#include <cstddef>
+
+/**
+ * @brief FFT několika kanálů najednou.
+ *
+ * Kanály jsou v bufferu proložené po prvcích: k-tý prvek zabírá 2 * lanes hodnot, nejdřív
+ * reálné části všech kanálů a za nimi imaginární, tedy data[k * 2 * lanes + l] a
+ * data[k * 2 * lanes + lanes + l]. Jeden motýlek tak zpracuje stejný prvek ze všech kanálů
+ * najednou v SSE2 vektorech a prvky jednoho motýlku leží v paměti vedle sebe.
+ * Každá úroveň se prochází sekvenčně s předpočítanými faktory, které vzniknou stejnou
+ * rekurencí jako v CFFT, takže výsledek je pro každý kanál bitově stejný jako CFFT.
+ */
+class BatchFFT
+{
+public:
+    /**
+     * @brief   Největší podporovaný počet kanálů v jedné dávce.
+     */
+    static const size_t MaxLanes = 8;
+
+    /**
+     * @brief   Maximální počet kanálů v dávce nastavený uživatelem, 1 dávkování vypíná.
+     */
+    static size_t maxLanes;
+
+    /**
+     * @brief           Dopředná FFT na místě.
+     * @param data      Proložená data, N * 2 * lanes hodnot.
+     * @param N         Velikost FFT, mocnina dvojky.
+     * @param lanes     Počet kanálů v dávce, 1, 2, 4 nebo 8.
+     * @return          Vrací false při špatných parametrech.
+     */
+    static bool forward(double *data, size_t N, size_t lanes);
+
+    /**
+     * @brief           Inverzní FFT na místě.
+     * @param data      Proložená data, N * 2 * lanes hodnot.
+     * @param N         Velikost FFT, mocnina dvojky.
+     * @param lanes     Počet kanálů v dávce, 1, 2, 4 nebo 8.
+     * @param scale     Jestli výsledek vydělit N.
+     * @return          Vrací false při špatných parametrech.
+     */
+    static bool inverse(double *data, size_t N, size_t lanes, bool scale = true);
+
+    /**
+     * @brief           Vynásobí spektrum všech kanálů presetem.
+     * @param data      Proložená data, N * 2 * lanes hodnot.
+     * @param preset    Doplněný preset o alespoň N / 2 hodnotách, horní polovina spektra se filtruje zrcadlově.
+     * @param N         Velikost FFT.
+     * @param lanes     Počet kanálů v dávce.
+     */
+    static void filter(double *data, const double *preset, size_t N, size_t lanes);
+
+    /**
+     * @brief           Vybere velikost dávky pro daný počet kanálů a vláken.
+     * @param channels  Počet kanálů.
+     * @param threads   Počet vláken.
+     * @return          Vrací 8, 4, 2 nebo 1 (bez dávkování).
+     *
+     * Kanály se nejdřív rozdělí mezi vlákna, dávka pak pokryje kanály jednoho vlákna.
+     */
+    static size_t lanesFor(size_t channels, size_t threads);
+
+private:
+    /**
+     * @brief   Zkontroluje parametry a spustí transformaci pro daný počet kanálů.
+     */
+    static bool run(double *data, size_t N, size_t lanes, bool inverse);
+
+    template<size_t Lanes> static void rearrange(double *data, size_t N);
+    template<size_t Lanes> static void perform(double *data, size_t N, bool inverse);
+};
+
+#endif // BATCH_FFT_H
@@ -0,0 +1,256 @@
+﻿#include "catalog.h"
+#include "wave.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    /* Špička ticha, aby index neobsahoval -inf */
+    const double SilencePeak = -120;
+
+    bool isWaveName(const fs::path &path)
+    {
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+        return ext == ".wav";
+    }
+
+    bool endsWith(const std::string &s, const char *suffix)
+    {
+        std::string tail(suffix);
+        return s.size() >= tail.size() && s.compare(s.size() - tail.size(), tail.size(), tail) == 0;
+    }
+
+    template<class T>
+    void put(std::ofstream &out, T value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /* Řetězec pro JSON s escapovanými znaky */
+    std::string quoted(const std::string &s)
+    {
+        std::ostringstream out;
+        out << '"';
+        for(size_t i = 0; i != s.size(); ++i)
+        {
+            unsigned char c = s[i];
+            if(c == '"' || c == '\\')
+                out << '\\' << c;
+            else if(c < 0x20)
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+            else
+                out << c;
+        }
+        out << '"';
+        return out.str();
+    }
+}
+
+const uint32_t Catalog::Version;
+const size_t Catalog::PeakFrames;
+
+bool Catalog::probe(const std::string &path, size_t peakBlocks, Entry &entry)
+{
+    std::ifstream in(path.c_str(), std::ios_base::in | std::ios_base::binary);
+    Wave::RiffChunk rch;
+    Wave::FmtChunk fch;
+    Wave::DataChunkHeader dchh;
+    if(!in.is_open() || !Wave::readHeaders(in,rch,fch,dchh) || fch.BlockAlign == 0)
+        return false;
+
+    /* Oříznutý soubor má méně dat, než uvádí hlavička */
+    uint64_t begin = uint64_t(in.tellg());
+    in.seekg(0, std::ios::end);
+    uint64_t available = uint64_t(in.tellg()) - begin;
+    uint64_t length = std::min<uint64_t>(dchh.length, available);
+
+    entry.path = path;
+    entry.channels = fch.NumChannels;
+    entry.SampleRate = fch.SampleRate;
+    entry.bits = fch.BitsPerSample;
+    entry.samples = length / fch.BlockAlign;
+    entry.peak = std::numeric_limits<double>::quiet_NaN();
+
+    const size_t SizeOfSample = fch.BitsPerSample / 8;
+    if(peakBlocks == 0 || (SizeOfSample != 1 && SizeOfSample != 2) || entry.samples == 0)
+        return true;
+
+    /* Úseky rovnoměrně od začátku do konce dat, krátký soubor se přečte celý */
+    size_t frames = std::min<uint64_t>(PeakFrames, entry.samples);
+    bool whole = entry.samples <= uint64_t(frames) * peakBlocks;
+    size_t blocks = whole ? (entry.samples + frames - 1) / frames : peakBlocks;
+    std::vector<char> buffer(frames * fch.BlockAlign);
+    int peak = 0;
+    for(size_t b = 0; b != blocks; ++b)
+    {
+        uint64_t first = whole ? std::min<uint64_t>(uint64_t(b) * frames, entry.samples - frames)
+                               : (blocks == 1 ? 0 : (entry.samples - frames) * b / (blocks - 1));
+        in.clear();
+        in.seekg(begin + first * fch.BlockAlign);
+        if(!in.read(&buffer[0], buffer.size()))
+            break;
+        for(size_t i = 0; i != buffer.size(); i += SizeOfSample)
+        {
+            int v = SizeOfSample == 2 ? int16_t(static_cast<unsigned char>(buffer[i]) | (static_cast<unsigned char>(buffer[i + 1]) << 8))
+                                      : (int(static_cast<unsigned char>(buffer[i])) - 128) * 256;
+            peak = std::max(peak, std::abs(v));
+        }
+    }
+    entry.peak = peak ? std::max(SilencePeak, 20 * std::log10(peak / 32768.)) : SilencePeak;
+    return true;
+}
+
+bool Catalog::build(const std::string &root, const std::string &output, size_t peakBlocks)
+{
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::error_code ec;
+    if(!fs::is_directory(root, ec))
+    {
+        std::cerr << "ERROR: Adresar pro katalog neexistuje: " << root << std::endl;
+        return false;
+    }
+
+    /* Průchod po úrovních: každé vlákno přečte jeden adresář, podadresáře tvoří další úroveň */
+    ThreadPool &pool = ThreadPool::instance();
+    std::vector<std::vector<std::string> > files(pool.size());
+    std::vector<fs::path> level(1, fs::path(root));
+    while(!level.empty())
+    {
+        std::vector<std::vector<fs::path> > next(pool.size());
+        pool.run(level.size(), [&](size_t d, size_t worker) {
+            std::error_code error;
+            fs::directory_iterator it(level[d], fs::directory_options::skip_permission_denied, error);
+            for(; !error && it != fs::directory_iterator(); it.increment(error))
+            {
+                std::error_code type;
+                /* Odkazy na adresáře se nenásledují, mohly by tvořit cyklus */
+                if(it->is_directory(type) && !it->is_symlink(type))
+                    next[worker].push_back(it->path());
+                else if(it->is_regular_file(type) && isWaveName(it->path()))
+                    files[worker].push_back(it->path().string());
+            }
+        });
+        level.clear();
+        for(size_t w = 0; w != next.size(); ++w)
+            level.insert(level.end(), next[w].begin(), next[w].end());
+    }
+
+    std::vector<std::string> paths;
+    for(size_t w = 0; w != files.size(); ++w)
+        paths.insert(paths.end(), files[w].begin(), files[w].end());
+    std::sort(paths.begin(), paths.end());
+
+    /* Hlavičky souborů paralelně, čtení je malé, takže se vyplatí i víc souborů najednou na disk */
+    std::vector<Entry> entries(paths.size());
+    std::vector<char> valid(paths.size(), 0);
+    pool.run(paths.size(), [&](size_t i, size_t) {
+        valid[i] = probe(paths[i], peakBlocks, entries[i]);
+    });
+    size_t invalid = 0;
+    size_t kept = 0;
+    for(size_t i = 0; i != entries.size(); ++i)
+    {
+        if(!valid[i])
+        {
+            ++invalid;
+            continue;
+        }
+        if(kept != i)
+            entries[kept] = std::move(entries[i]);
+        ++kept;
+    }
+    entries.resize(kept);
+
+    if(!write(entries, output))
+        return false;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Katalog: " << entries.size() << " souboru, " << invalid << " neplatnych, "
+              << seconds << " s." << std::endl;
+    return true;
+}
+
+bool Catalog::write(const std::vector<Entry> &entries, const std::string &output)
+{
+    std::ofstream out(output.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    const bool csv = endsWith(output, ".csv");
+    const bool json = endsWith(output, ".json");
+    if(csv || json)
+    {
+        out << std::fixed;
+        if(csv)
+            out << "path,channels,sample_rate,bits,samples,seconds,peak_db\n";
+        else
+            out << "[\n";
+        for(size_t i = 0; i != entries.size(); ++i)
+        {
+            const Entry &e = entries[i];
+            double seconds = e.SampleRate ? double(e.samples) / e.SampleRate : 0;
+            if(csv)
+            {
+                /* Cesta s čárkou nebo uvozovkami se uzavře do uvozovek podle RFC 4180 */
+                std::string path = e.path;
+                if(path.find_first_of(",\"\n") != std::string::npos)
+                {
+                    std::string escaped = "\"";
+                    for(size_t k = 0; k != path.size(); ++k)
+                        escaped += path[k] == '"' ? std::string("\"\"") : std::string(1, path[k]);
+                    path = escaped + "\"";
+                }
+                out << path << ',' << e.channels << ',' << e.SampleRate << ',' << e.bits << ',' << e.samples << ','
+                    << std::setprecision(3) << seconds << ',';
+                if(!std::isnan(e.peak))
+                    out << std::setprecision(2) << e.peak;
+                out << '\n';
+            }
+            else
+            {
+                out << "  {\"path\": " << quoted(e.path) << ", \"channels\": " << e.channels
+                    << ", \"sample_rate\": " << e.SampleRate << ", \"bits\": " << e.bits << ", \"samples\": " << e.samples
+                    << ", \"seconds\": " << std::setprecision(3) << seconds << ", \"peak_db\": ";
+                if(std::isnan(e.peak))
+                    out << "null";
+                else
+                    out << std::setprecision(2) << e.peak;
+                out << (i + 1 != entries.size() ? "},\n" : "}\n");
+            }
+        }
+        if(json)
+            out << "]\n";
+    }
+    else
+    {
+        out.write("ZCAT", 4);
+        put<uint32_t>(out, Version);
+        put<uint64_t>(out, entries.size());
+        for(size_t i = 0; i != entries.size(); ++i)
+        {
+            const Entry &e = entries[i];
+            put<uint16_t>(out, uint16_t(std::min<size_t>(e.path.size(), 0xFFFF)));
+            out.write(e.path.data(), std::min<size_t>(e.path.size(), 0xFFFF));
+            put<uint16_t>(out, e.channels);
+            put<uint32_t>(out, e.SampleRate);
+            put<uint16_t>(out, e.bits);
+            put<uint64_t>(out, e.samples);
+            put<float>(out, float(e.peak));
+        }
+    }
+    if(!out)
+    {
+        std::cerr << "ERROR: Nelze zapsat katalog: " << output << std::endl;
+        return false;
+    }
+    return true;
+}
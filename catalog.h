@@ -0,0 +1,75 @@
+﻿#ifndef CATALOG_H
+#define CATALOG_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Katalog WAV souborů v adresáři: formát, délka a odhad špičky bez načítání dat.
+ *
+ * Adresáře se procházejí paralelně po úrovních, každé vlákno čte jeden adresář. Z každého
+ * WAV souboru se přečtou jen hlavičky (Wave::readHeaders()), data se vůbec nealokují.
+ * Špička se volitelně odhadne z několika rovnoměrně rozmístěných úseků dat.
+ *
+ * Formát indexu se vybere podle přípony výstupu:
+ *
+ *     .csv    path,channels,sample_rate,bits,samples,seconds,peak_db
+ *     .json   pole objektů se stejnými klíči
+ *     jinak   binární: "ZCAT", uint32 verze, uint64 počet záznamů, záznamy:
+ *             uint16 délka cesty, cesta v UTF-8, uint16 kanály, uint32 vzorkovací frekvence,
+ *             uint16 bity, uint64 samply v kanálu, float špička v dBFS (NaN, pokud se nepočítala)
+ *
+ * Záznamy jsou seřazené podle cesty, špička bez odhadu je v CSV a JSON prázdná, respektive null,
+ * špička ticha je -120 dB.
+ */
+class Catalog
+{
+public:
+    static const uint32_t Version = 1;          /**< Verze binárního formátu. */
+    static const size_t PeakFrames = 4096;      /**< Počet samplů v jednom úseku pro odhad špičky. */
+
+    /**
+     * @brief Jeden soubor katalogu.
+     */
+    struct Entry
+    {
+        std::string path;       /**< Cesta k souboru. */
+        uint16_t channels;      /**< Počet kanálů. */
+        uint32_t SampleRate;    /**< Vzorkovací frekvence. */
+        uint16_t bits;          /**< Bitů na sampl. */
+        uint64_t samples;       /**< Počet samplů v kanálu. */
+        double peak;            /**< Odhad špičky v dBFS, NaN bez odhadu. */
+    };
+
+    /**
+     * @brief               Projde adresář a uloží katalog WAV souborů.
+     * @param root          Kořenový adresář, prochází se i podadresáře.
+     * @param output        Jméno výstupního indexu.
+     * @param peakBlocks    Z kolika úseků se odhadne špička, 0 = bez odhadu.
+     * @return              Vrací false, pokud adresář nejde projít nebo index nejde zapsat.
+     *
+     * Soubory s poškozenými hlavičkami se do katalogu nezapíšou, jen se započítají.
+     */
+    static bool build(const std::string &root, const std::string &output, size_t peakBlocks);
+
+    /**
+     * @brief               Přečte hlavičky jednoho souboru a případně odhadne špičku.
+     * @param path          Cesta k WAV souboru.
+     * @param peakBlocks    Z kolika úseků se odhadne špička, 0 = bez odhadu.
+     * @param[out] entry    Záznam souboru.
+     * @return              Vrací false, pokud soubor nemá platné hlavičky.
+     */
+    static bool probe(const std::string &path, size_t peakBlocks, Entry &entry);
+
+private:
+    /**
+     * @brief           Zapíše záznamy ve formátu podle přípony.
+     * @param entries   Záznamy.
+     * @param output    Jméno výstupu.
+     * @return          Vrací false při chybě zápisu.
+     */
+    static bool write(const std::vector<Entry> &entries, const std::string &output);
+};
+
+#endif // CATALOG_H
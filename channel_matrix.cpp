@@ -0,0 +1,186 @@
+﻿#include "channel_matrix.h"
+#include "wave.h"
+#include "data_utility.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ZAPOCTAK_MATRIX_SSE2
+#endif
+
+namespace
+{
+    /* Počet samplů v kanálu, které se přemixují najednou */
+    const size_t BlockFrames = 4096;
+
+    /* Stereo downmix 5.1 podle ITU-R BS.775, pořadí kanálů WAV: L R C LFE Ls Rs */
+    void ituStereo(std::vector<double> &m)
+    {
+        const double a = std::sqrt(0.5);
+        const double rows[2][6] = { { 1, 0, a, 0, a, 0 },
+                                    { 0, 1, a, 0, 0, a } };
+        m.assign(&rows[0][0], &rows[0][0] + 12);
+    }
+}
+
+bool ChannelMatrix::load(const std::string &spec, size_t NumChannels)
+{
+    inputs = NumChannels;
+    coefficients.clear();
+    if(spec == "stereo")
+    {
+        if(NumChannels == 6)
+            ituStereo(coefficients);
+        else if(NumChannels == 1)
+            coefficients.assign(2, 1);
+        else if(NumChannels == 2)
+        {
+            const double rows[4] = { 1, 0, 0, 1 };
+            coefficients.assign(rows, rows + 4);
+        }
+    }
+    else if(spec == "mono")
+    {
+        if(NumChannels == 6)
+        {
+            std::vector<double> stereo;
+            ituStereo(stereo);
+            for(size_t c = 0; c != 6; ++c)
+                coefficients.push_back((stereo[c] + stereo[6 + c]) / 2);
+        }
+        else
+            coefficients.assign(NumChannels, 1. / NumChannels);
+    }
+    else if(spec == "ms" || spec == "lr")
+    {
+        if(NumChannels == 2)
+        {
+            /* Kódování dělí dvěma, aby se M a S vešly do rozsahu, dekódování pak jen sčítá */
+            const double h = spec == "ms" ? 0.5 : 1;
+            const double rows[4] = { h, h, h, -h };
+            coefficients.assign(rows, rows + 4);
+        }
+    }
+    else
+    {
+        std::ifstream in(spec.c_str());
+        if(!in.is_open())
+        {
+            std::cerr << "ERROR: Nelze nacist matici kanalu: " << spec << std::endl;
+            return false;
+        }
+        std::string line;
+        while(std::getline(in, line))
+        {
+            size_t first = line.find_first_not_of(" \t\r");
+            if(first == std::string::npos || line[first] == '#')
+                continue;
+            std::istringstream row(line);
+            std::vector<double> values;
+            double value;
+            while(row >> value)
+                values.push_back(value);
+            if(!row.eof() || values.size() != NumChannels)
+            {
+                std::cerr << "ERROR: Radek matice kanalu musi mit " << NumChannels << " koeficientu: " << line << std::endl;
+                return false;
+            }
+            coefficients.insert(coefficients.end(), values.begin(), values.end());
+        }
+    }
+    if(coefficients.empty() || NumChannels == 0)
+    {
+        std::cerr << "ERROR: Matici kanalu " << spec << " nelze pouzit pro " << NumChannels << " kanalu." << std::endl;
+        return false;
+    }
+    outputs = coefficients.size() / NumChannels;
+    return true;
+}
+
+void ChannelMatrix::applyRow(size_t output, const double *const *in, double *out, size_t count) const
+{
+    const double *m = &coefficients[output * inputs];
+    size_t i = 0;
+#ifdef ZAPOCTAK_MATRIX_SSE2
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128d a0 = _mm_setzero_pd();
+        __m128d a1 = _mm_setzero_pd();
+        for(size_t c = 0; c != inputs; ++c)
+        {
+            const __m128d k = _mm_set1_pd(m[c]);
+            a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(in[c] + i), k));
+            a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(in[c] + i + 2), k));
+        }
+        _mm_storeu_pd(out + i, a0);
+        _mm_storeu_pd(out + i + 2, a1);
+    }
+#endif
+    for(; i != count; ++i)
+    {
+        double sum = 0;
+        for(size_t c = 0; c != inputs; ++c)
+            sum += in[c][i] * m[c];
+        out[i] = sum;
+    }
+}
+
+Wave* ChannelMatrix::apply(const Wave &wave) const
+{
+    const size_t SizeOfSample = wave.fchunk.BitsPerSample / 8;
+    if(wave.fchunk.NumChannels != inputs || (!wave.PData && SizeOfSample != 1 && SizeOfSample != 2))
+    {
+        std::cerr << "ERROR: Matice kanalu neodpovida vstupu." << std::endl;
+        return 0;
+    }
+    const bool parsed = wave.PData != 0;
+    const size_t samples = parsed ? wave.PData[0].size() : wave.dchunk.head.length / (inputs * SizeOfSample);
+    Wave::FmtChunk fmt = wave.fchunk;
+    fmt.NumChannels = outputs;
+    Wave *ret = Wave::create(fmt,samples);
+
+    /* Každé vlákno má své buffery bloku: vstupní kanály za sebou a jeden výstupní kanál */
+    ThreadPool &pool = ThreadPool::instance();
+    std::vector<std::vector<double> > buffers(pool.size(), std::vector<double>((inputs + 1) * BlockFrames));
+    pool.run((samples + BlockFrames - 1) / BlockFrames, [&](size_t block, size_t worker) {
+        size_t from = block * BlockFrames;
+        size_t count = std::min(BlockFrames, samples - from);
+        double *buffer = &buffers[worker][0];
+        std::vector<const double*> in(inputs);
+        for(size_t c = 0; c != inputs; ++c)
+            in[c] = buffer + c * BlockFrames;
+
+        /* Převod bloku na double po kanálech, stejně jako parseRange() */
+        if(parsed)
+        {
+            for(size_t c = 0; c != inputs; ++c)
+                for(size_t i = 0; i != count; ++i)
+                    buffer[c * BlockFrames + i] = wave.PData[c][from + i].re();
+        }
+        else
+        {
+            char *raw = wave.dchunk.data + from * inputs * SizeOfSample;
+            for(size_t i = 0; i != count; ++i)
+                for(size_t c = 0; c != inputs; ++c, raw += SizeOfSample)
+                {
+                    complex tmp = DataUtility::fromCharsToComplex(raw,SizeOfSample);
+                    DataUtility::scaleComplex(tmp,SizeOfSample,false);
+                    buffer[c * BlockFrames + i] = tmp.re();
+                }
+        }
+
+        double *out = buffer + inputs * BlockFrames;
+        for(size_t o = 0; o != outputs; ++o)
+        {
+            applyRow(o, &in[0], out, count);
+            for(size_t i = 0; i != count; ++i)
+                ret->PData[o][from + i] = complex(out[i]);
+        }
+    });
+    return ret;
+}
@@ -0,0 +1,74 @@
+﻿#ifndef CHANNEL_MATRIX_H
+#define CHANNEL_MATRIX_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Wave;
+
+/**
+ * @brief Matice přemixování kanálů: každý výstupní kanál je lineární kombinace vstupních.
+ *
+ * Předdefinované matice:
+ *
+ *     stereo  5.1 (L R C LFE Ls Rs) na stereo podle ITU-R BS.775: L + C/√2 + Ls/√2, LFE se zahodí.
+ *             Mono se rozkopíruje do obou kanálů, stereo zůstane beze změny.
+ *     mono    Průměr všech kanálů, z 5.1 průměr stereo downmixu.
+ *     ms      Stereo na mid/side: M = (L + R) / 2, S = (L - R) / 2.
+ *     lr      Mid/side zpět na stereo: L = M + S, R = M - S.
+ *
+ * Jinak se matice načte ze souboru: každý řádek je jeden výstupní kanál s koeficienty pro všechny
+ * vstupní kanály. Prázdné řádky a řádky začínající # se přeskočí.
+ *
+ * Násobí se po blocích samplů: pro každý výstupní kanál se sečtou vstupní kanály bloku
+ * vynásobené koeficienty, v SSE2 čtyři samply najednou.
+ */
+class ChannelMatrix
+{
+public:
+    ChannelMatrix() : inputs(0), outputs(0) {}
+
+    /**
+     * @brief               Připraví matici.
+     * @param spec          Jméno předdefinované matice, nebo cesta k souboru s maticí.
+     * @param NumChannels   Počet vstupních kanálů.
+     * @return              Vrací false, pokud matici nelze načíst nebo neodpovídá počtu kanálů.
+     */
+    bool load(const std::string &spec, size_t NumChannels);
+
+    /**
+     * @brief   Počet výstupních kanálů.
+     */
+    size_t outputCount() const { return outputs; }
+
+    /**
+     * @brief   Koeficienty po řádcích, pro klíč cache.
+     */
+    const std::vector<double>& values() const { return coefficients; }
+
+    /**
+     * @brief           Spočítá jeden výstupní kanál bloku.
+     * @param output    Číslo výstupního kanálu.
+     * @param in        Ukazatele na samply vstupních kanálů.
+     * @param[out] out  Samply výstupního kanálu.
+     * @param count     Počet samplů.
+     */
+    void applyRow(size_t output, const double *const *in, double *out, size_t count) const;
+
+    /**
+     * @brief           Přemixuje kanály wavu.
+     * @param wave      Wave s raw daty, nebo rozparsovanými daty, pokud jsou.
+     * @return          Vrací nový wave s rozparsovanými daty výstupních kanálů.
+     *
+     * Bloky samplů se zpracovávají paralelně na poolu vláken. Raw data se převádějí rovnou
+     * po blocích, kanály, které matice zahodí, se tak vůbec celé neparsují.
+     */
+    Wave* apply(const Wave &wave) const;
+
+private:
+    size_t inputs;                          /**< Počet vstupních kanálů. */
+    size_t outputs;                         /**< Počet výstupních kanálů. */
+    std::vector<double> coefficients;       /**< Koeficienty, outputs řádků po inputs hodnotách. */
+};
+
+#endif // CHANNEL_MATRIX_H
@@ -0,0 +1,185 @@
+﻿#include "checkpoint.h"
+#include "wave.h"
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#define fseeko _fseeki64
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char Magic[4] = { 'Z', 'C', 'K', 'P' };
+    const uint32_t Version = 1;
+    const size_t KeySize = 32;
+}
+
+const unsigned int Checkpoint::Interval;
+
+Checkpoint::Checkpoint(const std::string &output, const std::string &key)
+    : output(output), key(key), file(0), dataOffset(0), frameSize(0), savedPhase(1), savedNext(0), savedLoudest(0) {}
+
+Checkpoint::~Checkpoint()
+{
+    if(file)
+        fclose(file);
+}
+
+std::string Checkpoint::stateName(const std::string &output)
+{
+    return output + ".checkpoint";
+}
+
+bool Checkpoint::load()
+{
+    FILE *state = fopen(stateName(output).c_str(), "rb");
+    if(!state)
+        return false;
+    char magic[4];
+    uint32_t version = 0;
+    char stored[KeySize];
+    uint32_t phase = 0;
+    uint64_t next = 0;
+    double loudest = 0;
+    bool valid = fread(magic, 1, sizeof(magic), state) == sizeof(magic) && memcmp(magic, Magic, sizeof(Magic)) == 0
+                 && fread(&version, sizeof(version), 1, state) == 1 && version == Version
+                 && fread(stored, 1, KeySize, state) == KeySize && key.compare(0, KeySize, stored, KeySize) == 0
+                 && fread(&phase, sizeof(phase), 1, state) == 1 && (phase == 1 || phase == 2)
+                 && fread(&next, sizeof(next), 1, state) == 1
+                 && fread(&loudest, sizeof(loudest), 1, state) == 1;
+    fclose(state);
+    if(!valid)
+        return false;
+    savedPhase = phase;
+    savedNext = size_t(next);
+    savedLoudest = loudest;
+    return true;
+}
+
+bool Checkpoint::open(const Wave &wave, bool resume)
+{
+    frameSize = wave.fchunk.NumChannels * (wave.fchunk.BitsPerSample / 8);
+    dataOffset = sizeof(Wave::RiffChunk) + sizeof(Wave::FmtChunk) + sizeof(Wave::DataChunkHeader);
+
+    /* S platným stavem se pokračuje v rozepsaném výstupu, jinak se výstup založí znovu.
+     * Starý výstup se nejdřív smaže, mohl to být hard link do cache. */
+    bool resumed = resume && key.size() == KeySize && load();
+    if(resumed)
+        file = fopen(output.c_str(), "r+b");
+    if(!file)
+    {
+        if(resumed)
+            std::cerr << "ERROR: Rozepsany vystup chybi, zacina se od zacatku: " << output << std::endl;
+        resumed = false;
+        savedPhase = 1;
+        savedNext = 0;
+        savedLoudest = 0;
+        remove(output.c_str());
+        file = fopen(output.c_str(), "w+b");
+    }
+    if(!file)
+    {
+        std::cerr << "ERROR: Nelze vytvorit vystupni soubor: " << output << std::endl;
+        return false;
+    }
+    lastCommit = std::chrono::steady_clock::now();
+    if(resumed)
+        return true;
+
+    /* Hlavičky a zarovnání za posledním celým samplem se nemění, zapíšou se hned */
+    size_t NumberOfSamples = frameSize ? wave.dchunk.head.length / frameSize : 0;
+    size_t tail = wave.dchunk.head.length - NumberOfSamples * frameSize;
+    bool ok = fwrite(&wave.rchunk, sizeof(Wave::RiffChunk), 1, file) == 1
+              && fwrite(&wave.fchunk, sizeof(Wave::FmtChunk), 1, file) == 1
+              && fwrite(&wave.dchunk.head, sizeof(Wave::DataChunkHeader), 1, file) == 1
+              && (tail == 0 || (fseeko(file, dataOffset + NumberOfSamples * frameSize, SEEK_SET) == 0
+                                && fwrite(wave.dchunk.data + NumberOfSamples * frameSize, 1, tail, file) == tail));
+    if(!ok)
+    {
+        std::cerr << "ERROR: Zapis do souboru selhal." << std::endl;
+        return false;
+    }
+    /* Prázdný stav, aby se i přerušení před prvním kontrolním bodem poznalo podle klíče */
+    return commit(1, 0, 0, true);
+}
+
+bool Checkpoint::write(const Wave &wave, size_t from, size_t count)
+{
+    if(!file || fseeko(file, dataOffset + uint64_t(from) * frameSize, SEEK_SET) != 0
+       || fwrite(wave.dchunk.data + from * frameSize, 1, count * frameSize, file) != count * frameSize)
+    {
+        std::cerr << "ERROR: Zapis do souboru selhal." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Checkpoint::sync()
+{
+    if(fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool Checkpoint::commit(unsigned int phase, size_t next, double loudest, bool force)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(!force && now - lastCommit < std::chrono::seconds(Interval))
+        return true;
+    lastCommit = now;
+
+    /* Nejdřív data, na která stav odkazuje, pak celý nový stav místo starého */
+    std::string name = stateName(output);
+    std::string tmp = name + ".tmp";
+    FILE *state = file && sync() ? fopen(tmp.c_str(), "wb") : 0;
+    bool ok = state != 0;
+    if(state)
+    {
+        uint32_t storedPhase = phase;
+        uint64_t storedNext = next;
+        ok = fwrite(Magic, 1, sizeof(Magic), state) == sizeof(Magic)
+             && fwrite(&Version, sizeof(Version), 1, state) == 1
+             && key.size() == KeySize && fwrite(key.data(), 1, KeySize, state) == KeySize
+             && fwrite(&storedPhase, sizeof(storedPhase), 1, state) == 1
+             && fwrite(&storedNext, sizeof(storedNext), 1, state) == 1
+             && fwrite(&loudest, sizeof(loudest), 1, state) == 1
+             && fflush(state) == 0;
+#ifdef _WIN32
+        ok = ok && _commit(_fileno(state)) == 0;
+#else
+        ok = ok && fsync(fileno(state)) == 0;
+#endif
+        ok = fclose(state) == 0 && ok;
+        /* Na Windows rename() existující cíl nepřepíše */
+#ifdef _WIN32
+        remove(name.c_str());
+#endif
+        ok = ok && rename(tmp.c_str(), name.c_str()) == 0;
+    }
+    if(!ok)
+        std::cerr << "ERROR: Nelze ulozit kontrolni bod: " << name << std::endl;
+    return ok;
+}
+
+bool Checkpoint::finish()
+{
+    if(!file)
+        return false;
+    bool ok = sync();
+    ok = fclose(file) == 0 && ok;
+    file = 0;
+    if(!ok)
+    {
+        std::cerr << "ERROR: Zapis do souboru selhal, kontrolni bod zustava: " << stateName(output) << std::endl;
+        return false;
+    }
+    remove(stateName(output).c_str());
+    return true;
+}
@@ -0,0 +1,127 @@
+﻿#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+class Wave;
+
+/**
+ * @brief Průběžný zápis výstupu equalizace s kontrolními body pro pokračování po přerušení.
+ *
+ * Výstupní soubor se založí hned na začátku v plné délce (hlavičky a data za posledním celým
+ * samplem jsou známé předem) a hotové bloky se do něj zapisují na své místo. Stav se ukládá
+ * do souboru s příponou .checkpoint: po zápisu na disk (fsync výstupu) se stav zapíše do dočasného
+ * souboru a přejmenuje, na disku je tak vždy celý starý, nebo celý nový stav.
+ *
+ * Bloky equalizace se nepřekrývají, stav proto nepotřebuje žádný konec filtru z minulého bloku.
+ * Stačí fáze, číslo dalšího bloku a největší dosavadní sampl pro normalizaci:
+ *
+ *     fáze 1  Filtr a průběžné kódování bez ztlumení, dokud žádný sampl nepřetekl.
+ *     fáze 2  Přetečení: všechny bloky se kódují znovu se ztlumením podle největšího samplu.
+ *
+ * Formát stavu: "ZCKP", verze (uint32), klíč úlohy (32 znaků), fáze (uint32), další blok (uint64)
+ * a největší sampl (double). Klíč obsahuje vše, co ovlivní výstup, i hash dat vstupu, se změněnou
+ * úlohou nebo jiným vstupem se nepokračuje.
+ */
+class Checkpoint
+{
+public:
+    /**
+     * @brief   Nejkratší doba mezi dvěma kontrolními body v sekundách, fsync po každém bloku by zdržoval.
+     */
+    static const unsigned int Interval = 2;
+
+    /**
+     * @brief           Konstruktor.
+     * @param output    Výstupní soubor.
+     * @param key       Klíč úlohy, 32 znaků z ResultCache::Hasher.
+     */
+    Checkpoint(const std::string &output, const std::string &key);
+
+    /**
+     * @brief   Destruktor, bez finish() stav zůstane na disku.
+     */
+    ~Checkpoint();
+
+    /**
+     * @brief           Otevře výstup a případně načte uložený stav.
+     * @param wave      Wave s raw daty, z něj se zapíšou hlavičky a data za posledním celým samplem.
+     * @param resume    Jestli pokračovat podle uloženého stavu. Bez platného stavu se začne od začátku.
+     * @return          Vrací false, pokud výstup nejde vytvořit.
+     */
+    bool open(const Wave &wave, bool resume);
+
+    /**
+     * @brief   Fáze uloženého stavu, 1 bez uloženého stavu.
+     */
+    unsigned int phase() const { return savedPhase; }
+
+    /**
+     * @brief   První blok, který ve fázi ještě není hotový.
+     */
+    size_t nextBlock() const { return savedNext; }
+
+    /**
+     * @brief   Největší sampl bloků před nextBlock() ve fázi 1, ve fázi 2 celého výstupu.
+     */
+    double loudest() const { return savedLoudest; }
+
+    /**
+     * @brief       Zapíše zakódovaný úsek raw dat na jeho místo ve výstupu.
+     * @param wave  Wave se zakódovanými raw daty.
+     * @param from  První sampl.
+     * @param count Počet samplů.
+     * @return      Vrací false při chybě zápisu.
+     */
+    bool write(const Wave &wave, size_t from, size_t count);
+
+    /**
+     * @brief           Uloží kontrolní bod, pokud od minulého uběhl Interval.
+     * @param phase     Fáze.
+     * @param next      První blok fáze, který ještě není zapsaný.
+     * @param loudest   Největší dosavadní sampl.
+     * @param force     Uložit hned, bez ohledu na Interval.
+     * @return          Vrací false při chybě zápisu.
+     */
+    bool commit(unsigned int phase, size_t next, double loudest, bool force = false);
+
+    /**
+     * @brief   Zapíše výstup na disk a smaže stav.
+     * @return  Vrací, jestli se to podařilo.
+     */
+    bool finish();
+
+    /**
+     * @brief           Jméno souboru se stavem pro daný výstup.
+     */
+    static std::string stateName(const std::string &output);
+
+private:
+    Checkpoint(const Checkpoint&);
+    Checkpoint& operator=(const Checkpoint&);
+
+    /**
+     * @brief   Načte stav, pokud existuje a patří k úloze.
+     */
+    bool load();
+
+    /**
+     * @brief   Zapíše buffer výstupu na disk a počká na dokončení.
+     */
+    bool sync();
+
+    std::string output;                                 /**< Výstupní soubor. */
+    std::string key;                                    /**< Klíč úlohy. */
+    FILE *file;                                         /**< Otevřený výstup. */
+    uint64_t dataOffset;                                /**< Pozice dat ve výstupu. */
+    size_t frameSize;                                   /**< Velikost samplu ve všech kanálech. */
+    unsigned int savedPhase;                            /**< Fáze uloženého stavu. */
+    size_t savedNext;                                   /**< Další blok uloženého stavu. */
+    double savedLoudest;                                /**< Největší sampl uloženého stavu. */
+    std::chrono::steady_clock::time_point lastCommit;   /**< Čas posledního kontrolního bodu. */
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,226 @@
+﻿#include "daemon.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /* Koš i pokrývá latence od BucketBase * BucketGrowth^i ms, 256 košů stačí na 12 hodin */
+    const double BucketBase = 0.01;
+    const double BucketGrowth = std::pow(2., 1. / 8);
+
+    size_t bucketOf(double ms)
+    {
+        if(ms < BucketBase)
+            return 0;
+        return std::min<size_t>(size_t(std::log(ms / BucketBase) / std::log(BucketGrowth)), Daemon::Buckets - 1);
+    }
+
+    /* Nejdelší řádek úlohy, klient s delším řádkem bez konce se odpojí */
+    const size_t MaxLine = 1 << 16;
+
+    /* Jak dlouho se nejvýš čeká na odeslání odpovědi klientovi, který nečte */
+    const int SendTimeout = 5;
+}
+
+const size_t Daemon::Buckets;
+
+Daemon::Daemon(const std::string &socket, Job job) : socket(socket), job(job), histogram(Buckets), jobs(0), slowest(0) {}
+
+std::vector<std::string> Daemon::split(const std::string &line)
+{
+    std::vector<std::string> ret;
+    std::string current;
+    bool quoted = false;
+    bool any = false;
+    for(size_t i = 0; i != line.size(); ++i)
+    {
+        char c = line[i];
+        if(c == '"')
+        {
+            quoted = !quoted;
+            any = true;
+        }
+        else if(!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n'))
+        {
+            if(any)
+                ret.push_back(current);
+            current.clear();
+            any = false;
+        }
+        else
+        {
+            current += c;
+            any = true;
+        }
+    }
+    if(any)
+        ret.push_back(current);
+    return ret;
+}
+
+std::string Daemon::stats() const
+{
+    std::ostringstream out;
+    out << "jobs " << jobs;
+    if(jobs == 0)
+        return out.str();
+    /* Percentily metodou nejbližšího pořadí, hodnotou je horní mez koše, nejvýš maximum */
+    const double percents[] = { 50, 90, 99 };
+    for(size_t i = 0; i != 3; ++i)
+    {
+        uint64_t rank = std::max<uint64_t>(uint64_t(percents[i] / 100 * jobs + .999999), 1);
+        uint64_t seen = 0;
+        size_t b = 0;
+        while(b + 1 != Buckets && (seen += histogram[b]) < rank)
+            ++b;
+        out << " p" << percents[i] << " " << std::min(slowest, BucketBase * std::pow(BucketGrowth, double(b + 1)));
+    }
+    out << " max " << slowest;
+    return out.str();
+}
+
+std::string Daemon::handle(const std::string &line, bool &quit)
+{
+    std::vector<std::string> params = split(line);
+    if(params.empty())
+        return "";
+    if(params.size() == 1 && params[0] == "stats")
+        return stats() + "\n";
+    if(params.size() == 1 && params[0] == "quit")
+    {
+        quit = true;
+        return "OK\n";
+    }
+
+    params.insert(params.begin(), "zapoctak");
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    int code = job(params);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    ++histogram[bucketOf(ms)];
+    ++jobs;
+    slowest = std::max(slowest, ms);
+
+    std::ostringstream out;
+    if(code == 0)
+        out << "OK " << ms << "\n";
+    else
+        out << "ERROR " << code << " " << ms << "\n";
+    return out.str();
+}
+
+#ifdef _WIN32
+
+int Daemon::run()
+{
+    std::cerr << "ERROR: Demon neni na Windows podporovan." << std::endl;
+    return 1;
+}
+
+#else
+
+int Daemon::run()
+{
+    int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(server < 0 || socket.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "ERROR: Nelze vytvorit socket: " << socket << std::endl;
+        return 1;
+    }
+    strncpy(address.sun_path, socket.c_str(), sizeof(address.sun_path) - 1);
+    unlink(socket.c_str());
+    if(bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, 16) != 0)
+    {
+        std::cerr << "ERROR: Nelze naslouchat na socketu: " << socket << std::endl;
+        close(server);
+        return 1;
+    }
+    std::cout << "Demon nasloucha na " << socket << std::endl;
+
+    /* Všichni klienti se hlídají najednou, žádný nečinný klient tak neblokuje ostatní.
+     * Úlohy běží postupně, v každém kole nejvýš jedna od každého klienta s celým řádkem. */
+    std::vector<pollfd> fds(1);
+    fds[0].fd = server;
+    fds[0].events = POLLIN;
+    std::vector<std::string> pending(1);
+    bool quit = false;
+    bool queued = false;
+    while(!quit)
+    {
+        if(poll(&fds[0], fds.size(), queued ? 0 : -1) < 0)
+            continue;
+        if(fds[0].revents & POLLIN)
+        {
+            int client = accept(server, 0, 0);
+            if(client >= 0)
+            {
+                timeval timeout = { SendTimeout, 0 };
+                setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                pollfd entry = { client, POLLIN, 0 };
+                fds.push_back(entry);
+                pending.push_back(std::string());
+            }
+        }
+
+        queued = false;
+        for(size_t c = 1; c < fds.size() && !quit; ++c)
+        {
+            bool closed = false;
+            if(fds[c].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                char buffer[4096];
+                long n = recv(fds[c].fd, buffer, sizeof(buffer), 0);
+                if(n > 0)
+                    pending[c].append(buffer, n);
+                else
+                    closed = true;
+            }
+            fds[c].revents = 0;
+
+            size_t eol = pending[c].find('\n');
+            if(eol != std::string::npos)
+            {
+                std::string reply = handle(pending[c].substr(0, eol), quit);
+                pending[c].erase(0, eol + 1);
+                /* Klient mohl mezitím odejít, nesmí to ukončit démona (SIGPIPE) */
+                send(fds[c].fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+                queued = queued || pending[c].find('\n') != std::string::npos;
+            }
+            else if(pending[c].size() > MaxLine)
+                closed = true;
+
+            /* Odpojený klient už nic neposílá, jeho rozpracované řádky se ale dokončí */
+            if(closed && pending[c].find('\n') == std::string::npos)
+            {
+                close(fds[c].fd);
+                fds.erase(fds.begin() + c);
+                pending.erase(pending.begin() + c);
+                --c;
+            }
+        }
+    }
+    for(size_t c = 1; c != fds.size(); ++c)
+        close(fds[c].fd);
+
+    close(server);
+    unlink(socket.c_str());
+    std::cout << stats() << std::endl;
+    return 0;
+}
+
+#endif
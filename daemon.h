@@ -0,0 +1,80 @@
+﻿#ifndef DAEMON_H
+#define DAEMON_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Dlouho běžící proces, který přijímá úlohy přes lokální Unix socket.
+ *
+ * Každý řádek poslaný do socketu je jedna úloha se stejnými parametry jako na příkazové řádce,
+ * například "-i vstup.wav -o vystup.wav -e bass.preset". Cesty s mezerami lze dát do uvozovek.
+ * Odpovědí je řádek "OK <ms>", nebo "ERROR <kód> <ms>". Příkaz "stats" vrátí počet úloh
+ * a percentily jejich latence, "quit" démona ukončí.
+ *
+ * Připojených klientů může být víc najednou, nečinný klient ostatní neblokuje. Z každého klienta
+ * s celým řádkem se v kole vezme jedna úloha.
+ *
+ * Úlohy se zpracovávají postupně v jednom procesu, takže mezi nimi zůstávají načtené presety
+ * (DataUtility::cachedPreset), pracovní prostory s buffery a tabulkami FFT (Workspace::shared)
+ * i vlákna poolu. Sdílená paměť se předává cestou, například souborem v /dev/shm.
+ */
+class Daemon
+{
+public:
+    /**
+     * @brief   Funkce, která zpracuje jednu úlohu, parametry začínají jménem programu.
+     */
+    typedef int (*Job)(const std::vector<std::string> &params);
+
+    /**
+     * @brief           Konstruktor.
+     * @param socket    Cesta k Unix socketu, existující socket se přepíše.
+     * @param job       Funkce zpracovávající úlohy.
+     */
+    Daemon(const std::string &socket, Job job);
+
+    /**
+     * @brief   Naslouchá a zpracovává úlohy, dokud nepřijde "quit".
+     * @return  Vrací návratový kód programu.
+     */
+    int run();
+
+    /**
+     * @brief       Rozdělí řádek úlohy na parametry.
+     * @param line  Řádek, parametry jsou oddělené mezerami, v uvozovkách mohou mezery obsahovat.
+     * @return      Vrací parametry.
+     */
+    static std::vector<std::string> split(const std::string &line);
+
+    /**
+     * @brief   Souhrn latencí dosud zpracovaných úloh.
+     * @return  Vrací řádek s počtem úloh a 50., 90., 99. percentilem a maximem v ms.
+     *
+     * Percentily jsou horní meze košů histogramu, tedy s přesností asi 9 %, maximum je přesné.
+     */
+    std::string stats() const;
+
+    /**
+     * @brief   Počet košů histogramu latencí.
+     */
+    static const size_t Buckets = 256;
+
+private:
+    /**
+     * @brief           Zpracuje jeden řádek od klienta.
+     * @param line      Řádek.
+     * @param[out] quit Nastaví se, pokud má démon skončit.
+     * @return          Vrací odpověď pro klienta včetně konce řádku.
+     */
+    std::string handle(const std::string &line, bool &quit);
+
+    std::string socket;             /**< Cesta k socketu. */
+    Job job;                        /**< Funkce zpracovávající úlohy. */
+    std::vector<uint64_t> histogram;    /**< Počty úloh v logaritmických koších latence, paměť nezávisí na počtu úloh. */
+    uint64_t jobs;                      /**< Počet zpracovaných úloh. */
+    double slowest;                     /**< Nejdelší latence v ms. */
+};
+
+#endif // DAEMON_H
@@ -1,5 +1,8 @@
 ﻿#include "data_utility.h"
+#include <filesystem>
+#include <iostream>
 #include <fstream>
+#include <map>
 
 
  size_t DataUtility::findNextTo2Exp(size_t x)
@@ -31,25 +34,34 @@
 
  std::vector<char> DataUtility::fromComplexToChars(complex x, size_t length)
  {
-     std::vector<char> ret;
+     if(length != 1 && length != 2)
+     {
+         std::cerr << "Spatna velikost dat v fromCharsToComplex." << std::endl;
+         return std::vector<char>();
+     }
+     std::vector<char> ret(length);
+     fromComplexToChars(x, length, &ret[0]);
+     return ret;
+ }
+
+ void DataUtility::fromComplexToChars(complex x, size_t length, char *out)
+ {
      short tmp2;
      switch(length)
      {
      case 1:
-         /* Ořízne realnou část komplexního čísla a vlozí ho do výstupního vektoru */
-         ret.push_back(static_cast<char>(x.re()  > 255 ? 255 : (x.re()  < 0 ? 0 : x.re())));
-         return ret;
+         /* Ořízne realnou část komplexního čísla a zapíše ho do výstupu */
+         out[0] = static_cast<char>(x.re()  > 255 ? 255 : (x.re()  < 0 ? 0 : x.re()));
+         return;
      case 2:
-         /* Ořízne realnou část komplexního čísla a vlozí ho do výstupního vektoru */
+         /* Ořízne realnou část komplexního čísla a zapíše ho do výstupu */
          tmp2 = static_cast<short>(x.re() > 32767 ? 32767 : (x.re() < -32768 ? -32768 : x.re()));
-         ret.push_back(char(tmp2 & 0xff));
-         ret.push_back(char((tmp2 >> 8) & 0xff));
-         return ret;
+         out[0] = char(tmp2 & 0xff);
+         out[1] = char((tmp2 >> 8) & 0xff);
+         return;
      default:
          std::cerr << "Spatna velikost dat v fromCharsToComplex." << std::endl;
-         return std::vector<char>();
      }
-
  }
 
  void DataUtility::scaleComplex(complex &first, size_t size_of_sample, bool inverse)
@@ -84,13 +96,48 @@
      std::ifstream in;
      in.open(filename, std::ios_base::in | std::ios_base::binary);
      std::vector<double> preset;
+     if(!in.is_open())
+     {
+        std::cerr << "ERROR: Nelze nacist preset: " << filename << std::endl;
+        return preset;
+     }
      double buffer = 0;
      while(!in.eof())
      {
         in >> buffer;
         preset.push_back(buffer);
+        /* Neúspěšné čtení na konci souboru je jen koncový whitespace, jinde chybná hodnota */
+        if(in.fail())
+        {
+            if(!in.eof())
+            {
+                std::cerr << "ERROR: Chybna hodnota v presetu: " << filename << std::endl;
+                preset.clear();
+            }
+            break;
+        }
      }
 
      in.close();
      return preset;
  }
+
+ std::vector<double> DataUtility::cachedPreset(const char *filename)
+ {
+     /* Načtené presety i s časem poslední změny souboru */
+     typedef std::pair<std::filesystem::file_time_type, std::vector<double> > Entry;
+     static std::map<std::string, Entry> presets;
+
+     std::error_code error;
+     std::filesystem::file_time_type time = std::filesystem::last_write_time(filename, error);
+     std::map<std::string, Entry>::iterator it = presets.find(filename);
+     if(error || it == presets.end() || it->second.first != time)
+     {
+         std::vector<double> preset = loadPreset(filename);
+         if(error || preset.empty())
+             return preset;
+         it = presets.insert(std::make_pair(std::string(filename), Entry())).first;
+         it->second = Entry(time, preset);
+     }
+     return it->second.second;
+ }
@@ -31,6 +31,14 @@ struct DataUtility
      */
     static std::vector<char> fromComplexToChars(complex number, size_t size_of_sample);
 
+    /**
+     * @brief                   Zkonvertuje komplexní číslo na Bajtové bez alokace.
+     * @param number            Vstupní komplexní číslo.
+     * @param size_of_sample    Velikost čísla, které se zapíše.
+     * @param[out] out          Buffer, kam se zapíše size_of_sample Bajtů v Little Endian.
+     */
+    static void fromComplexToChars(complex number, size_t size_of_sample, char *out);
+
     /**
      * @brief                       Přescaluje na rozmezí [-1,+1], respektive zpět.
      * @param[in,out] number        Číslo ke scalování.
@@ -45,9 +53,19 @@ struct DataUtility
     /**
      * @brief           Načte preset.
      * @param filename  Jméno souboru presetu.
-     * @return          Vrátí data presetu ve vectoru.
+     * @return          Vrátí data presetu ve vectoru, prázdný vector, pokud soubor nejde načíst.
      */
     static std::vector<double> loadPreset(const char* filename);
+
+    /**
+     * @brief           Načte preset, opakovaně načtený preset vrátí z paměti.
+     * @param filename  Jméno souboru presetu.
+     * @return          Vrátí kopii dat presetu, prázdný vector, pokud soubor nejde načíst.
+     *
+     * Preset se načte znovu, jen pokud se soubor od minula změnil. Démon tak nemusí
+     * pro každou úlohu znovu parsovat stejný preset.
+     */
+    static std::vector<double> cachedPreset(const char* filename);
 };
 
 #endif // DATA_UTILITY_H
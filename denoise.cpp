@@ -0,0 +1,213 @@
+﻿#include "denoise.h"
+#include "wave.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+    /* Počet rámců, které si vlákno bere najednou */
+    const size_t framesPerTask = 16;
+}
+
+Denoiser::Denoiser(const Options &options) : options(options), windowPower(0)
+{
+    const double pi = 3.14159265358979323846;
+    window.resize(options.size);
+    for(size_t n = 0; n != options.size; ++n)
+    {
+        window[n] = .5 - .5 * cos(2 * pi * n / options.size);
+        windowPower += window[n] * window[n];
+    }
+}
+
+bool Denoiser::learn(const Wave &wave, size_t from, size_t count)
+{
+    const size_t samples = wave.PData[0].size();
+    if(count < options.size || from + count > samples)
+    {
+        std::cerr << "ERROR: Usek pro profil sumu je prilis kratky nebo mimo data." << std::endl;
+        return false;
+    }
+    /* Rámce s polovičním překryvem, které celé leží v úseku */
+    std::vector<size_t> starts;
+    for(size_t start = from; start + options.size <= from + count; start += options.size / 2)
+        starts.push_back(start);
+    learnFrames(wave,starts);
+    return true;
+}
+
+bool Denoiser::learnQuietest(const Wave &wave)
+{
+    const size_t N = options.size;
+    const size_t samples = wave.PData[0].size();
+    const size_t NumChannels = wave.fchunk.NumChannels;
+    const size_t frames = samples < N ? 0 : (samples - N) / (N / 2) + 1;
+    if(frames == 0)
+    {
+        std::cerr << "ERROR: Vstup je prilis kratky pro odhad profilu sumu." << std::endl;
+        return false;
+    }
+
+    /* Energie každého rámce přes všechny kanály */
+    std::vector<double> energy(frames);
+    ThreadPool &pool = ThreadPool::instance();
+    pool.run((frames + framesPerTask - 1) / framesPerTask, [&](size_t task, size_t) {
+        for(size_t f = task * framesPerTask; f < frames && f < (task + 1) * framesPerTask; ++f)
+        {
+            double sum = 0;
+            for(size_t ch = 0; ch != NumChannels; ++ch)
+            {
+                const complex *in = &wave.PData[ch][f * (N / 2)];
+                for(size_t n = 0; n != N; ++n)
+                    sum += in[n].re() * in[n].re() * window[n];
+            }
+            energy[f] = sum;
+        }
+    });
+
+    /* Nejtišší rámce, které nejsou digitální ticho */
+    std::vector<size_t> candidates;
+    for(size_t f = 0; f != frames; ++f)
+        if(energy[f] > 0)
+            candidates.push_back(f);
+    if(candidates.empty())
+    {
+        std::cerr << "ERROR: Vstup je tichy, profil sumu nelze odhadnout." << std::endl;
+        return false;
+    }
+    size_t count = std::max<size_t>(1, size_t(candidates.size() * options.quietest));
+    std::nth_element(candidates.begin(), candidates.begin() + (count - 1), candidates.end(),
+                     [&](size_t a, size_t b) { return energy[a] < energy[b] || (energy[a] == energy[b] && a < b); });
+    candidates.resize(count);
+    std::sort(candidates.begin(), candidates.end());
+
+    std::vector<size_t> starts(count);
+    for(size_t i = 0; i != count; ++i)
+        starts[i] = candidates[i] * (N / 2);
+    learnFrames(wave,starts);
+    return true;
+}
+
+void Denoiser::learnFrames(const Wave &wave, const std::vector<size_t> &starts)
+{
+    const size_t N = options.size;
+    const size_t bins = N / 2 + 1;
+    const size_t NumChannels = wave.fchunk.NumChannels;
+    const size_t tasks = (starts.size() + framesPerTask - 1) / framesPerTask;
+
+    ThreadPool &pool = ThreadPool::instance();
+    std::vector<Workspace> &workspaces = Workspace::shared();
+    Workspace::prepareAll(workspaces,pool.size(),N);
+
+    /* Každý kus úlohy sečte výkon svých rámců zvlášť, kusy se pak sečtou sériově,
+     * aby profil nezávisel na počtu vláken */
+    std::vector<double> partial(NumChannels * tasks * bins, 0.);
+    pool.run(NumChannels * tasks, [&](size_t index, size_t worker) {
+        const size_t ch = index / tasks;
+        const size_t task = index % tasks;
+        std::vector<complex> &block = workspaces[worker].block;
+        double *sum = &partial[index * bins];
+        for(size_t f = task * framesPerTask; f < starts.size() && f < (task + 1) * framesPerTask; ++f)
+        {
+            const complex *in = &wave.PData[ch][starts[f]];
+            for(size_t n = 0; n != N; ++n)
+                block[n] = complex(in[n].re() * window[n]);
+            CFFT::Forward(&block[0], N);
+            for(size_t k = 0; k != bins; ++k)
+                sum[k] += block[k].norm();
+        }
+    });
+
+    /* Průměrný výkon rámce vydělený součtem čtverců okna je výkon šumu na sampl */
+    profile.assign(NumChannels, std::vector<double>(bins, 0.));
+    for(size_t ch = 0; ch != NumChannels; ++ch)
+    {
+        for(size_t task = 0; task != tasks; ++task)
+            for(size_t k = 0; k != bins; ++k)
+                profile[ch][k] += partial[(ch * tasks + task) * bins + k];
+        for(size_t k = 0; k != bins; ++k)
+            profile[ch][k] /= starts.size() * windowPower;
+    }
+}
+
+void Denoiser::computeGains(size_t N, size_t channel, size_t countData, Workspace &ws) const
+{
+    const size_t half = N / 2;
+    const std::vector<double> &noise = profile[channel];
+    const double floor = std::pow(10., -options.reduction / 20);
+    /* Šum v bloku s obdélníkovým oknem délky countData má výkon profil * countData */
+    const double scale = options.sensitivity * countData;
+    const double step = double(options.size) / N;
+    double *gains = &ws.gains[0];
+    double *sums = &ws.gainSums[0];
+
+    /* Zesílení podle odečtení výkonu šumu, nejvýš o reduction dB */
+    sums[0] = 0;
+    for(size_t k = 0; k <= half; ++k)
+    {
+        /* Profil má méně frekvencí, mezi nimi se lineárně interpoluje */
+        double position = k * step;
+        size_t j = size_t(position);
+        double t = position - j;
+        double threshold = scale * (j + 1 < noise.size() ? noise[j] * (1 - t) + noise[j + 1] * t : noise.back());
+        double gain = gains[k] > threshold ? 1 - threshold / gains[k] : 0;
+        sums[k + 1] = sums[k] + std::max(floor, gain);
+    }
+
+    /* Vyhlazení klouzavým průměrem přes šířku jedné frekvence profilu na každou stranu */
+    const size_t width = std::max<size_t>(1, N / options.size);
+    for(size_t k = 0; k <= half; ++k)
+    {
+        size_t from = k > width ? k - width : 0;
+        size_t to = std::min(k + width + 1, half + 1);
+        gains[k] = (sums[to] - sums[from]) / (to - from);
+    }
+}
+
+void Denoiser::apply(complex *spectrum, size_t N, size_t channel, size_t countData, Workspace &ws) const
+{
+    const size_t half = N / 2;
+    double *gains = &ws.gains[0];
+    for(size_t k = 0; k <= half; ++k)
+        gains[k] = spectrum[k].norm();
+    computeGains(N, channel, countData, ws);
+
+    /* Spektrum reálného signálu je symetrické, druhá polovina dostane stejné zesílení */
+    spectrum[0] *= gains[0];
+    for(size_t k = 1; k != half; ++k)
+    {
+        spectrum[k] *= gains[k];
+        spectrum[N - k] *= gains[k];
+    }
+    spectrum[half] *= gains[half];
+}
+
+void Denoiser::apply(double *data, size_t N, size_t first, size_t lanes, size_t countData, Workspace &ws) const
+{
+    const size_t half = N / 2;
+    const size_t Width = 2 * lanes;
+    double *gains = &ws.gains[0];
+    for(size_t l = 0; l != lanes; ++l)
+    {
+        for(size_t k = 0; k <= half; ++k)
+        {
+            double re = data[k * Width + l];
+            double im = data[k * Width + lanes + l];
+            gains[k] = re * re + im * im;
+        }
+        computeGains(N, first + l, countData, ws);
+
+        for(size_t k = 0; k <= half; ++k)
+        {
+            data[k * Width + l] *= gains[k];
+            data[k * Width + lanes + l] *= gains[k];
+            if(k != 0 && k != half)
+            {
+                data[(N - k) * Width + l] *= gains[k];
+                data[(N - k) * Width + lanes + l] *= gains[k];
+            }
+        }
+    }
+}
@@ -0,0 +1,105 @@
+﻿#ifndef DENOISE_H
+#define DENOISE_H
+#include "workspace.h"
+#include <vector>
+
+class Wave;
+
+/**
+ * @brief Potlačení stálého šumu (spectral gating) podle naučeného profilu šumu.
+ *
+ * Profil je průměrný výkon šumu na jednotlivých frekvencích, odhadnutý z rámců s Hannovým oknem
+ * buď ze zadaného úseku, nebo z nejtišších rámců celého vstupu. Profil je normovaný na jeden sampl,
+ * takže se dá použít pro blok libovolné délky a velikost FFT.
+ *
+ * Samotné potlačení se provádí na spektru bloku equalizace, mezi dopřednou FFT a filtrem,
+ * FFT se tedy počítá jen jednou. Frekvence, jejichž výkon není výrazně nad šumem, se zeslabí,
+ * zesílení se vyhladí přes sousední frekvence, aby nevznikal "hudební" šum.
+ */
+class Denoiser
+{
+public:
+    /**
+     * @brief Nastavení odšumění.
+     */
+    struct Options
+    {
+        size_t size;            /**< Velikost rámce pro odhad profilu, mocnina dvojky. */
+        double reduction;       /**< Největší potlačení šumu v dB. */
+        double sensitivity;     /**< Násobek výkonu šumu, pod kterým se frekvence potlačí úplně. */
+        double quietest;        /**< Podíl nejtišších rámců, ze kterých se odhadne automatický profil. */
+
+        Options() : size(2048), reduction(12), sensitivity(2), quietest(0.1) {}
+    };
+
+    /**
+     * @brief           Konstruktor, připraví okno pro odhad profilu.
+     * @param options   Nastavení odšumění.
+     */
+    explicit Denoiser(const Options &options);
+
+    /**
+     * @brief           Naučí se profil šumu z úseku.
+     * @param wave      Rozparsovaný wave.
+     * @param from      První sampl úseku.
+     * @param count     Počet samplů úseku, alespoň velikost rámce.
+     * @return          Vrací false, pokud je úsek moc krátký nebo mimo data.
+     */
+    bool learn(const Wave &wave, size_t from, size_t count);
+
+    /**
+     * @brief           Naučí se profil šumu z nejtišších rámců celého vstupu.
+     * @param wave      Rozparsovaný wave.
+     * @return          Vrací false, pokud je vstup moc krátký nebo úplně tichý.
+     *
+     * Úplně tiché rámce (digitální ticho) se přeskočí, šum v nich není.
+     */
+    bool learnQuietest(const Wave &wave);
+
+    /**
+     * @brief               Potlačí šum ve spektru bloku jednoho kanálu.
+     * @param spectrum      Spektrum bloku reálného signálu o velikosti N.
+     * @param N             Velikost FFT.
+     * @param channel       Číslo kanálu, podle kterého se vybere profil.
+     * @param countData     Počet samplů bloku před doplněním nulami.
+     * @param ws            Pracovní prostor vlákna připravený s bufferem zesílení.
+     */
+    void apply(complex *spectrum, size_t N, size_t channel, size_t countData, Workspace &ws) const;
+
+    /**
+     * @brief               Potlačí šum ve spektrech bloků několika kanálů v rozložení BatchFFT.
+     * @param data          Proložená spektra kanálů first až first + lanes - 1.
+     * @param N             Velikost FFT.
+     * @param first         Číslo prvního kanálu.
+     * @param lanes         Počet kanálů.
+     * @param countData     Počet samplů bloku před doplněním nulami.
+     * @param ws            Pracovní prostor vlákna připravený s bufferem zesílení.
+     *
+     * Výsledek je stejný jako apply() pro každý kanál zvlášť.
+     */
+    void apply(double *data, size_t N, size_t first, size_t lanes, size_t countData, Workspace &ws) const;
+
+private:
+    /**
+     * @brief           Spočítá profil jako průměrný výkon daných rámců.
+     * @param wave      Rozparsovaný wave.
+     * @param starts    Začátky rámců, vzestupně.
+     */
+    void learnFrames(const Wave &wave, const std::vector<size_t> &starts);
+
+    /**
+     * @brief               Převede výkon frekvencí ve ws.gains na vyhlazená zesílení.
+     * @param N             Velikost FFT.
+     * @param channel       Číslo kanálu.
+     * @param countData     Počet samplů bloku před doplněním nulami.
+     * @param ws            Pracovní prostor vlákna.
+     */
+    void computeGains(size_t N, size_t channel, size_t countData, Workspace &ws) const;
+
+    Options options;                                /**< Nastavení. */
+    std::vector<double> window;                     /**< Hannovo okno rámce. */
+    double windowPower;                             /**< Součet čtverců okna. */
+    std::vector<std::vector<double> > profile;      /**< Výkon šumu na sampl pro každý kanál a frekvenci rámce. */
+};
+
+#endif // DENOISE_H
@@ -0,0 +1,230 @@
+﻿#include "effect_graph.h"
+#include "wave.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+const size_t EffectGraph::BlockFrames;
+
+bool EffectGraph::load(const char *filename)
+{
+    std::ifstream in(filename);
+    if(!in.is_open())
+    {
+        std::cerr << "ERROR: Nelze otevrit konfiguraci grafu: " << filename << std::endl;
+        return false;
+    }
+
+    nodes.clear();
+    nodes.push_back(Node());
+    nodes[0].name = "input";
+    std::string outputName;
+    std::string line;
+    for(size_t number = 1; std::getline(in, line); ++number)
+    {
+        std::istringstream words(line);
+        std::string name, type, inputs;
+        if(!(words >> name) || name[0] == '#')
+            continue;
+        if(name == "output")
+        {
+            words >> outputName;
+            continue;
+        }
+        if(!(words >> type >> inputs))
+        {
+            std::cerr << "ERROR: Radek " << number << " konfigurace grafu nema typ nebo vstupy." << std::endl;
+            return false;
+        }
+
+        Node node;
+        node.name = name;
+        for(size_t i = 0; i != nodes.size(); ++i)
+            if(nodes[i].name == name)
+            {
+                std::cerr << "ERROR: Uzel " << name << " je definovany dvakrat." << std::endl;
+                return false;
+            }
+
+        /* Vstupy musí být definované dříve, graf tak nemůže obsahovat cyklus */
+        std::istringstream list(inputs);
+        std::string input;
+        while(std::getline(list, input, ','))
+        {
+            size_t i = 0;
+            while(i != nodes.size() && nodes[i].name != input)
+                ++i;
+            if(i == nodes.size())
+            {
+                std::cerr << "ERROR: Radek " << number << ": neznamy vstup " << input << std::endl;
+                return false;
+            }
+            node.inputs.push_back(i);
+        }
+
+        EffectNode::Params params;
+        std::string param;
+        while(words >> param)
+        {
+            size_t equals = param.find('=');
+            if(equals == std::string::npos)
+            {
+                std::cerr << "ERROR: Radek " << number << ": parametr neni ve tvaru klic=hodnota: " << param << std::endl;
+                return false;
+            }
+            params[param.substr(0, equals)] = param.substr(equals + 1);
+        }
+        node.effect.reset(EffectNode::create(type, params));
+        if(!node.effect)
+            return false;
+        nodes.push_back(std::move(node));
+    }
+
+    if(nodes.size() == 1)
+    {
+        std::cerr << "ERROR: Graf neobsahuje zadny uzel." << std::endl;
+        return false;
+    }
+    output = nodes.size() - 1;
+    if(!outputName.empty())
+    {
+        for(output = 1; output != nodes.size() && nodes[output].name != outputName; ++output)
+            ;
+        if(output == nodes.size())
+        {
+            std::cerr << "ERROR: Neznamy vystupni uzel " << outputName << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EffectGraph::configure(size_t SampleRate, size_t NumChannels)
+{
+    nodes[0].format.SampleRate = SampleRate;
+    nodes[0].format.NumChannels = NumChannels;
+    nodes[0].level = 0;
+    levels = 1;
+    for(size_t n = 1; n != nodes.size(); ++n)
+    {
+        Node &node = nodes[n];
+        std::vector<EffectNode::Format> formats;
+        node.level = 0;
+        for(size_t i = 0; i != node.inputs.size(); ++i)
+        {
+            formats.push_back(nodes[node.inputs[i]].format);
+            node.level = std::max(node.level, nodes[node.inputs[i]].level + 1);
+        }
+        if(!node.effect->configure(formats, node.format))
+        {
+            std::cerr << "ERROR: Uzel " << node.name << " nelze pripravit." << std::endl;
+            return false;
+        }
+        levels = std::max(levels, node.level + 1);
+    }
+
+    /* Úroveň posledního konzumenta, výstup se čte až po zpracování všech úrovní */
+    std::vector<size_t> lastUse(nodes.size());
+    for(size_t n = 0; n != nodes.size(); ++n)
+        lastUse[n] = nodes[n].level;
+    for(size_t n = 1; n != nodes.size(); ++n)
+        for(size_t i = 0; i != nodes[n].inputs.size(); ++i)
+            lastUse[nodes[n].inputs[i]] = std::max(lastUse[nodes[n].inputs[i]], nodes[n].level);
+    lastUse[output] = levels;
+
+    /* Přidělení slotů po úrovních, slot se uvolní po úrovni posledního konzumenta */
+    std::vector<size_t> owner;
+    size_t count = 0;
+    for(size_t level = 0; level != levels; ++level)
+        for(size_t n = 0; n != nodes.size(); ++n)
+        {
+            if(nodes[n].level != level)
+                continue;
+            size_t slot = 0;
+            while(slot != owner.size() && lastUse[owner[slot]] >= level)
+                ++slot;
+            if(slot == owner.size())
+                owner.push_back(n);
+            else
+                owner[slot] = n;
+            nodes[n].slot = slot;
+            count = owner.size();
+        }
+    slots.assign(count, AudioBlock());
+    return true;
+}
+
+Wave* EffectGraph::process(const Wave &input)
+{
+    const size_t NumChannels = input.fchunk.NumChannels;
+    if(!configure(input.fchunk.SampleRate, NumChannels))
+        return 0;
+
+    /* Kusy úlohy každé úrovně: kanál uzlu, nebo celý uzel */
+    std::vector<std::vector<std::pair<size_t,size_t> > > tasks(levels);
+    std::vector<EffectNode::Inputs> inputs(nodes.size());
+    for(size_t n = 1; n != nodes.size(); ++n)
+    {
+        for(size_t i = 0; i != nodes[n].inputs.size(); ++i)
+            inputs[n].push_back(&slots[nodes[nodes[n].inputs[i]].slot]);
+        size_t channels = nodes[n].effect->perChannel() ? nodes[n].format.NumChannels : 1;
+        for(size_t ch = 0; ch != channels; ++ch)
+            tasks[nodes[n].level].push_back(std::make_pair(n, ch));
+    }
+
+    const size_t samples = input.PData[0].size();
+    const EffectNode::Format &format = nodes[output].format;
+    std::vector<std::vector<double> > result(format.NumChannels);
+    ThreadPool &pool = ThreadPool::instance();
+    AudioBlock &source = slots[nodes[0].slot];
+    const AudioBlock &sink = slots[nodes[output].slot];
+
+    for(size_t first = 0; ; first += BlockFrames)
+    {
+        /* Blok vstupu */
+        size_t count = std::min(BlockFrames, samples - std::min(first, samples));
+        source.resize(NumChannels, count);
+        source.last = first + count >= samples;
+        for(size_t ch = 0; ch != NumChannels; ++ch)
+            for(size_t i = 0; i != count; ++i)
+                source.channels[ch][i] = input.PData[ch][first + i].re();
+
+        for(size_t level = 1; level != levels; ++level)
+        {
+            /* Sériově se zjistí délky výstupů, paralelně se spočítají */
+            for(size_t n = 1; n != nodes.size(); ++n)
+            {
+                if(nodes[n].level != level)
+                    continue;
+                bool last = true;
+                for(size_t i = 0; i != inputs[n].size(); ++i)
+                    last = last && inputs[n][i]->last;
+                AudioBlock &out = slots[nodes[n].slot];
+                out.resize(nodes[n].format.NumChannels, nodes[n].effect->begin(inputs[n], last));
+                out.last = last;
+            }
+            const std::vector<std::pair<size_t,size_t> > &work = tasks[level];
+            pool.run(work.size(), [&](size_t t, size_t) {
+                size_t n = work[t].first;
+                nodes[n].effect->process(inputs[n], slots[nodes[n].slot], work[t].second);
+            });
+        }
+
+        for(size_t ch = 0; ch != format.NumChannels; ++ch)
+            result[ch].insert(result[ch].end(), sink.channels[ch].begin(), sink.channels[ch].begin() + sink.frames);
+        if(source.last)
+            break;
+    }
+
+    /* Výstupní wave s formátem výstupního uzlu */
+    Wave::FmtChunk fmt = input.fchunk;
+    fmt.SampleRate = format.SampleRate;
+    fmt.NumChannels = format.NumChannels;
+    Wave *ret = Wave::create(fmt, result[0].size());
+    for(size_t ch = 0; ch != format.NumChannels; ++ch)
+        for(size_t i = 0; i != result[ch].size(); ++i)
+            ret->PData[ch][i] = complex(result[ch][i]);
+    return ret;
+}
@@ -0,0 +1,73 @@
+﻿#ifndef EFFECT_GRAPH_H
+#define EFFECT_GRAPH_H
+#include "effect_node.h"
+#include <memory>
+
+class Wave;
+
+/**
+ * @brief Graf efektů načtený z konfiguračního souboru.
+ *
+ * Každý řádek konfigurace je jeden uzel:
+ *
+ *     jmeno typ vstup[,vstup...] [klic=hodnota]...
+ *
+ * Vstupem je jméno dříve definovaného uzlu nebo "input" (vstupní wave). Řádek "output jmeno"
+ * vybere výstupní uzel, jinak je výstupem poslední uzel. Prázdné řádky a řádky začínající # se přeskočí.
+ *
+ * Graf se zpracovává po blocích. Uzly jsou rozdělené do úrovní podle nejdelší cesty od vstupu,
+ * uzly jedné úrovně na sobě nezávisí. Pro každý blok se úrovně zpracují postupně, kanály všech uzlů
+ * jedné úrovně paralelně na poolu vláken. Bloky drží jen pár bufferů (slotů): slot uzlu se uvolní
+ * po úrovni jeho posledního konzumenta a dostane ho další uzel. Každý blok tak projde všemi efekty,
+ * dokud je v cache, místo samostatného průchodu celými daty pro každý efekt.
+ */
+class EffectGraph
+{
+public:
+    /**
+     * @brief           Načte graf z konfiguračního souboru.
+     * @param filename  Cesta ke konfiguraci.
+     * @return          Vrací false při chybě v konfiguraci.
+     */
+    bool load(const char *filename);
+
+    /**
+     * @brief           Zpracuje celý wave grafem.
+     * @param input     Rozparsovaný vstupní wave.
+     * @return          Vrací nový wave s rozparsovanými daty výstupu, nebo 0 při chybě.
+     *
+     * Graf lze zpracovat jen jednou, uzly si drží stav proudu.
+     */
+    Wave* process(const Wave &input);
+
+private:
+    /**
+     * @brief Uzel grafu s vazbami.
+     */
+    struct Node
+    {
+        std::string name;                       /**< Jméno z konfigurace. */
+        std::unique_ptr<EffectNode> effect;     /**< Efekt, u vstupu 0. */
+        std::vector<size_t> inputs;             /**< Indexy vstupních uzlů. */
+        EffectNode::Format format;              /**< Formát výstupu. */
+        size_t level;                           /**< Úroveň, vstup má 0. */
+        size_t slot;                            /**< Index bufferu s výstupem. */
+    };
+
+    /**
+     * @brief               Připraví uzly pro formát vstupu, spočítá úrovně a přidělí sloty.
+     * @param SampleRate    Vzorkovací frekvence vstupu.
+     * @param NumChannels   Počet kanálů vstupu.
+     * @return              Vrací false, pokud některý uzel formát nepřijme.
+     */
+    bool configure(size_t SampleRate, size_t NumChannels);
+
+    static const size_t BlockFrames = 4096;     /**< Počet samplů v kanálu, které se čtou ze vstupu najednou. */
+
+    std::vector<Node> nodes;            /**< Uzly v pořadí konfigurace, na indexu 0 je vstup. */
+    size_t output;                      /**< Index výstupního uzlu. */
+    size_t levels;                      /**< Počet úrovní včetně vstupu. */
+    std::vector<AudioBlock> slots;      /**< Sdílené buffery bloků. */
+};
+
+#endif // EFFECT_GRAPH_H
@@ -0,0 +1,114 @@
+﻿#ifndef EFFECT_NODE_H
+#define EFFECT_NODE_H
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Blok samplů, který si předávají uzly grafu efektů.
+ *
+ * Každý kanál má vlastní buffer. Buffery se mezi bloky jen přepisují, alokují se znovu,
+ * jen když je blok delší než kterýkoli předchozí.
+ */
+struct AudioBlock
+{
+    std::vector<std::vector<double> > channels;     /**< Samply po kanálech, platných je prvních frames. */
+    size_t frames;                                  /**< Počet platných samplů v každém kanálu. */
+    bool last;                                      /**< Jestli je to poslední blok proudu. */
+
+    AudioBlock() : frames(0), last(false) {}
+
+    /**
+     * @brief               Nastaví počet kanálů a platných samplů.
+     * @param NumChannels   Počet kanálů.
+     * @param frames        Počet platných samplů v každém kanálu.
+     */
+    void resize(size_t NumChannels, size_t frames);
+};
+
+/**
+ * @brief Uzel grafu efektů, zpracovává proud samplů po blocích.
+ *
+ * Zpracování jednoho bloku má dvě fáze. Metoda begin() se volá sériově a jen spočítá,
+ * kolik samplů uzel vydá, a posune jeho stav. Metoda process() pak samply spočítá,
+ * pro každý kanál zvlášť a kanály paralelně. Uzel může vydat jiný počet samplů,
+ * než dostal (zpoždění bloku FFT, převzorkování), na konci proudu ale musí vydat všechno.
+ *
+ * Nový efekt = nová odvozená třída a jeden řádek v EffectNode::create().
+ */
+class EffectNode
+{
+public:
+    /**
+     * @brief Formát proudu mezi uzly.
+     */
+    struct Format
+    {
+        size_t SampleRate;      /**< Vzorkovací frekvence. */
+        size_t NumChannels;     /**< Počet kanálů. */
+    };
+
+    typedef std::map<std::string, std::string> Params;     /**< Parametry uzlu z konfigurace, klíč=hodnota. */
+    typedef std::vector<const AudioBlock*> Inputs;          /**< Vstupní bloky uzlu. */
+
+    virtual ~EffectNode() {}
+
+    /**
+     * @brief               Připraví uzel pro formát vstupů.
+     * @param inputs        Formáty vstupů.
+     * @param[out] output   Formát výstupu.
+     * @return              Vrací false, pokud uzel se vstupy pracovat neumí.
+     */
+    virtual bool configure(const std::vector<Format> &inputs, Format &output) = 0;
+
+    /**
+     * @brief   Jestli se kanály dají zpracovat nezávisle.
+     * @return  Pokud vrací false, process() se volá jen jednou s kanálem 0 a zpracuje všechny kanály.
+     */
+    virtual bool perChannel() const { return true; }
+
+    /**
+     * @brief           Začne zpracování bloku.
+     * @param inputs    Vstupní bloky.
+     * @param last      Jestli jsou všechny vstupy na konci proudu.
+     * @return          Vrací počet samplů, které uzel v tomto bloku vydá.
+     */
+    virtual size_t begin(const Inputs &inputs, bool last) = 0;
+
+    /**
+     * @brief           Zpracuje jeden kanál bloku.
+     * @param inputs    Vstupní bloky.
+     * @param[out] out  Výstupní blok s počtem samplů z begin().
+     * @param channel   Číslo kanálu.
+     */
+    virtual void process(const Inputs &inputs, AudioBlock &out, size_t channel) = 0;
+
+    /**
+     * @brief           Vytvoří uzel podle jména typu.
+     * @param type      Typ uzlu: gain, fft-eq, iir-eq, limiter, resample, mix nebo remix.
+     * @param params    Parametry uzlu.
+     * @return          Vrací nový uzel, nebo 0 při neznámém typu nebo chybných parametrech.
+     */
+    static EffectNode* create(const std::string &type, const Params &params);
+
+protected:
+    /**
+     * @brief           Přečte číselný parametr.
+     * @param params    Parametry uzlu.
+     * @param name      Jméno parametru.
+     * @param value     Výchozí hodnota, pokud parametr chybí.
+     * @return          Vrací hodnotu parametru.
+     */
+    static double number(const Params &params, const std::string &name, double value);
+
+    /**
+     * @brief               Zkontroluje, že má uzel právě jeden vstup, a převezme jeho formát.
+     * @param inputs        Formáty vstupů.
+     * @param[out] output   Formát výstupu, stejný jako vstup.
+     * @return              Vrací false, pokud uzel nemá právě jeden vstup.
+     */
+    static bool single(const std::vector<Format> &inputs, Format &output);
+};
+
+#endif // EFFECT_NODE_H
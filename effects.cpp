@@ -0,0 +1,456 @@
+﻿#include "effects.h"
+#include "data_utility.h"
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    const double Pi = 3.14159265358979323846;
+}
+
+void AudioBlock::resize(size_t NumChannels, size_t frames)
+{
+    channels.resize(NumChannels);
+    for(size_t ch = 0; ch != NumChannels; ++ch)
+        if(channels[ch].size() < frames)
+            channels[ch].resize(frames);
+    this->frames = frames;
+}
+
+EffectNode* EffectNode::create(const std::string &type, const Params &params)
+{
+    if(type == "gain")
+        return new GainNode(params);
+    if(type == "fft-eq")
+    {
+        if(params.find("preset") == params.end())
+        {
+            std::cerr << "ERROR: Uzel fft-eq potrebuje parametr preset." << std::endl;
+            return 0;
+        }
+        return new FftEqNode(params);
+    }
+    if(type == "iir-eq")
+        return new IirEqNode(params);
+    if(type == "limiter")
+        return new LimiterNode(params);
+    if(type == "resample")
+    {
+        if(number(params, "rate", 0) <= 0)
+        {
+            std::cerr << "ERROR: Uzel resample potrebuje kladny parametr rate." << std::endl;
+            return 0;
+        }
+        return new ResamplerNode(params);
+    }
+    if(type == "mix")
+        return new MixNode(params);
+    if(type == "remix")
+    {
+        if(params.find("matrix") == params.end())
+        {
+            std::cerr << "ERROR: Uzel remix potrebuje parametr matrix." << std::endl;
+            return 0;
+        }
+        return new RemixNode(params);
+    }
+    std::cerr << "ERROR: Neznamy typ uzlu: " << type << std::endl;
+    return 0;
+}
+
+double EffectNode::number(const Params &params, const std::string &name, double value)
+{
+    Params::const_iterator it = params.find(name);
+    return it == params.end() ? value : atof(it->second.c_str());
+}
+
+bool EffectNode::single(const std::vector<Format> &inputs, Format &output)
+{
+    if(inputs.size() != 1)
+    {
+        std::cerr << "ERROR: Uzel musi mit prave jeden vstup." << std::endl;
+        return false;
+    }
+    output = inputs[0];
+    return true;
+}
+
+GainNode::GainNode(const Params &params)
+{
+    gain = params.find("db") != params.end() ? std::pow(10., number(params, "db", 0) / 20)
+                                             : number(params, "percent", 100) / 100;
+}
+
+bool GainNode::configure(const std::vector<Format> &inputs, Format &output)
+{
+    return single(inputs, output);
+}
+
+size_t GainNode::begin(const Inputs &inputs, bool)
+{
+    return inputs[0]->frames;
+}
+
+void GainNode::process(const Inputs &inputs, AudioBlock &out, size_t channel)
+{
+    const double *in = inputs[0]->channels[channel].data();
+    double *o = out.channels[channel].data();
+    for(size_t i = 0; i != out.frames; ++i)
+        o[i] = in[i] * gain;
+}
+
+FftEqNode::FftEqNode(const Params &params)
+    : filename(params.find("preset")->second), blockSize(0), countForFFT(0), pendingCount(0), previousPending(0), emitting(0)
+{
+}
+
+bool FftEqNode::configure(const std::vector<Format> &inputs, Format &output)
+{
+    if(!single(inputs, output))
+        return false;
+    preset = DataUtility::cachedPreset(filename.c_str());
+    if(preset.empty())
+    {
+        std::cerr << "ERROR: Nelze nacist preset: " << filename << std::endl;
+        return false;
+    }
+    blockSize = output.SampleRate;
+    countForFFT = DataUtility::findNextTo2Exp(blockSize);
+    /* Doplnění neměnícími frekvencemi jako Wave::padPreset() */
+    if(preset.size() < countForFFT / 2)
+        preset.resize(countForFFT / 2, 1);
+    pending.assign(output.NumChannels, std::vector<double>(blockSize));
+    spectra.assign(output.NumChannels, std::vector<complex>(countForFFT));
+    return true;
+}
+
+size_t FftEqNode::begin(const Inputs &inputs, bool last)
+{
+    /* Vydají se jen celé bloky, na konci proudu i zbytek */
+    size_t total = pendingCount + inputs[0]->frames;
+    previousPending = pendingCount;
+    emitting = last ? total : total / blockSize * blockSize;
+    pendingCount = total - emitting;
+    return emitting;
+}
+
+void FftEqNode::process(const Inputs &inputs, AudioBlock &out, size_t channel)
+{
+    const double *in = inputs[0]->channels[channel].data();
+    double *waiting = pending[channel].data();
+    std::vector<complex> &spectrum = spectra[channel];
+    double *o = out.channels[channel].data();
+    const size_t half = countForFFT / 2;
+
+    /* Proud je pending následovaný vstupem bloku */
+    for(size_t done = 0; done < emitting; done += blockSize)
+    {
+        size_t count = std::min(blockSize, emitting - done);
+        for(size_t k = 0; k != count; ++k)
+        {
+            size_t i = done + k;
+            spectrum[k] = complex(i < previousPending ? waiting[i] : in[i - previousPending]);
+        }
+        std::fill(spectrum.begin() + count, spectrum.end(), complex(0));
+
+        CFFT::Forward(&spectrum[0], countForFFT);
+        /* Stejný filtr jako Wave::applyFilter(), druhá polovina spektra je zrcadlová */
+        for(size_t k = 0; k != half; ++k)
+            spectrum[k] = spectrum[k] * preset[k];
+        for(size_t k = half, j = half - 1; k != countForFFT; ++k, --j)
+            spectrum[k] = spectrum[k] * preset[j];
+        CFFT::Inverse(&spectrum[0], countForFFT, true);
+
+        for(size_t k = 0; k != count; ++k)
+            o[done + k] = spectrum[k].re();
+    }
+
+    /* Zbytek proudu počká na další blok. Bez vydaného bloku už je začátek pending na místě. */
+    size_t total = previousPending + inputs[0]->frames;
+    for(size_t i = emitting == 0 ? previousPending : emitting; i < total; ++i)
+        waiting[i - emitting] = i < previousPending ? waiting[i] : in[i - previousPending];
+}
+
+IirEqNode::IirEqNode(const Params &params)
+    : type("peak"), frequency(number(params, "freq", 1000)), q(number(params, "q", 0.707)), gainDb(number(params, "gain", 0)),
+      b0(1), b1(0), b2(0), a1(0), a2(0)
+{
+    Params::const_iterator it = params.find("type");
+    if(it != params.end())
+        type = it->second;
+}
+
+bool IirEqNode::configure(const std::vector<Format> &inputs, Format &output)
+{
+    if(!single(inputs, output))
+        return false;
+    if(frequency <= 0 || frequency >= output.SampleRate / 2. || q <= 0)
+    {
+        std::cerr << "ERROR: Frekvence iir-eq musi byt mezi 0 a polovinou vzorkovaci frekvence a q kladne." << std::endl;
+        return false;
+    }
+
+    /* Koeficienty podle RBJ Audio EQ Cookbook */
+    const double A = std::pow(10., gainDb / 40);
+    const double w0 = 2 * Pi * frequency / output.SampleRate;
+    const double cosw = std::cos(w0);
+    const double alpha = std::sin(w0) / (2 * q);
+    double a0;
+    if(type == "lowpass")
+    {
+        b0 = (1 - cosw) / 2; b1 = 1 - cosw; b2 = (1 - cosw) / 2;
+        a0 = 1 + alpha; a1 = -2 * cosw; a2 = 1 - alpha;
+    }
+    else if(type == "highpass")
+    {
+        b0 = (1 + cosw) / 2; b1 = -(1 + cosw); b2 = (1 + cosw) / 2;
+        a0 = 1 + alpha; a1 = -2 * cosw; a2 = 1 - alpha;
+    }
+    else if(type == "peak")
+    {
+        b0 = 1 + alpha * A; b1 = -2 * cosw; b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A; a1 = -2 * cosw; a2 = 1 - alpha / A;
+    }
+    else if(type == "lowshelf" || type == "highshelf")
+    {
+        const double s = type == "lowshelf" ? 1 : -1;
+        const double root = 2 * std::sqrt(A) * alpha;
+        b0 = A * ((A + 1) - s * (A - 1) * cosw + root);
+        b1 = 2 * s * A * ((A - 1) - s * (A + 1) * cosw);
+        b2 = A * ((A + 1) - s * (A - 1) * cosw - root);
+        a0 = (A + 1) + s * (A - 1) * cosw + root;
+        a1 = -2 * s * ((A - 1) + s * (A + 1) * cosw);
+        a2 = (A + 1) + s * (A - 1) * cosw - root;
+    }
+    else
+    {
+        std::cerr << "ERROR: Neznamy typ iir-eq: " << type << std::endl;
+        return false;
+    }
+    b0 /= a0; b1 /= a0; b2 /= a0; a1 /= a0; a2 /= a0;
+    z1.assign(output.NumChannels, 0.);
+    z2.assign(output.NumChannels, 0.);
+    return true;
+}
+
+size_t IirEqNode::begin(const Inputs &inputs, bool)
+{
+    return inputs[0]->frames;
+}
+
+void IirEqNode::process(const Inputs &inputs, AudioBlock &out, size_t channel)
+{
+    const double *in = inputs[0]->channels[channel].data();
+    double *o = out.channels[channel].data();
+    double s1 = z1[channel];
+    double s2 = z2[channel];
+    for(size_t i = 0; i != out.frames; ++i)
+    {
+        double x = in[i];
+        double y = b0 * x + s1;
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        o[i] = y;
+    }
+    z1[channel] = s1;
+    z2[channel] = s2;
+}
+
+LimiterNode::LimiterNode(const Params &params)
+    : ceiling(std::pow(10., number(params, "ceiling", -1) / 20)), releaseMs(number(params, "release", 50)), release(0), gain(1)
+{
+}
+
+bool LimiterNode::configure(const std::vector<Format> &inputs, Format &output)
+{
+    if(!single(inputs, output))
+        return false;
+    release = releaseMs > 0 ? std::exp(-1000. / (releaseMs * output.SampleRate)) : 0;
+    return true;
+}
+
+size_t LimiterNode::begin(const Inputs &inputs, bool)
+{
+    return inputs[0]->frames;
+}
+
+void LimiterNode::process(const Inputs &inputs, AudioBlock &out, size_t)
+{
+    const size_t NumChannels = out.channels.size();
+    for(size_t i = 0; i != out.frames; ++i)
+    {
+        double peak = 0;
+        for(size_t ch = 0; ch != NumChannels; ++ch)
+            peak = std::max(peak, std::fabs(inputs[0]->channels[ch][i]));
+        /* Stažení okamžitě, návrat exponenciálně, ale nikdy nad strop */
+        double target = peak > ceiling ? ceiling / peak : 1;
+        gain = std::min(target, 1 - (1 - gain) * release);
+        for(size_t ch = 0; ch != NumChannels; ++ch)
+            out.channels[ch][i] = inputs[0]->channels[ch][i] * gain;
+    }
+}
+
+ResamplerNode::ResamplerNode(const Params &params)
+    : inRate(0), outRate(uint64_t(number(params, "rate", 0))), consumed(0), produced(0), blockStart(0), firstOut(0)
+{
+}
+
+bool ResamplerNode::configure(const std::vector<Format> &inputs, Format &output)
+{
+    if(!single(inputs, output))
+        return false;
+    inRate = output.SampleRate;
+    output.SampleRate = outRate;
+    history.assign(output.NumChannels, std::vector<double>(3, 0.));
+    return true;
+}
+
+size_t ResamplerNode::begin(const Inputs &inputs, bool last)
+{
+    blockStart = consumed;
+    firstOut = produced;
+    consumed += inputs[0]->frames;
+    /* Výstupní sampl m leží ve vstupu na pozici m * inRate / outRate a potřebuje dva další vstupní samply.
+     * Na konci proudu se vydají všechny a chybějící vstupní samply se nahradí posledním. */
+    uint64_t end;
+    if(last)
+        end = (consumed * outRate + inRate - 1) / inRate;
+    else
+        end = consumed > 2 ? ((consumed - 2) * outRate + inRate - 1) / inRate : 0;
+    produced = std::max(produced, end);
+    return size_t(produced - firstOut);
+}
+
+void ResamplerNode::process(const Inputs &inputs, AudioBlock &out, size_t channel)
+{
+    const double *in = inputs[0]->channels[channel].data();
+    std::vector<double> &previous = history[channel];
+    double *o = out.channels[channel].data();
+
+    /* Vstupní sampl j, z bloku nebo z posledních tří před ním, mimo proud se použije krajní */
+    auto sample = [&](int64_t j) -> double {
+        j = std::max<int64_t>(0, std::min<int64_t>(j, int64_t(consumed) - 1));
+        return uint64_t(j) >= blockStart ? in[j - blockStart] : previous[j - (int64_t(blockStart) - 3)];
+    };
+
+    for(size_t i = 0; i != out.frames; ++i)
+    {
+        uint64_t position = (firstOut + i) * inRate;
+        int64_t j = int64_t(position / outRate);
+        double t = double(position % outRate) / outRate;
+        double p0 = sample(j - 1), p1 = sample(j), p2 = sample(j + 1), p3 = sample(j + 2);
+        double a = -.5 * p0 + 1.5 * p1 - 1.5 * p2 + .5 * p3;
+        double b = p0 - 2.5 * p1 + 2 * p2 - .5 * p3;
+        double c = -.5 * p0 + .5 * p2;
+        o[i] = ((a * t + b) * t + c) * t + p1;
+    }
+
+    if(consumed == 0)
+        return;
+    double tail[3];
+    for(int k = 0; k != 3; ++k)
+        tail[k] = sample(int64_t(consumed) - 3 + k);
+    std::copy(tail, tail + 3, previous.begin());
+}
+
+MixNode::MixNode(const Params &params) : emitting(0)
+{
+    Params::const_iterator it = params.find("gains");
+    if(it != params.end())
+    {
+        std::istringstream list(it->second);
+        std::string item;
+        while(std::getline(list, item, ','))
+            gains.push_back(atof(item.c_str()) / 100);
+    }
+}
+
+bool MixNode::configure(const std::vector<Format> &inputs, Format &output)
+{
+    if(inputs.empty())
+        return false;
+    for(size_t i = 1; i != inputs.size(); ++i)
+        if(inputs[i].SampleRate != inputs[0].SampleRate || inputs[i].NumChannels != inputs[0].NumChannels)
+        {
+            std::cerr << "ERROR: Vstupy uzlu mix musi mit stejnou vzorkovaci frekvenci a pocet kanalu." << std::endl;
+            return false;
+        }
+    output = inputs[0];
+    gains.resize(inputs.size(), 1.);
+    queues.assign(inputs.size(), std::vector<std::vector<double> >(output.NumChannels));
+    queued.assign(inputs.size(), 0);
+    previousQueued.assign(inputs.size(), 0);
+    return true;
+}
+
+size_t MixNode::begin(const Inputs &inputs, bool last)
+{
+    /* Vydá se, co je k dispozici ve všech vstupech, na konci proudu všechno */
+    emitting = last ? 0 : size_t(-1);
+    for(size_t i = 0; i != inputs.size(); ++i)
+    {
+        size_t available = queued[i] + inputs[i]->frames;
+        emitting = last ? std::max(emitting, available) : std::min(emitting, available);
+    }
+    for(size_t i = 0; i != inputs.size(); ++i)
+    {
+        size_t available = queued[i] + inputs[i]->frames;
+        previousQueued[i] = queued[i];
+        queued[i] = available > emitting ? available - emitting : 0;
+        /* Fronty se zvětšují jen v této sériové části */
+        for(size_t ch = 0; ch != queues[i].size(); ++ch)
+            if(queues[i][ch].size() < std::max(queued[i], previousQueued[i]))
+                queues[i][ch].resize(std::max(queued[i], previousQueued[i]));
+    }
+    return emitting;
+}
+
+void MixNode::process(const Inputs &inputs, AudioBlock &out, size_t channel)
+{
+    double *o = out.channels[channel].data();
+    std::fill(o, o + emitting, 0.);
+    for(size_t i = 0; i != inputs.size(); ++i)
+    {
+        const double *in = inputs[i]->channels[channel].data();
+        double *queue = queues[i][channel].data();
+        const size_t before = previousQueued[i];
+        const size_t available = before + inputs[i]->frames;
+        const double g = gains[i];
+        /* Proud vstupu je jeho fronta následovaná blokem */
+        for(size_t k = 0; k != std::min(emitting, available); ++k)
+            o[k] += g * (k < before ? queue[k] : in[k - before]);
+        /* Zbytek se posune na začátek fronty, čte se vždy dál, než se zapisuje */
+        for(size_t k = emitting; k < available; ++k)
+            queue[k - emitting] = k < before ? queue[k] : in[k - before];
+    }
+}
+
+RemixNode::RemixNode(const Params &params) : spec(params.find("matrix")->second)
+{
+}
+
+bool RemixNode::configure(const std::vector<Format> &inputs, Format &output)
+{
+    if(!single(inputs, output) || !matrix.load(spec, output.NumChannels))
+        return false;
+    output.NumChannels = matrix.outputCount();
+    in.resize(inputs[0].NumChannels);
+    return true;
+}
+
+size_t RemixNode::begin(const Inputs &inputs, bool)
+{
+    /* Ukazatele na kanály se nastaví v sériové části, buffery se v process() už nemění */
+    for(size_t c = 0; c != in.size(); ++c)
+        in[c] = inputs[0]->channels[c].data();
+    return inputs[0]->frames;
+}
+
+void RemixNode::process(const Inputs &, AudioBlock &out, size_t channel)
+{
+    matrix.applyRow(channel, &in[0], out.channels[channel].data(), out.frames);
+}
@@ -0,0 +1,164 @@
+﻿#ifndef EFFECTS_H
+#define EFFECTS_H
+#include "effect_node.h"
+#include "channel_matrix.h"
+#include "complex.h"
+#include <cstdint>
+
+/**
+ * @brief Zesílení o daný počet procent nebo dB.
+ *
+ * Parametry: percent=P (výchozí 100), nebo db=X.
+ */
+class GainNode : public EffectNode
+{
+public:
+    explicit GainNode(const Params &params);
+    bool configure(const std::vector<Format> &inputs, Format &output);
+    size_t begin(const Inputs &inputs, bool last);
+    void process(const Inputs &inputs, AudioBlock &out, size_t channel);
+
+private:
+    double gain;    /**< Násobek samplů. */
+};
+
+/**
+ * @brief Equalizace presetem přes FFT, stejně jako Wave::equalizeWith(), ale bez normalizace.
+ *
+ * Samply se sbírají do bloků o velikosti SampleRate, každý blok se doplní nulami na mocninu dvojky,
+ * projde dopřednou FFT, vynásobí se presetem a projde inverzní FFT. Výstup je tedy o blok zpožděný.
+ * Parametry: preset=Soubor.
+ */
+class FftEqNode : public EffectNode
+{
+public:
+    explicit FftEqNode(const Params &params);
+    bool configure(const std::vector<Format> &inputs, Format &output);
+    size_t begin(const Inputs &inputs, bool last);
+    void process(const Inputs &inputs, AudioBlock &out, size_t channel);
+
+private:
+    std::string filename;                           /**< Cesta k presetu. */
+    std::vector<double> preset;                     /**< Preset doplněný na polovinu velikosti FFT. */
+    size_t blockSize;                               /**< Délka bloku, SampleRate. */
+    size_t countForFFT;                             /**< Velikost FFT. */
+    std::vector<std::vector<double> > pending;      /**< Samply nedokončeného bloku pro každý kanál. */
+    std::vector<std::vector<complex> > spectra;     /**< Buffer FFT pro každý kanál. */
+    size_t pendingCount;                            /**< Počet samplů v pending po begin(). */
+    size_t previousPending;                         /**< Počet samplů v pending před begin(). */
+    size_t emitting;                                /**< Počet samplů, které se vydají v aktuálním bloku. */
+};
+
+/**
+ * @brief Parametrický ekvalizér z jednoho bikvadratického filtru (RBJ Audio EQ Cookbook).
+ *
+ * Parametry: type=peak|lowpass|highpass|lowshelf|highshelf (výchozí peak), freq=Hz (výchozí 1000),
+ * q=Q (výchozí 0.707), gain=dB (výchozí 0, jen pro peak a shelf).
+ */
+class IirEqNode : public EffectNode
+{
+public:
+    explicit IirEqNode(const Params &params);
+    bool configure(const std::vector<Format> &inputs, Format &output);
+    size_t begin(const Inputs &inputs, bool last);
+    void process(const Inputs &inputs, AudioBlock &out, size_t channel);
+
+private:
+    std::string type;               /**< Typ filtru. */
+    double frequency;               /**< Střední nebo mezní frekvence. */
+    double q;                       /**< Činitel jakosti. */
+    double gainDb;                  /**< Zesílení pro peak a shelf. */
+    double b0, b1, b2, a1, a2;      /**< Normované koeficienty. */
+    std::vector<double> z1, z2;     /**< Stav filtru pro každý kanál (transponovaná přímá forma II). */
+};
+
+/**
+ * @brief Limiter se společným zesílením pro všechny kanály.
+ *
+ * Špička přes ceiling se stáhne okamžitě, zesílení se pak exponenciálně vrací k 1.
+ * Parametry: ceiling=dB (výchozí -1), release=ms (výchozí 50).
+ */
+class LimiterNode : public EffectNode
+{
+public:
+    explicit LimiterNode(const Params &params);
+    bool configure(const std::vector<Format> &inputs, Format &output);
+    bool perChannel() const { return false; }
+    size_t begin(const Inputs &inputs, bool last);
+    void process(const Inputs &inputs, AudioBlock &out, size_t channel);
+
+private:
+    double ceiling;         /**< Strop v lineární míře. */
+    double releaseMs;       /**< Doba návratu zesílení. */
+    double release;         /**< Koeficient návratu za jeden sampl. */
+    double gain;            /**< Aktuální zesílení. */
+};
+
+/**
+ * @brief Převzorkování na jinou vzorkovací frekvenci kubickou (Catmull-Rom) interpolací.
+ *
+ * Poloha výstupního samplu ve vstupu se počítá v celých číslech, takže se chyba nehromadí.
+ * Parametry: rate=Hz.
+ */
+class ResamplerNode : public EffectNode
+{
+public:
+    explicit ResamplerNode(const Params &params);
+    bool configure(const std::vector<Format> &inputs, Format &output);
+    size_t begin(const Inputs &inputs, bool last);
+    void process(const Inputs &inputs, AudioBlock &out, size_t channel);
+
+private:
+    uint64_t inRate;                                /**< Vstupní vzorkovací frekvence. */
+    uint64_t outRate;                               /**< Výstupní vzorkovací frekvence. */
+    uint64_t consumed;                              /**< Počet přijatých vstupních samplů po begin(). */
+    uint64_t produced;                              /**< Počet vydaných výstupních samplů po begin(). */
+    uint64_t blockStart;                            /**< Index prvního vstupního samplu aktuálního bloku. */
+    uint64_t firstOut;                              /**< Index prvního výstupního samplu aktuálního bloku. */
+    std::vector<std::vector<double> > history;      /**< Poslední tři vstupní samply před blokem pro každý kanál. */
+};
+
+/**
+ * @brief Součet několika větví grafu.
+ *
+ * Větve mohou mít různé zpoždění, samply se proto zarovnávají přes frontu každého vstupu.
+ * Na konci proudu se kratší větve doplní tichem. Všechny vstupy musí mít stejný formát.
+ * Parametry: gains=P1,P2,... v procentech (výchozí 100 pro každý vstup).
+ */
+class MixNode : public EffectNode
+{
+public:
+    explicit MixNode(const Params &params);
+    bool configure(const std::vector<Format> &inputs, Format &output);
+    size_t begin(const Inputs &inputs, bool last);
+    void process(const Inputs &inputs, AudioBlock &out, size_t channel);
+
+private:
+    std::vector<double> gains;                                      /**< Násobky vstupů. */
+    std::vector<std::vector<std::vector<double> > > queues;         /**< Fronta samplů pro každý vstup a kanál. */
+    std::vector<size_t> queued;                                     /**< Počet samplů ve frontách po begin(). */
+    std::vector<size_t> previousQueued;                             /**< Počet samplů ve frontách před begin(). */
+    size_t emitting;                                                /**< Počet samplů, které se vydají v aktuálním bloku. */
+};
+
+/**
+ * @brief Přemixování kanálů maticí, např. downmix 5.1 na stereo.
+ *
+ * Výstupní kanály se počítají paralelně, každý jako kombinace všech vstupních kanálů bloku.
+ * Parametry: matrix=stereo|mono|ms|lr|Soubor (viz ChannelMatrix).
+ */
+class RemixNode : public EffectNode
+{
+public:
+    explicit RemixNode(const Params &params);
+    bool configure(const std::vector<Format> &inputs, Format &output);
+    size_t begin(const Inputs &inputs, bool last);
+    void process(const Inputs &inputs, AudioBlock &out, size_t channel);
+
+private:
+    std::string spec;               /**< Jméno matice, nebo cesta k souboru. */
+    ChannelMatrix matrix;           /**< Matice pro počet kanálů vstupu. */
+    std::vector<const double*> in;  /**< Ukazatele na kanály vstupního bloku. */
+};
+
+#endif // EFFECTS_H
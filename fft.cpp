@@ -9,6 +9,9 @@
 #include "fft.h"
 //   Include math library
 #include <math.h>
+//   Include containers and synchronization for transform factor tables
+#include <mutex>
+#include <vector>
 
 //   FORWARD FOURIER TRANSFORM
 //     Input  - input data
@@ -22,7 +25,7 @@ bool CFFT::Forward(const complex *const Input, complex *const Output, const unsi
     //   Initialize data
     Rearrange(Input, Output, N);
     //   Call FFT implementation
-    Perform(Output, N);
+    Transform(Output, N);
     //   Succeeded
     return true;
 }
@@ -38,7 +41,7 @@ bool CFFT::Forward(complex *const Data, const unsigned int N)
     //   Rearrange
     Rearrange(Data, N);
     //   Call FFT implementation
-    Perform(Data, N);
+    Transform(Data, N);
     //   Succeeded
     return true;
 }
@@ -56,7 +59,7 @@ bool CFFT::Inverse(const complex *const Input, complex *const Output, const unsi
     //   Initialize data
     Rearrange(Input, Output, N);
     //   Call FFT implementation
-    Perform(Output, N, true);
+    Transform(Output, N, true);
     //   Scale if necessary
     if (Scale)
         CFFT::Scale(Output, N);
@@ -76,7 +79,7 @@ bool CFFT::Inverse(complex *const Data, const unsigned int N, const bool Scale /
     //   Rearrange
     Rearrange(Data, N);
     //   Call FFT implementation
-    Perform(Data, N, true);
+    Transform(Data, N, true);
     //   Scale if necessary
     if (Scale)
         CFFT::Scale(Data, N);
@@ -170,6 +173,90 @@ void CFFT::Perform(complex *const Data, const unsigned int N, const bool Inverse
     }
 }
 
+//   Transform factor tables for all sizes up to 2^31, forward and inverse
+namespace
+{
+    //   Each table is built once, afterwards it is read without locking
+    std::once_flag TwiddleOnce[2][32];
+    std::vector<complex> TwiddleTables[2][32];
+
+    //   One butterfly of Perform
+    inline void Butterfly(complex *const Data, const unsigned int Pair, const unsigned int Step, const complex &Factor)
+    {
+        //   Match position
+        const unsigned int Match = Pair + Step;
+        //   Second term of two-point transform
+        const complex Product(Factor * Data[Match]);
+        //   Transform for fi + pi
+        Data[Match] = Data[Pair] - Product;
+        //   Transform for fi
+        Data[Pair] += Product;
+    }
+}
+
+//   Transform factors of all stages for size N
+const complex *CFFT::Twiddles(const unsigned int N, const bool Inverse)
+{
+    unsigned int Log = 0;
+    while ((1u << Log) < N)
+        ++Log;
+    std::vector<complex> &Table = TwiddleTables[Inverse ? 1 : 0][Log];
+    std::call_once(TwiddleOnce[Inverse ? 1 : 0][Log], [&]()
+    {
+        const double pi = Inverse ? 3.14159265358979323846 : -3.14159265358979323846;
+        Table.resize(N);
+        //   The same trigonometric recurrence as in Perform, so the factors are identical
+        for (unsigned int Step = 1; Step < N; Step <<= 1)
+        {
+            const double delta = pi / double(Step);
+            const double Sine = sin(delta * .5);
+            const complex Multiplier(-2. * Sine * Sine, sin(delta));
+            complex Factor(1.);
+            for (unsigned int Group = 0; Group < Step; ++Group)
+            {
+                Table[Step + Group] = Factor;
+                Factor = Multiplier * Factor + Factor;
+            }
+        }
+    });
+    return &Table[0];
+}
+
+//   Parameters of the cache-friendly implementation
+CFFT::Tuning CFFT::tuning;
+
+//   Perform or PerformLarge according to tuning
+void CFFT::Transform(complex *const Data, const unsigned int N, const bool Inverse /* = false */)
+{
+    //   Blocks and tiles must fit into the transform
+    if (tuning.LargeN && N >= tuning.LargeN && tuning.LargeBlock <= N && tuning.LargeTile <= tuning.LargeBlock)
+        PerformLarge(Data, N, Inverse);
+    else
+        Perform(Data, N, Inverse);
+}
+
+//   Cache-friendly FFT implementation for large N
+void CFFT::PerformLarge(complex *const Data, const unsigned int N, const bool Inverse /* = false */)
+{
+    const complex *const Factors = Twiddles(N, Inverse);
+    const unsigned int LargeBlock = tuning.LargeBlock;
+    const unsigned int LargeTile = tuning.LargeTile;
+    //   Short stages only combine entries inside one block, finish all of them block by block
+    for (unsigned int Base = 0; Base < N; Base += LargeBlock)
+        for (unsigned int Step = 1; Step < LargeBlock; Step <<= 1)
+            for (unsigned int Pair = Base; Pair < Base + LargeBlock; Pair += Step << 1)
+                for (unsigned int Group = 0; Group < Step; ++Group)
+                    Butterfly(Data, Pair + Group, Step, Factors[Step + Group]);
+    //   Long stages only combine entries with the same position inside a block (the same column),
+    //   finish all of them for a tile of neighbouring columns at a time
+    for (unsigned int Column = 0; Column < LargeBlock; Column += LargeTile)
+        for (unsigned int Step = LargeBlock; Step < N; Step <<= 1)
+            for (unsigned int Pair = 0; Pair < N; Pair += Step << 1)
+                for (unsigned int Row = 0; Row < Step; Row += LargeBlock)
+                    for (unsigned int Group = Row + Column; Group < Row + Column + LargeTile; ++Group)
+                        Butterfly(Data, Pair + Group, Step, Factors[Step + Group]);
+}
+
 //   Scaling of inverse FFT result
 void CFFT::Scale(complex *const Data, const unsigned int N)
 {
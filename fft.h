@@ -41,6 +41,20 @@ public:
 	//     Scale - if to scale result
 	static bool Inverse(complex *const Data, const unsigned int N, const bool Scale = true);
 
+	//   Parameters of the cache-friendly implementation, any choice gives the same result
+	//     LargeN     - sizes from LargeN up use PerformLarge, 0 means never
+	//     LargeBlock - length of the blocks of short stages, power of two
+	//     LargeTile  - number of neighbouring columns of long stages done together, power of two
+	//   Defaults fit most caches, Wisdom sets values measured on the current machine
+	struct Tuning
+	{
+		unsigned int LargeN;
+		unsigned int LargeBlock;
+		unsigned int LargeTile;
+		Tuning() : LargeN(1 << 14), LargeBlock(1 << 12), LargeTile(16) {}
+	};
+	static Tuning tuning;
+
 protected:
 	//   Rearrange function and its inplace version
 	static void Rearrange(const complex *const Input, complex *const Output, const unsigned int N);
@@ -49,6 +63,18 @@ protected:
 	//   FFT implementation
 	static void Perform(complex *const Data, const unsigned int N, const bool Inverse = false);
 
+	//   Cache-friendly FFT implementation for large N, same result as Perform
+	//     Stages shorter than LargeBlock run block by block, the remaining stages
+	//     run on tiles of LargeTile neighbouring columns, so the working set fits the cache
+	static void PerformLarge(complex *const Data, const unsigned int N, const bool Inverse = false);
+
+	//   Transform factors of all stages for size N, Factor of group g in stage Step is at [Step + g]
+	//   Computed once per size and direction by the same recurrence as in Perform
+	static const complex *Twiddles(const unsigned int N, const bool Inverse);
+
+	//   Perform or PerformLarge according to tuning
+	static void Transform(complex *const Data, const unsigned int N, const bool Inverse = false);
+
 	//   Scaling of inverse FFT result
 	static void Scale(complex *const Data, const unsigned int N);
 };
@@ -0,0 +1,863 @@
+﻿#include "flac.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    /* Tabulky CRC-8 (polynom 0x07) hlavičky rámce a CRC-16 (polynom 0x8005) celého rámce */
+    struct CrcTables
+    {
+        unsigned char crc8[256];
+        unsigned short crc16[256];
+
+        CrcTables()
+        {
+            for(unsigned int i = 0; i != 256; ++i)
+            {
+                unsigned int c8 = i;
+                unsigned int c16 = i << 8;
+                for(int bit = 0; bit != 8; ++bit)
+                {
+                    c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+                    c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+                }
+                crc8[i] = c8 & 0xFF;
+                crc16[i] = c16 & 0xFFFF;
+            }
+        }
+    };
+
+    const CrcTables tables;
+
+    unsigned int crc8(const unsigned char *data, size_t size)
+    {
+        unsigned int crc = 0;
+        for(size_t i = 0; i != size; ++i)
+            crc = tables.crc8[crc ^ data[i]];
+        return crc;
+    }
+
+    unsigned int crc16(const unsigned char *data, size_t size)
+    {
+        unsigned int crc = 0;
+        for(size_t i = 0; i != size; ++i)
+            crc = ((crc << 8) ^ tables.crc16[(crc >> 8) ^ data[i]]) & 0xFFFF;
+        return crc;
+    }
+
+    /* Zápis bitů od nejvyššího, jak je FLAC ukládá */
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<unsigned char> &out) : out(out), buffer(0), count(0) {}
+
+        void write(uint32_t value, unsigned int bits)
+        {
+            if(bits == 0)
+                return;
+            buffer = (buffer << bits) | (bits == 32 ? value : value & ((1u << bits) - 1));
+            count += bits;
+            while(count >= 8)
+            {
+                count -= 8;
+                out.push_back((unsigned char)(buffer >> count));
+            }
+            buffer &= (uint64_t(1) << count) - 1;
+        }
+
+        void writeSigned(int32_t value, unsigned int bits)
+        {
+            write(uint32_t(value), bits);
+        }
+
+        /* Riceův kód: podíl unárně (nuly a jednička), zbytek na k bitech */
+        void writeRice(int32_t value, unsigned int k)
+        {
+            uint32_t u = (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+            uint32_t q = u >> k;
+            if(q + 1 + k <= 32)
+                write((1u << k) | (u & ((1u << k) - 1)), q + 1 + k);
+            else
+            {
+                for(; q >= 32; q -= 32)
+                    write(0, 32);
+                write(1, q + 1);
+                write(u, k);
+            }
+        }
+
+        void align()
+        {
+            if(count)
+                write(0, 8 - count);
+        }
+
+    private:
+        std::vector<unsigned char> &out;
+        uint64_t buffer;
+        unsigned int count;
+    };
+
+    /* Čtení bitů od nejvyššího, data musí mít za koncem 8 nulových Bajtů */
+    class BitReader
+    {
+    public:
+        BitReader(const unsigned char *data, size_t size, size_t byte) : data(data), bits(uint64_t(size) * 8), position(uint64_t(byte) * 8) {}
+
+        uint32_t read(unsigned int n)
+        {
+            if(n == 0)
+                return 0;
+            if(position >= bits)
+            {
+                position += n;
+                return 0;
+            }
+            const unsigned char *p = data + (position >> 3);
+            uint64_t window = 0;
+            for(int i = 0; i != 8; ++i)
+                window = (window << 8) | p[i];
+            uint32_t value = uint32_t((window << (position & 7)) >> (64 - n));
+            position += n;
+            return value;
+        }
+
+        int32_t readSigned(unsigned int n)
+        {
+            if(n == 0)
+                return 0;
+            uint32_t value = read(n);
+            return n == 32 ? int32_t(value) : int32_t(value << (32 - n)) >> (32 - n);
+        }
+
+        uint32_t readUnary()
+        {
+            /* Nuly se počítají po 64 bitech */
+            uint32_t zeros = 0;
+            while(position < bits)
+            {
+                const unsigned char *p = data + (position >> 3);
+                uint64_t window = 0;
+                for(int i = 0; i != 8; ++i)
+                    window = (window << 8) | p[i];
+                window <<= position & 7;
+                if(window == 0)
+                {
+                    zeros += 64 - (position & 7);
+                    position += 64 - (position & 7);
+                    continue;
+                }
+                int leading = __builtin_clzll(window);
+                zeros += leading;
+                position += leading + 1;
+                return zeros;
+            }
+            position = bits + 1;
+            return zeros;
+        }
+
+        void align() { position = (position + 7) & ~uint64_t(7); }
+        size_t byte() const { return size_t(position >> 3); }
+        bool overrun() const { return position > bits; }
+
+    private:
+        const unsigned char *data;
+        uint64_t bits;
+        uint64_t position;
+    };
+
+    const int RiceEscape = 15;      /* Parametr 15 u 4bitových parametrů znamená nekódovaný oddíl */
+    const int MaxRiceParameter = 14;
+    const size_t MaxPartitionOrder = 8;
+    const int LpcPrecision = 12;
+    const int MaxLpcShift = 15;
+
+    /* Parametry všech řádů dělení jsou v jednom poli, řád p začíná na indexu 2^p - 1 */
+    inline size_t levelOffset(size_t order) { return (size_t(1) << order) - 1; }
+}
+
+FlacEncoder::FlacEncoder(size_t NumChannels, size_t BitsPerSample, size_t SampleRate, uint64_t samples, size_t workers)
+    : NumChannels(NumChannels), BitsPerSample(BitsPerSample), SampleRate(SampleRate), samples(samples),
+      window(BlockSize), scratch(std::max<size_t>(1, workers))
+{
+    /* Tukeyho okno s polovinou délky v náběhu a doběhu */
+    const double taper = 0.25 * (BlockSize - 1);
+    for(size_t i = 0; i != BlockSize; ++i)
+    {
+        double distance = std::min<double>(i, BlockSize - 1 - i);
+        window[i] = distance < taper ? 0.5 * (1 - std::cos(M_PI * distance / taper)) : 1;
+    }
+
+    for(size_t w = 0; w != scratch.size(); ++w)
+    {
+        Scratch &s = scratch[w];
+        /* Všechny kanály, u sterea navíc střed a rozdíl */
+        const size_t signals = std::max<size_t>(NumChannels, 4);
+        s.signal.resize(signals);
+        s.best.resize(signals);
+        for(size_t c = 0; c != signals; ++c)
+        {
+            s.signal[c].resize(BlockSize);
+            s.best[c].residual.resize(BlockSize);
+            s.best[c].parameters.resize(levelOffset(MaxPartitionOrder + 1));
+        }
+        s.candidate.residual.resize(BlockSize);
+        s.candidate.parameters.resize(levelOffset(MaxPartitionOrder + 1));
+        s.windowed.resize(BlockSize);
+        s.sums.reserve(size_t(1) << MaxPartitionOrder);
+    }
+}
+
+bool FlacEncoder::supported() const
+{
+    return NumChannels >= 1 && NumChannels <= 8 && (BitsPerSample == 8 || BitsPerSample == 16)
+           && SampleRate > 0 && SampleRate < (1u << 20) && samples < (uint64_t(1) << 36);
+}
+
+void FlacEncoder::header(std::vector<unsigned char> &out) const
+{
+    out.assign({'f', 'L', 'a', 'C', 0x80, 0, 0, 34});
+    BitWriter w(out);
+    w.write(BlockSize, 16);
+    w.write(BlockSize, 16);
+    w.write(0, 24);
+    w.write(0, 24);
+    w.write(SampleRate, 20);
+    w.write(NumChannels - 1, 3);
+    w.write(BitsPerSample - 1, 5);
+    w.write(uint32_t(samples >> 32), 4);
+    w.write(uint32_t(samples), 32);
+    for(int i = 0; i != 4; ++i)
+        w.write(0, 32);
+}
+
+uint64_t FlacEncoder::chooseRice(Subframe &sub, size_t count, std::vector<uint64_t> &sums) const
+{
+    const size_t order = sub.order;
+    size_t maxOrder = 0;
+    while(maxOrder < MaxPartitionOrder && count % (size_t(2) << maxOrder) == 0 && (count >> (maxOrder + 1)) > order)
+        ++maxOrder;
+
+    /* Součty zbytků v nejjemnějších oddílech, hrubší dělení se z nich jen sečtou */
+    size_t partitions = size_t(1) << maxOrder;
+    size_t size = count >> maxOrder;
+    sums.assign(partitions, 0);
+    const int32_t *residual = &sub.residual[0];
+    for(size_t p = 0; p != partitions; ++p)
+    {
+        uint64_t sum = 0;
+        for(size_t i = p == 0 ? order : p * size; i != (p + 1) * size; ++i)
+            sum += (uint32_t(residual[i]) << 1) ^ uint32_t(residual[i] >> 31);
+        sums[p] = sum;
+    }
+
+    uint64_t best = ~uint64_t(0);
+    for(size_t level = maxOrder + 1; level-- != 0; )
+    {
+        partitions = size_t(1) << level;
+        size = count >> level;
+        int *parameters = &sub.parameters[levelOffset(level)];
+        uint64_t bits = 0;
+        for(size_t p = 0; p != partitions; ++p)
+        {
+            uint64_t n = size - (p == 0 ? order : 0);
+            /* Odhad délky: n * (k + 1) + součet / 2^k, nejlepší k leží u log2 průměru */
+            uint64_t partitionBits = ~uint64_t(0);
+            int guess = 0;
+            while(guess < MaxRiceParameter && (n << (guess + 1)) <= sums[p])
+                ++guess;
+            for(int k = std::max(0, guess - 1); k <= std::min(MaxRiceParameter, guess + 1); ++k)
+            {
+                uint64_t estimate = n * (k + 1) + (sums[p] >> k);
+                if(estimate < partitionBits)
+                {
+                    partitionBits = estimate;
+                    parameters[p] = k;
+                }
+            }
+            bits += 4 + partitionBits;
+        }
+        if(bits <= best)
+        {
+            best = bits;
+            sub.partitionOrder = level;
+        }
+        for(size_t p = 0; 2 * p + 1 < partitions; ++p)
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    return 2 + 4 + best;
+}
+
+void FlacEncoder::analyze(const int32_t *x, size_t count, int bps, Scratch &scratch, Subframe &best) const
+{
+    /* Konstanta */
+    bool constant = true;
+    for(size_t i = 1; i != count && constant; ++i)
+        constant = x[i] == x[0];
+    best.order = 0;
+    if(constant)
+    {
+        best.type = 0;
+        best.bits = 8 + bps;
+        return;
+    }
+    best.type = 1;
+    best.bits = 8 + uint64_t(count) * bps;
+
+    /* Pevný prediktor: řád podle součtu absolutních hodnot zbytků */
+    Subframe &candidate = scratch.candidate;
+    if(count > 4)
+    {
+        uint64_t error[5] = {0, 0, 0, 0, 0};
+        for(size_t i = 4; i != count; ++i)
+        {
+            int64_t e0 = x[i];
+            int64_t e1 = e0 - x[i-1];
+            int64_t e2 = e1 - (int64_t(x[i-1]) - x[i-2]);
+            int64_t e3 = e2 - (int64_t(x[i-1]) - 2 * int64_t(x[i-2]) + x[i-3]);
+            int64_t e4 = e3 - (int64_t(x[i-1]) - 3 * int64_t(x[i-2]) + 3 * int64_t(x[i-3]) - x[i-4]);
+            error[0] += std::llabs(e0);
+            error[1] += std::llabs(e1);
+            error[2] += std::llabs(e2);
+            error[3] += std::llabs(e3);
+            error[4] += std::llabs(e4);
+        }
+        size_t order = std::min_element(error, error + 5) - error;
+        for(size_t i = order; i != count; ++i)
+        {
+            int64_t r;
+            switch(order)
+            {
+            case 0: r = x[i]; break;
+            case 1: r = int64_t(x[i]) - x[i-1]; break;
+            case 2: r = int64_t(x[i]) - 2 * int64_t(x[i-1]) + x[i-2]; break;
+            case 3: r = int64_t(x[i]) - 3 * int64_t(x[i-1]) + 3 * int64_t(x[i-2]) - x[i-3]; break;
+            default: r = int64_t(x[i]) - 4 * int64_t(x[i-1]) + 6 * int64_t(x[i-2]) - 4 * int64_t(x[i-3]) + x[i-4]; break;
+            }
+            candidate.residual[i] = int32_t(r);
+        }
+        candidate.type = 2;
+        candidate.order = order;
+        candidate.bits = 8 + uint64_t(order) * bps + chooseRice(candidate, count, scratch.sums);
+        if(candidate.bits < best.bits)
+            std::swap(best, candidate);
+    }
+
+    /* LPC: autokorelace signálu v okně, Levinson-Durbin pro všechny řády */
+    if(count <= 4 * MaxLpcOrder)
+        return;
+    std::vector<double> &windowed = scratch.windowed;
+    for(size_t i = 0; i != count; ++i)
+        windowed[i] = x[i] * (count == BlockSize ? window[i] : 1.);
+    /* Všechna zpoždění v jednom průchodu, součty na sobě nezávisí */
+    double autoc[MaxLpcOrder + 1] = {0};
+    for(size_t i = 0; i != MaxLpcOrder; ++i)
+        for(size_t lag = 0; lag <= i; ++lag)
+            autoc[lag] += windowed[i] * windowed[i - lag];
+    for(size_t i = MaxLpcOrder; i != count; ++i)
+        for(size_t lag = 0; lag <= MaxLpcOrder; ++lag)
+            autoc[lag] += windowed[i] * windowed[i - lag];
+    if(autoc[0] <= 0)
+        return;
+
+    double lpc[MaxLpcOrder][MaxLpcOrder];
+    double error[MaxLpcOrder];
+    double current[MaxLpcOrder];
+    double err = autoc[0];
+    size_t orders = 0;
+    for(size_t i = 0; i != MaxLpcOrder; ++i)
+    {
+        double r = -autoc[i + 1];
+        for(size_t j = 0; j != i; ++j)
+            r -= current[j] * autoc[i - j];
+        r /= err;
+        current[i] = r;
+        for(size_t j = 0; j != i / 2; ++j)
+        {
+            double tmp = current[j];
+            current[j] += r * current[i - 1 - j];
+            current[i - 1 - j] += r * tmp;
+        }
+        if(i % 2)
+            current[i / 2] += current[i / 2] * r;
+        err *= 1 - r * r;
+        /* Prediktor má opačná znaménka než koeficienty z rekurze */
+        for(size_t j = 0; j <= i; ++j)
+            lpc[i][j] = -current[j];
+        error[i] = err;
+        ++orders;
+        if(err <= 0)
+            break;
+    }
+
+    /* Řád podle očekávané délky zbytků, jako v referenčním kodéru */
+    size_t order = 0;
+    double bestEstimate = 0;
+    for(size_t i = 0; i != orders; ++i)
+    {
+        double perSample = error[i] > 0 ? std::max(0., 0.5 * std::log2(0.5 * error[i] / count)) : 0;
+        double estimate = perSample * (count - i - 1) + (i + 1) * double(bps + LpcPrecision);
+        if(i == 0 || estimate < bestEstimate)
+        {
+            bestEstimate = estimate;
+            order = i + 1;
+        }
+    }
+
+    /* Kvantizace koeficientů s přenosem chyby zaokrouhlení */
+    const double *coefs = lpc[order - 1];
+    double cmax = 0;
+    for(size_t j = 0; j != order; ++j)
+        cmax = std::max(cmax, std::fabs(coefs[j]));
+    if(cmax <= 0)
+        return;
+    int exponent;
+    std::frexp(cmax, &exponent);
+    int shift = std::min(MaxLpcShift, LpcPrecision - 1 - exponent);
+    if(shift < 0)
+        return;
+    const int32_t qmax = (1 << (LpcPrecision - 1)) - 1;
+    double carry = 0;
+    for(size_t j = 0; j != order; ++j)
+    {
+        carry += coefs[j] * (1 << shift);
+        int32_t q = int32_t(std::lround(carry));
+        q = std::max(-qmax - 1, std::min(qmax, q));
+        carry -= q;
+        candidate.coefs[j] = q;
+    }
+
+    for(size_t i = order; i != count; ++i)
+    {
+        int64_t sum = 0;
+        for(size_t j = 0; j != order; ++j)
+            sum += int64_t(candidate.coefs[j]) * x[i - 1 - j];
+        int64_t r = x[i] - (sum >> shift);
+        /* Zbytek se nevejde do Riceova kódu, LPC se nepoužije */
+        if(r > (1 << 30) || r < -(1 << 30))
+            return;
+        candidate.residual[i] = int32_t(r);
+    }
+    candidate.type = 3;
+    candidate.order = order;
+    candidate.precision = LpcPrecision;
+    candidate.shift = shift;
+    candidate.bits = 8 + uint64_t(order) * bps + 4 + 5 + order * LpcPrecision + chooseRice(candidate, count, scratch.sums);
+    if(candidate.bits < best.bits)
+        std::swap(best, candidate);
+}
+
+void FlacEncoder::encodeFrame(const char *pcm, size_t count, uint64_t number, size_t worker, std::vector<unsigned char> &out)
+{
+    Scratch &s = scratch[worker];
+    const int bps = int(BitsPerSample);
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(pcm);
+
+    /* Rozdělení na kanály, 8bitové WAV samply jsou bez znaménka */
+    for(size_t i = 0; i != count; ++i)
+        for(size_t ch = 0; ch != NumChannels; ++ch)
+        {
+            if(bps == 16)
+            {
+                s.signal[ch][i] = int16_t(p[0] | (p[1] << 8));
+                p += 2;
+            }
+            else
+                s.signal[ch][i] = int32_t(*p++) - 128;
+        }
+
+    size_t candidates = NumChannels;
+    if(NumChannels == 2)
+    {
+        for(size_t i = 0; i != count; ++i)
+        {
+            int32_t left = s.signal[0][i];
+            int32_t right = s.signal[1][i];
+            s.signal[2][i] = (left + right) >> 1;
+            s.signal[3][i] = left - right;
+        }
+        candidates = 4;
+    }
+    /* Rozdíl sterea má o bit víc, čtvrtý kanál vícekanálového zvuku ne */
+    const size_t side = NumChannels == 2 ? 3 : size_t(-1);
+    for(size_t c = 0; c != candidates; ++c)
+        analyze(&s.signal[c][0], count, bps + (c == side), s, s.best[c]);
+
+    /* Stereo: nejkratší z dvojic levý/pravý, levý/rozdíl, rozdíl/pravý, střed/rozdíl */
+    unsigned int assignment = NumChannels - 1;
+    size_t used[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    if(NumChannels == 2)
+    {
+        const uint64_t costs[4] = {s.best[0].bits + s.best[1].bits, s.best[0].bits + s.best[3].bits,
+                                   s.best[3].bits + s.best[1].bits, s.best[2].bits + s.best[3].bits};
+        const size_t pairs[4][2] = {{0, 1}, {0, 3}, {3, 1}, {2, 3}};
+        size_t choice = std::min_element(costs, costs + 4) - costs;
+        assignment = choice == 0 ? 1 : 7 + choice;
+        used[0] = pairs[choice][0];
+        used[1] = pairs[choice][1];
+    }
+
+    /* Hlavička rámce: pevná velikost bloku, frekvence z STREAMINFO, číslo rámce v UTF-8 */
+    out.clear();
+    BitWriter w(out);
+    w.write(0xFFF8, 16);
+    w.write(count == BlockSize ? 12 : 7, 4);
+    w.write(0, 4);
+    w.write(assignment, 4);
+    w.write(bps == 8 ? 1 : 4, 3);
+    w.write(0, 1);
+    if(number < 0x80)
+        w.write(uint32_t(number), 8);
+    else
+    {
+        int extra = 1;
+        while(extra < 5 && number >= (uint64_t(1) << (5 * extra + 6)))
+            ++extra;
+        w.write(((0xFF00u >> (extra + 1)) & 0xFF) | uint32_t(number >> (6 * extra)), 8);
+        for(int i = extra - 1; i >= 0; --i)
+            w.write(0x80 | ((number >> (6 * i)) & 0x3F), 8);
+    }
+    if(count != BlockSize)
+        w.write(count - 1, 16);
+    w.write(crc8(&out[0], out.size()), 8);
+
+    for(size_t ch = 0; ch != NumChannels; ++ch)
+    {
+        const Subframe &sub = s.best[used[ch]];
+        const int32_t *x = &s.signal[used[ch]][0];
+        const int channelBps = bps + (used[ch] == side);
+        switch(sub.type)
+        {
+        case 0:
+            w.write(0, 8);
+            w.writeSigned(x[0], channelBps);
+            continue;
+        case 1:
+            w.write(1 << 1, 8);
+            for(size_t i = 0; i != count; ++i)
+                w.writeSigned(x[i], channelBps);
+            continue;
+        case 2:
+            w.write((8 | sub.order) << 1, 8);
+            for(size_t i = 0; i != sub.order; ++i)
+                w.writeSigned(x[i], channelBps);
+            break;
+        default:
+            w.write((32 | (sub.order - 1)) << 1, 8);
+            for(size_t i = 0; i != sub.order; ++i)
+                w.writeSigned(x[i], channelBps);
+            w.write(sub.precision - 1, 4);
+            w.writeSigned(sub.shift, 5);
+            for(size_t j = 0; j != sub.order; ++j)
+                w.writeSigned(sub.coefs[j], sub.precision);
+            break;
+        }
+
+        /* Zbytky: Riceův kód se 4bitovými parametry, parametr pro každý oddíl */
+        w.write(0, 2);
+        w.write(sub.partitionOrder, 4);
+        size_t partitions = size_t(1) << sub.partitionOrder;
+        size_t size = count >> sub.partitionOrder;
+        const int *parameters = &sub.parameters[levelOffset(sub.partitionOrder)];
+        for(size_t part = 0; part != partitions; ++part)
+        {
+            w.write(parameters[part], 4);
+            for(size_t i = part == 0 ? sub.order : part * size; i != (part + 1) * size; ++i)
+                w.writeRice(sub.residual[i], parameters[part]);
+        }
+    }
+    w.align();
+    w.write(crc16(&out[0], out.size()), 16);
+}
+
+bool FlacDecoder::isFlac(const char *filename)
+{
+    std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+    char magic[4];
+    return in.read(magic, 4) && std::memcmp(magic, "fLaC", 4) == 0;
+}
+
+bool FlacDecoder::isFlacName(const std::string &filename)
+{
+    if(filename.size() < 5)
+        return false;
+    std::string extension = filename.substr(filename.size() - 5);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".flac";
+}
+
+bool FlacDecoder::open(const char *filename)
+{
+    std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+    if(!in.is_open())
+        return false;
+    in.seekg(0, std::ios::end);
+    size_t size = size_t(in.tellg());
+    in.seekg(0);
+    /* Čtení bitů smí přesáhnout konec o 8 Bajtů */
+    file.assign(size + 8, 0);
+    if(size < 4 || !in.read(reinterpret_cast<char*>(&file[0]), size) || std::memcmp(&file[0], "fLaC", 4) != 0)
+    {
+        std::cerr << "ERROR: Neplatny FLAC soubor." << std::endl;
+        return false;
+    }
+
+    /* Metadata bloky, potřeba je jen STREAMINFO */
+    bool streamInfo = false;
+    size_t pos = 4;
+    for(bool last = false; !last; )
+    {
+        if(pos + 4 > size)
+        {
+            std::cerr << "ERROR: Neplatny FLAC soubor." << std::endl;
+            return false;
+        }
+        last = (file[pos] & 0x80) != 0;
+        int type = file[pos] & 0x7F;
+        size_t length = (size_t(file[pos+1]) << 16) | (size_t(file[pos+2]) << 8) | file[pos+3];
+        pos += 4;
+        if(type == 0 && length >= 34 && pos + length <= size)
+        {
+            BitReader r(&file[0], size, pos + 10);
+            SampleRate = r.read(20);
+            NumChannels = r.read(3) + 1;
+            BitsPerSample = r.read(5) + 1;
+            samples = uint64_t(r.read(4)) << 32;
+            samples |= r.read(32);
+            streamInfo = true;
+        }
+        pos += length;
+    }
+
+    if(!streamInfo || pos > size)
+    {
+        std::cerr << "ERROR: Neplatny FLAC soubor." << std::endl;
+        return false;
+    }
+    if(BitsPerSample != 8 && BitsPerSample != 16)
+    {
+        std::cerr << "ERROR: FLAC s " << BitsPerSample << " bity na sampl neni podporovany." << std::endl;
+        return false;
+    }
+    if(samples == 0)
+    {
+        std::cerr << "ERROR: FLAC bez celkoveho poctu samplu neni podporovany." << std::endl;
+        return false;
+    }
+    audio = pos;
+    return true;
+}
+
+bool FlacDecoder::decode(char *out)
+{
+    size_t pos = audio;
+    uint64_t done = 0;
+    while(done < samples)
+        if(!decodeFrame(pos, out, done))
+        {
+            std::cerr << "ERROR: Poskozeny FLAC ramec na pozici " << pos << "." << std::endl;
+            return false;
+        }
+    return true;
+}
+
+bool FlacDecoder::decodeFrame(size_t &pos, char *out, uint64_t &done)
+{
+    const size_t size = file.size() - 8;
+    if(pos + 2 > size)
+        return false;
+    BitReader r(&file[0], size, pos);
+    if(r.read(14) != 0x3FFE || r.read(1) != 0)
+        return false;
+    r.read(1);
+    uint32_t blockCode = r.read(4);
+    uint32_t rateCode = r.read(4);
+    uint32_t assignment = r.read(4);
+    uint32_t sizeCode = r.read(3);
+    if(r.read(1) != 0 || blockCode == 0 || rateCode == 15 || assignment > 10 || sizeCode == 3)
+        return false;
+
+    /* Číslo rámce nebo samplu v UTF-8, hodnota se nepotřebuje */
+    uint32_t first = r.read(8);
+    int extra = 0;
+    while(extra < 8 && (first & (0x80 >> extra)))
+        ++extra;
+    if(extra == 1 || extra == 8)
+        return false;
+    for(int i = 1; i < extra; ++i)
+        if((r.read(8) & 0xC0) != 0x80)
+            return false;
+
+    size_t blockSize;
+    if(blockCode == 1)
+        blockSize = 192;
+    else if(blockCode <= 5)
+        blockSize = size_t(576) << (blockCode - 2);
+    else if(blockCode == 6)
+        blockSize = r.read(8) + 1;
+    else if(blockCode == 7)
+        blockSize = r.read(16) + 1;
+    else
+        blockSize = size_t(256) << (blockCode - 8);
+    if(rateCode == 12)
+        r.read(8);
+    else if(rateCode == 13 || rateCode == 14)
+        r.read(16);
+    const size_t sizes[8] = {BitsPerSample, 8, 12, 0, 16, 20, 24, 32};
+    if(sizes[sizeCode] != BitsPerSample)
+        return false;
+    size_t headerEnd = r.byte();
+    if(r.read(8) != crc8(&file[pos], headerEnd - pos))
+        return false;
+
+    size_t channelCount = assignment < 8 ? assignment + 1 : 2;
+    if(channelCount != NumChannels || blockSize > samples - done)
+        return false;
+
+    for(size_t ch = 0; ch != channelCount; ++ch)
+    {
+        int bps = int(BitsPerSample);
+        if((assignment == 8 && ch == 1) || (assignment == 9 && ch == 0) || (assignment == 10 && ch == 1))
+            ++bps;
+        std::vector<int32_t> &x = channels[ch];
+        x.resize(blockSize);
+
+        if(r.read(1) != 0)
+            return false;
+        uint32_t type = r.read(6);
+        int wasted = 0;
+        if(r.read(1))
+        {
+            wasted = int(r.readUnary()) + 1;
+            bps -= wasted;
+            if(bps <= 0)
+                return false;
+        }
+
+        size_t order = 0;
+        int shift = 0;
+        int32_t coefs[32];
+        if(type == 0)
+            std::fill(x.begin(), x.end(), r.readSigned(bps));
+        else if(type == 1)
+            for(size_t i = 0; i != blockSize; ++i)
+                x[i] = r.readSigned(bps);
+        else if((type >= 8 && type <= 12) || type >= 32)
+        {
+            order = type >= 32 ? type - 31 : type - 8;
+            if(order > blockSize)
+                return false;
+            for(size_t i = 0; i != order; ++i)
+                x[i] = r.readSigned(bps);
+            if(type >= 32)
+            {
+                int precision = int(r.read(4)) + 1;
+                shift = r.readSigned(5);
+                if(precision == 16 || shift < 0)
+                    return false;
+                for(size_t j = 0; j != order; ++j)
+                    coefs[j] = r.readSigned(precision);
+            }
+
+            /* Zbytky predikce */
+            uint32_t method = r.read(2);
+            if(method > 1)
+                return false;
+            const unsigned int parameterBits = method == 0 ? 4 : 5;
+            const uint32_t escape = method == 0 ? RiceEscape : 31;
+            size_t partitionOrder = r.read(4);
+            size_t partitions = size_t(1) << partitionOrder;
+            size_t partitionSize = blockSize >> partitionOrder;
+            if(partitionSize << partitionOrder != blockSize || partitionSize < order)
+                return false;
+            for(size_t part = 0; part != partitions; ++part)
+            {
+                uint32_t parameter = r.read(parameterBits);
+                size_t from = part == 0 ? order : part * partitionSize;
+                size_t to = (part + 1) * partitionSize;
+                if(parameter == escape)
+                {
+                    unsigned int raw = r.read(5);
+                    for(size_t i = from; i != to; ++i)
+                        x[i] = r.readSigned(raw);
+                }
+                else
+                    for(size_t i = from; i != to; ++i)
+                    {
+                        uint32_t u = r.readUnary() << parameter;
+                        u |= r.read(parameter);
+                        x[i] = int32_t(u >> 1) ^ -int32_t(u & 1);
+                    }
+                if(r.overrun())
+                    return false;
+            }
+
+            /* Obnova samplů z predikce, zbytky se přepisují na místě */
+            if(type >= 32)
+                for(size_t i = order; i != blockSize; ++i)
+                {
+                    int64_t sum = 0;
+                    for(size_t j = 0; j != order; ++j)
+                        sum += int64_t(coefs[j]) * x[i - 1 - j];
+                    x[i] += int32_t(sum >> shift);
+                }
+            else
+                for(size_t i = order; i != blockSize; ++i)
+                    switch(order)
+                    {
+                    case 1: x[i] += x[i-1]; break;
+                    case 2: x[i] += 2 * x[i-1] - x[i-2]; break;
+                    case 3: x[i] += 3 * x[i-1] - 3 * x[i-2] + x[i-3]; break;
+                    case 4: x[i] += 4 * x[i-1] - 6 * x[i-2] + 4 * x[i-3] - x[i-4]; break;
+                    default: break;
+                    }
+        }
+        else
+            return false;
+
+        if(wasted)
+            for(size_t i = 0; i != blockSize; ++i)
+                x[i] = int32_t(uint32_t(x[i]) << wasted);
+    }
+    r.align();
+    size_t frameEnd = r.byte();
+    if(r.overrun() || frameEnd + 2 > size || r.read(16) != crc16(&file[pos], frameEnd - pos))
+        return false;
+
+    /* Zpětná dekorelace sterea */
+    if(assignment == 8)
+        for(size_t i = 0; i != blockSize; ++i)
+            channels[1][i] = channels[0][i] - channels[1][i];
+    else if(assignment == 9)
+        for(size_t i = 0; i != blockSize; ++i)
+            channels[0][i] += channels[1][i];
+    else if(assignment == 10)
+        for(size_t i = 0; i != blockSize; ++i)
+        {
+            int32_t side = channels[1][i];
+            int32_t mid = int32_t(uint32_t(channels[0][i]) << 1) | (side & 1);
+            channels[0][i] = (mid + side) >> 1;
+            channels[1][i] = (mid - side) >> 1;
+        }
+
+    /* Zápis do raw dat ve formátu WAV */
+    unsigned char *p = reinterpret_cast<unsigned char*>(out) + done * channelCount * (BitsPerSample / 8);
+    for(size_t i = 0; i != blockSize; ++i)
+        for(size_t ch = 0; ch != channelCount; ++ch)
+        {
+            int32_t v = channels[ch][i];
+            if(BitsPerSample == 16)
+            {
+                *p++ = (unsigned char)(v & 0xFF);
+                *p++ = (unsigned char)((v >> 8) & 0xFF);
+            }
+            else
+                *p++ = (unsigned char)(v + 128);
+        }
+    done += blockSize;
+    pos = frameEnd + 2;
+    return true;
+}
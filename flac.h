@@ -0,0 +1,169 @@
+﻿#ifndef FLAC_H
+#define FLAC_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Bezeztrátová komprese FLAC pro 8 a 16bitové PCM.
+ *
+ * Kodér dělí data na rámce po BlockSize samplech. Každý kanál rámce se zakóduje jako konstanta,
+ * pevný prediktor (řád 0 až 4) nebo LPC prediktor (řád do MaxLpcOrder, koeficienty z autokorelace
+ * přes Levinson-Durbin), podle toho, co vyjde kratší. Zbytky predikce se kódují Riceovým kódem
+ * s parametrem pro každý oddíl rámce. Stereo zkouší i kombinace levý/pravý/střed/rozdíl.
+ * Rámce jsou na sobě nezávislé, volající je tedy může kódovat paralelně.
+ *
+ * MD5 nezakódovaných dat ani velikosti rámců se do STREAMINFO nezapisují (nuly znamenají neznámé),
+ * hlavička se tak dá zapsat na začátek souboru ještě před kódováním.
+ */
+class FlacEncoder
+{
+public:
+    static const size_t BlockSize = 4096;   /**< Počet samplů v kanálu v jednom rámci. */
+    static const size_t MaxLpcOrder = 8;    /**< Nejvyšší řád LPC prediktoru. */
+
+    /**
+     * @brief               Konstruktor.
+     * @param NumChannels   Počet kanálů, 1 až 8.
+     * @param BitsPerSample Velikost samplu v bitech, 8 nebo 16.
+     * @param SampleRate    Vzorkovací frekvence.
+     * @param samples       Celkový počet samplů v kanálu.
+     * @param workers       Počet vláken, která mohou kódovat rámce současně.
+     */
+    FlacEncoder(size_t NumChannels, size_t BitsPerSample, size_t SampleRate, uint64_t samples, size_t workers);
+
+    /**
+     * @brief   Zjistí, jestli formát lze zakódovat.
+     */
+    bool supported() const;
+
+    /**
+     * @brief           Vytvoří začátek souboru: značku fLaC a blok STREAMINFO.
+     * @param[out] out  Výstupní Bajty.
+     */
+    void header(std::vector<unsigned char> &out) const;
+
+    /**
+     * @brief           Zakóduje jeden rámec.
+     * @param pcm       Raw data rámce ve formátu WAV (prokládané kanály, little endian, 8 bitů bez znaménka).
+     * @param count     Počet samplů v kanálu, nejvýš BlockSize, menší jen u posledního rámce.
+     * @param number    Pořadové číslo rámce.
+     * @param worker    Index vlákna, určuje pomocné buffery.
+     * @param[out] out  Zakódovaný rámec, přepíše se.
+     */
+    void encodeFrame(const char *pcm, size_t count, uint64_t number, size_t worker, std::vector<unsigned char> &out);
+
+private:
+    /**
+     * @brief Zvolený způsob zakódování jednoho kanálu rámce.
+     */
+    struct Subframe
+    {
+        int type;                           /**< 0 konstanta, 1 verbatim, 2 pevný prediktor, 3 LPC. */
+        size_t order;                       /**< Řád prediktoru. */
+        int precision;                      /**< Přesnost LPC koeficientů v bitech. */
+        int shift;                          /**< Posun LPC predikce. */
+        int32_t coefs[MaxLpcOrder];         /**< Kvantované LPC koeficienty. */
+        size_t partitionOrder;              /**< Řád dělení zbytků na oddíly. */
+        std::vector<int> parameters;        /**< Riceův parametr každého oddílu. */
+        std::vector<int32_t> residual;      /**< Zbytky predikce, prvních order položek se nepoužije. */
+        uint64_t bits;                      /**< Velikost zakódovaného kanálu v bitech. */
+    };
+
+    /**
+     * @brief Pomocné buffery jednoho vlákna.
+     */
+    struct Scratch
+    {
+        std::vector<std::vector<int32_t> > signal;  /**< Kanály rámce, u sterea levý, pravý, střed, rozdíl. */
+        std::vector<Subframe> best;                 /**< Nejlepší zakódování každého kanálu. */
+        Subframe candidate;                 /**< Právě zkoušené zakódování. */
+        std::vector<double> windowed;       /**< Signál vynásobený oknem pro autokorelaci. */
+        std::vector<uint64_t> sums;         /**< Součty zbytků v nejjemnějších oddílech. */
+    };
+
+    /**
+     * @brief               Najde nejkratší zakódování kanálu.
+     * @param x             Samply kanálu.
+     * @param count         Počet samplů.
+     * @param bps           Počet bitů na sampl (rozdíl sterea má o jeden víc).
+     * @param scratch       Pomocné buffery.
+     * @param[out] best     Nejlepší zakódování.
+     */
+    void analyze(const int32_t *x, size_t count, int bps, Scratch &scratch, Subframe &best) const;
+
+    /**
+     * @brief               Zvolí dělení zbytků na oddíly a Riceovy parametry.
+     * @param sub           Zakódování se spočítanými zbytky, doplní se dělení, parametry a velikost.
+     * @param count         Počet samplů.
+     * @param sums          Pomocný buffer.
+     * @return              Vrací velikost zbytků v bitech.
+     */
+    uint64_t chooseRice(Subframe &sub, size_t count, std::vector<uint64_t> &sums) const;
+
+    size_t NumChannels;             /**< Počet kanálů. */
+    size_t BitsPerSample;           /**< Bity na sampl. */
+    size_t SampleRate;              /**< Vzorkovací frekvence. */
+    uint64_t samples;               /**< Celkový počet samplů v kanálu. */
+    std::vector<double> window;     /**< Tukeyho okno pro autokorelaci celého rámce. */
+    std::vector<Scratch> scratch;   /**< Pomocné buffery pro každé vlákno. */
+};
+
+/**
+ * @brief Dekodér FLAC souborů s 8 nebo 16 bity na sampl.
+ *
+ * Podporuje všechny typy kanálů (konstanta, verbatim, pevný prediktor, LPC), oba Riceovy
+ * kódy včetně escape oddílů, nevyužité bity i pevnou a proměnnou velikost rámců.
+ * Soubor se načte celý do paměti a rámce se dekódují postupně.
+ */
+class FlacDecoder
+{
+public:
+    /**
+     * @brief           Načte soubor a přečte STREAMINFO.
+     * @param filename  Jméno souboru.
+     * @return          Vrací false, pokud soubor není FLAC nebo má nepodporovaný formát.
+     */
+    bool open(const char *filename);
+
+    /**
+     * @brief           Dekóduje všechny rámce do raw dat ve formátu WAV.
+     * @param[out] out  Buffer o velikosti samples * NumChannels * BitsPerSample / 8.
+     * @return          Vrací false při poškozeném rámci.
+     */
+    bool decode(char *out);
+
+    /**
+     * @brief           Zjistí, jestli soubor začíná značkou fLaC.
+     * @param filename  Jméno souboru.
+     */
+    static bool isFlac(const char *filename);
+
+    /**
+     * @brief           Zjistí, jestli jméno souboru končí příponou .flac.
+     * @param filename  Jméno souboru.
+     */
+    static bool isFlacName(const std::string &filename);
+
+    size_t NumChannels;     /**< Počet kanálů. */
+    size_t BitsPerSample;   /**< Bity na sampl. */
+    size_t SampleRate;      /**< Vzorkovací frekvence. */
+    uint64_t samples;       /**< Celkový počet samplů v kanálu. */
+
+private:
+    /**
+     * @brief               Dekóduje jeden rámec.
+     * @param[in,out] pos   Pozice rámce v souboru, posune se za rámec.
+     * @param out           Raw data celého souboru.
+     * @param[in,out] done  Počet už dekódovaných samplů v kanálu.
+     * @return              Vrací false při chybě.
+     */
+    bool decodeFrame(size_t &pos, char *out, uint64_t &done);
+
+    std::vector<unsigned char> file;    /**< Celý soubor. */
+    size_t audio;                       /**< Pozice prvního rámce. */
+    std::vector<int32_t> channels[8];   /**< Dekódované kanály rámce. */
+};
+
+#endif // FLAC_H
@@ -0,0 +1,192 @@
+﻿#include "gain.h"
+#include "wave.h"
+#include "async_io.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ZAPOCTAK_GAIN_SSE2
+#endif
+
+namespace
+{
+    /* Velikost bloku celých samplů pro process() a applyData() */
+    size_t stepFor(size_t SizeOfSample)
+    {
+        return std::max<size_t>(SizeOfSample, AsyncIO::options.chunkSize / SizeOfSample * SizeOfSample);
+    }
+}
+
+Gain::Gain(unsigned int percent, bool dither) : gain(percent / 100.), dither(dither)
+{
+    /* Co nejvíc desetinných bitů tak, aby se zesílení vešlo do 16 bitů se znaménkem */
+    shift = 15;
+    while(shift > 0 && std::floor(gain * (1 << shift) + .5) > 32767)
+        --shift;
+    factor = int32_t(std::min(std::floor(gain * (1 << shift) + .5), 32767.));
+
+    state[0] = 0x9e3779b9u;
+    state[1] = 0x7f4a7c15u;
+    state[2] = 0x85ebca6bu;
+    state[3] = 0xc2b2ae35u;
+
+    for(int x = 0; x != 256; ++x)
+    {
+        double v = std::floor((x - 128) * gain + .5) + 128;
+        table[x] = static_cast<unsigned char>(v > 255 ? 255 : (v < 0 ? 0 : v));
+    }
+}
+
+uint32_t Gain::random()
+{
+    uint32_t &x = state[0];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+void Gain::apply(char *data, size_t bytes, size_t sizeOfSample)
+{
+    if(sizeOfSample == 1)
+        apply8(reinterpret_cast<unsigned char*>(data), bytes);
+    else if(sizeOfSample == 2)
+        apply16(reinterpret_cast<short*>(data), bytes / 2);
+    else
+        std::cerr << "ERROR: Nepodporovana velikost samplu." << std::endl;
+}
+
+void Gain::applyData(char *data, uint64_t length, size_t sizeOfSample)
+{
+    size_t step = stepFor(sizeOfSample);
+    uint64_t samplesBytes = length / sizeOfSample * sizeOfSample;
+    for(uint64_t done = 0; done < samplesBytes; done += step)
+        apply(data + done, size_t(std::min<uint64_t>(step, samplesBytes - done)), sizeOfSample);
+}
+
+void Gain::apply8(unsigned char *data, size_t count)
+{
+    if(!dither)
+    {
+        for(size_t i = 0; i != count; ++i)
+            data[i] = table[data[i]];
+        return;
+    }
+    /* TPDF dither: součet dvou rovnoměrných šumů v rozsahu [0,1) LSB minus 1 */
+    for(size_t i = 0; i != count; ++i)
+    {
+        double noise = (random() >> 8) / 16777216. + (random() >> 8) / 16777216. - 1;
+        double v = std::floor((data[i] - 128) * gain + noise + .5) + 128;
+        data[i] = static_cast<unsigned char>(v > 255 ? 255 : (v < 0 ? 0 : v));
+    }
+}
+
+void Gain::apply16(short *data, size_t count)
+{
+    const int32_t round = shift ? 1 << (shift - 1) : 0;
+    const int32_t offset = dither ? -(1 << shift) : 0;
+    size_t i = 0;
+#ifdef ZAPOCTAK_GAIN_SSE2
+    const __m128i f = _mm_set1_epi16(short(factor));
+    const __m128i r = _mm_set1_epi32(round + offset);
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    const __m128i d = _mm_cvtsi32_si128(32 - shift);
+    __m128i st = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        /* Součiny 16 x 16 bitů do 32 bitů ze spodní a horní poloviny */
+        __m128i lo = _mm_mullo_epi16(x, f);
+        __m128i hi = _mm_mulhi_epi16(x, f);
+        __m128i a = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi), r);
+        __m128i b = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi), r);
+        if(dither)
+        {
+            /* Čtyři dráhy xorshift32, každý sampl dostane součet dvou čísel z [0, 2^shift) */
+            __m128i n[4];
+            for(int k = 0; k != 4; ++k)
+            {
+                st = _mm_xor_si128(st, _mm_slli_epi32(st, 13));
+                st = _mm_xor_si128(st, _mm_srli_epi32(st, 17));
+                st = _mm_xor_si128(st, _mm_slli_epi32(st, 5));
+                n[k] = _mm_srl_epi32(st, d);
+            }
+            a = _mm_add_epi32(a, _mm_add_epi32(n[0], n[1]));
+            b = _mm_add_epi32(b, _mm_add_epi32(n[2], n[3]));
+        }
+        /* Posun zpět a sbalení do 16 bitů se saturací */
+        a = _mm_sra_epi32(a, s);
+        b = _mm_sra_epi32(b, s);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_packs_epi32(a, b));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), st);
+#endif
+    for(; i != count; ++i)
+    {
+        int32_t v = int32_t(data[i]) * factor + round;
+        if(dither)
+            v += shift ? offset + int32_t(random() >> (32 - shift)) + int32_t(random() >> (32 - shift)) : 0;
+        v >>= shift;
+        data[i] = short(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+    }
+}
+
+bool Gain::process(const char *input, const char *output, unsigned int percent, bool dither)
+{
+    std::ifstream in(input, std::ios_base::in | std::ios_base::binary);
+    Wave::RiffChunk rch;
+    Wave::FmtChunk fch;
+    Wave::DataChunkHeader dchh;
+    if(!in.is_open() || !Wave::readHeaders(in,rch,fch,dchh))
+        return false;
+    size_t SizeOfSample = fch.BitsPerSample / 8;
+    if(SizeOfSample < 1 || SizeOfSample > 2)
+    {
+        std::cerr << "ERROR: Nepodporovana velikost samplu." << std::endl;
+        return false;
+    }
+
+    /* Délka podle data chunku, ale nejvýš do konce souboru */
+    std::streamoff begin = in.tellg();
+    in.seekg(0, std::ios::end);
+    uint64_t available = uint64_t(in.tellg() - begin);
+    in.seekg(begin);
+    if(available < dchh.length)
+    {
+        rch.length -= dchh.length - uint32_t(available);
+        dchh.length = uint32_t(available);
+    }
+
+    AsyncWriter out(output);
+    out.write(reinterpret_cast<char*>(&rch),sizeof(rch));
+    out.write(reinterpret_cast<char*>(&fch),sizeof(fch));
+    out.write(reinterpret_cast<char*>(&dchh),sizeof(dchh));
+
+    /* Bloky celých samplů, zbytek za posledním celým samplem se jen zkopíruje */
+    Gain engine(percent, dither);
+    size_t step = stepFor(SizeOfSample);
+    std::vector<char> buffer(step);
+    uint64_t samplesBytes = dchh.length / SizeOfSample * SizeOfSample;
+    for(uint64_t done = 0; done < dchh.length; )
+    {
+        size_t n = size_t(std::min<uint64_t>(step, dchh.length - done));
+        if(!in.read(&buffer[0], n))
+        {
+            std::cerr << "ERROR: Reading data." << std::endl;
+            return false;
+        }
+        engine.apply(&buffer[0], size_t(std::min<uint64_t>(n, samplesBytes - std::min(samplesBytes, done))), SizeOfSample);
+        out.write(&buffer[0], n);
+        done += n;
+    }
+    if(!out.finish())
+    {
+        std::cerr << "ERROR: Zapis do souboru selhal." << std::endl;
+        return false;
+    }
+    return true;
+}
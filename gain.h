@@ -0,0 +1,72 @@
+﻿#ifndef GAIN_H
+#define GAIN_H
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Změna hlasitosti přímo na PCM datech.
+ *
+ * Když se mění jen hlasitost, není potřeba data parsovat do komplexních čísel a zpět.
+ * Zesílení se převede na celé číslo s pevnou řádovou čárkou a každý sampl se jím vynásobí
+ * v celých číslech, zaokrouhlí a ořízne do rozsahu formátu. 16bitové samply se násobí
+ * po osmi v SSE2, 8bitové přes předpočítanou tabulku. Volitelně se před zaokrouhlením
+ * přičte trojúhelníkový (TPDF) dither o velikosti ±1 LSB.
+ */
+class Gain
+{
+public:
+    /**
+     * @brief           Konstruktor.
+     * @param percent   Zesílení v procentech.
+     * @param dither    Jestli se má přidávat dither.
+     */
+    Gain(unsigned int percent, bool dither);
+
+    /**
+     * @brief               Změní hlasitost bloku raw dat.
+     * @param data          Raw data, celé samply.
+     * @param bytes         Velikost dat v Bajtech, musí být násobkem sizeOfSample.
+     * @param sizeOfSample  Velikost samplu v Bajtech, 1 nebo 2.
+     *
+     * Stav ditheru se mezi voláními zachovává, data lze tedy zpracovávat postupně po blocích.
+     */
+    void apply(char *data, size_t bytes, size_t sizeOfSample);
+
+    /**
+     * @brief               Změní hlasitost raw dat celého souboru po stejných blocích jako process().
+     * @param data          Raw data.
+     * @param length        Délka dat v Bajtech, data za posledním celým samplem se nezmění.
+     * @param sizeOfSample  Velikost samplu v Bajtech, 1 nebo 2.
+     *
+     * Dither tak dá stejný výsledek jako process() nad stejným souborem.
+     */
+    void applyData(char *data, uint64_t length, size_t sizeOfSample);
+
+    /**
+     * @brief           Změní hlasitost WAV souboru a uloží ho, data se čtou a zapisují po blocích.
+     * @param input     Vstupní WAV soubor.
+     * @param output    Výstupní WAV soubor.
+     * @param percent   Zesílení v procentech.
+     * @param dither    Jestli se má přidávat dither.
+     * @return          Vrací, jestli nenastala chyba.
+     */
+    static bool process(const char *input, const char *output, unsigned int percent, bool dither);
+
+private:
+    void apply8(unsigned char *data, size_t count);
+    void apply16(short *data, size_t count);
+
+    /**
+     * @brief   Další náhodné číslo (xorshift32) pro skalární dither.
+     */
+    uint32_t random();
+
+    int32_t factor;             /**< Zesílení v pevné řádové čárce, factor / 2^shift. */
+    int shift;                  /**< Počet desetinných bitů zesílení. */
+    double gain;                /**< Zesílení jako reálné číslo. */
+    bool dither;                /**< Jestli se přidává dither. */
+    uint32_t state[4];          /**< Stav generátoru pro dither, čtyři dráhy pro SSE2. */
+    unsigned char table[256];   /**< Výsledky pro 8bitové samply bez ditheru. */
+};
+
+#endif // GAIN_H
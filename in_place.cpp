@@ -0,0 +1,179 @@
+﻿#include "in_place.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char Magic[4] = { 'Z', 'J', 'R', 'N' };
+    const uint32_t Version = 1;
+}
+
+InPlaceWriter::InPlaceWriter(const std::string &filename) : filename(filename), journal(0), dirty(0), total(0) {}
+
+InPlaceWriter::~InPlaceWriter()
+{
+    if(journal)
+        fclose(journal);
+}
+
+std::string InPlaceWriter::journalName(const std::string &filename)
+{
+    return filename + ".journal";
+}
+
+bool InPlaceWriter::open()
+{
+    if(!file.open(filename, true))
+    {
+        std::cerr << "ERROR: Nelze namapovat soubor pro zapis: " << filename << std::endl;
+        return false;
+    }
+    journal = fopen(journalName(filename).c_str(), "wb");
+    if(!journal)
+    {
+        std::cerr << "ERROR: Nelze vytvorit journal: " << journalName(filename) << std::endl;
+        return false;
+    }
+    uint64_t size = file.size();
+    fwrite(Magic, 1, sizeof(Magic), journal);
+    fwrite(&Version, sizeof(Version), 1, journal);
+    fwrite(&size, sizeof(size), 1, journal);
+    return syncJournal();
+}
+
+bool InPlaceWriter::syncJournal()
+{
+    if(fflush(journal) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(journal)) == 0;
+#else
+    return fsync(fileno(journal)) == 0;
+#endif
+}
+
+bool InPlaceWriter::write(uint64_t offset, const char *data, size_t size)
+{
+    if(!file.isOpen() || !journal || offset + size > file.size())
+    {
+        std::cerr << "ERROR: Data se nevejdou do prepisovaneho souboru." << std::endl;
+        return false;
+    }
+    total += size;
+
+    /* Změněné bloky (zarovnané na pozici v souboru), sousední se spojí do jednoho úseku */
+    std::vector<std::pair<uint64_t,size_t> > ranges;
+    for(uint64_t pos = offset; pos < offset + size; )
+    {
+        uint64_t end = std::min<uint64_t>((pos / BlockSize + 1) * BlockSize, offset + size);
+        if(memcmp(file.data() + pos, data + (pos - offset), size_t(end - pos)) != 0)
+        {
+            if(!ranges.empty() && ranges.back().first + ranges.back().second == pos)
+                ranges.back().second += size_t(end - pos);
+            else
+                ranges.push_back(std::make_pair(pos, size_t(end - pos)));
+        }
+        pos = end;
+    }
+    if(ranges.empty())
+        return true;
+
+    /* Nejdřív původní obsah do journalu a na disk, teprve pak přepis */
+    for(size_t i = 0; i != ranges.size(); ++i)
+    {
+        uint32_t length = uint32_t(ranges[i].second);
+        fwrite(&ranges[i].first, sizeof(uint64_t), 1, journal);
+        fwrite(&length, sizeof(length), 1, journal);
+        fwrite(file.data() + ranges[i].first, 1, length, journal);
+    }
+    if(!syncJournal())
+    {
+        std::cerr << "ERROR: Zapis journalu selhal." << std::endl;
+        return false;
+    }
+    for(size_t i = 0; i != ranges.size(); ++i)
+    {
+        memcpy(file.data() + ranges[i].first, data + (ranges[i].first - offset), ranges[i].second);
+        dirty += ranges[i].second;
+    }
+    return true;
+}
+
+bool InPlaceWriter::commit()
+{
+    if(!file.isOpen() || !journal)
+        return false;
+    if(!file.flush())
+    {
+        std::cerr << "ERROR: Zapis zmen na disk selhal, journal zustava: " << journalName(filename) << std::endl;
+        return false;
+    }
+    file.close();
+    fclose(journal);
+    journal = 0;
+    remove(journalName(filename).c_str());
+    return true;
+}
+
+bool InPlaceWriter::rollback(const std::string &filename)
+{
+    std::string name = journalName(filename);
+    FILE *in = fopen(name.c_str(), "rb");
+    if(!in)
+        return true;
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t size = 0;
+    MappedFile file;
+    bool ok = fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, Magic, sizeof(Magic)) == 0
+              && fread(&version, sizeof(version), 1, in) == 1 && version == Version
+              && fread(&size, sizeof(size), 1, in) == 1;
+    /* Journal bez celé hlavičky vznikl před prvním přepisem, není co obnovovat */
+    if(!ok)
+    {
+        fclose(in);
+        remove(name.c_str());
+        return true;
+    }
+    if(!file.open(filename, true) || file.size() != size)
+    {
+        std::cerr << "ERROR: Soubor neodpovida journalu, neobnovuji: " << filename << std::endl;
+        fclose(in);
+        return false;
+    }
+
+    /* Obnova všech celých záznamů */
+    size_t restored = 0;
+    std::vector<char> buffer;
+    uint64_t offset;
+    uint32_t length;
+    while(fread(&offset, sizeof(offset), 1, in) == 1 && fread(&length, sizeof(length), 1, in) == 1)
+    {
+        if(offset + length > size)
+            break;
+        buffer.resize(length);
+        if(length && fread(&buffer[0], 1, length, in) != length)
+            break;
+        std::copy(buffer.begin(), buffer.end(), file.data() + offset);
+        ++restored;
+    }
+    fclose(in);
+    if(!file.flush())
+    {
+        std::cerr << "ERROR: Zapis obnovenych dat selhal." << std::endl;
+        return false;
+    }
+    file.close();
+    remove(name.c_str());
+    std::cerr << "Obnoveno " << restored << " useku z journalu: " << name << std::endl;
+    return true;
+}
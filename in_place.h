@@ -0,0 +1,99 @@
+﻿#ifndef IN_PLACE_H
+#define IN_PLACE_H
+#include "mapped_file.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Přepis souboru na místě s journalem pro obnovu.
+ *
+ * Soubor se namapuje pro zápis a nová data se porovnávají se stávajícími po blocích.
+ * Zapisují se jen bloky, které se změnily. Před přepsáním se původní obsah změněných
+ * bloků uloží do journalu (soubor s příponou .journal) a journal se synchronizuje na disk,
+ * teprve potom se bloky přepíšou. Po úspěšném dokončení se mapování zapíše na disk
+ * a journal se smaže. Pokud se běh přeruší, rollback() z journalu obnoví původní soubor.
+ *
+ * Formát journalu: "ZJRN", verze (uint32), velikost souboru (uint64) a pak záznamy
+ * pozice (uint64), délka (uint32) a původní data. Neúplný poslední záznam se ignoruje,
+ * jeho blok ještě nebyl přepsán.
+ */
+class InPlaceWriter
+{
+public:
+    /**
+     * @brief   Velikost bloku, po kterém se hledají změny.
+     */
+    static const size_t BlockSize = 4096;
+
+    /**
+     * @brief           Konstruktor.
+     * @param filename  Soubor, který se bude přepisovat.
+     */
+    explicit InPlaceWriter(const std::string &filename);
+
+    /**
+     * @brief   Destruktor, bez commit() journal zůstane na disku.
+     */
+    ~InPlaceWriter();
+
+    /**
+     * @brief   Namapuje soubor pro zápis a založí journal.
+     * @return  Vrací, jestli se to podařilo.
+     */
+    bool open();
+
+    /**
+     * @brief           Zapíše data na danou pozici, přepíšou se jen změněné bloky.
+     * @param offset    Pozice v souboru.
+     * @param data      Nová data.
+     * @param size      Velikost dat v Bajtech.
+     * @return          Vrací false, pokud data přesahují soubor nebo selhal zápis journalu.
+     */
+    bool write(uint64_t offset, const char *data, size_t size);
+
+    /**
+     * @brief   Zapíše změny na disk a smaže journal.
+     * @return  Vrací, jestli se to podařilo.
+     */
+    bool commit();
+
+    /**
+     * @brief   Počet přepsaných Bajtů.
+     */
+    uint64_t dirtyBytes() const { return dirty; }
+
+    /**
+     * @brief   Počet Bajtů, které prošly porovnáním.
+     */
+    uint64_t totalBytes() const { return total; }
+
+    /**
+     * @brief           Obnoví soubor z journalu přerušeného přepisu.
+     * @param filename  Přepisovaný soubor.
+     * @return          Vrací false, pokud journal existuje, ale obnova selhala. Bez journalu vrací true.
+     */
+    static bool rollback(const std::string &filename);
+
+    /**
+     * @brief           Jméno journalu pro daný soubor.
+     */
+    static std::string journalName(const std::string &filename);
+
+private:
+    InPlaceWriter(const InPlaceWriter&);
+    InPlaceWriter& operator=(const InPlaceWriter&);
+
+    /**
+     * @brief   Zapíše buffer journalu na disk a počká na dokončení.
+     */
+    bool syncJournal();
+
+    std::string filename;   /**< Přepisovaný soubor. */
+    MappedFile file;        /**< Namapovaný soubor. */
+    FILE *journal;          /**< Otevřený journal. */
+    uint64_t dirty;         /**< Počet přepsaných Bajtů. */
+    uint64_t total;         /**< Počet porovnaných Bajtů. */
+};
+
+#endif // IN_PLACE_H
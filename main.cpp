@@ -1,57 +1,679 @@
 ﻿#include "data_utility.h"
 #include "wave.h"
+#include "alloc_counter.h"
+#include "spectral_analysis.h"
+#include "result_cache.h"
+#include "spectrum_cache.h"
+#include "async_io.h"
+#include "mixer.h"
+#include "batch_fft.h"
+#include "in_place.h"
+#include "gain.h"
+#include "daemon.h"
+#include "denoise.h"
+#include "effect_graph.h"
+#include "thread_pool.h"
+#include "pipeline.h"
+#include "flac.h"
+#include "peak_index.h"
+#include "activity_map.h"
+#include "arena.h"
+#include "channel_matrix.h"
+#include "catalog.h"
+#include "wisdom.h"
+#include "checkpoint.h"
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
 using namespace std;
 
-int main(int argc, char **argv)
+/**
+ * @brief           Uloží výstup, formát se vybere podle přípony.
+ * @param wave      Wave k uložení.
+ * @param filename  Jméno výstupního souboru, s příponou .flac se uloží jako FLAC, jinak jako WAV.
+ * @return          Vrací false, pokud se výstup nepodařilo uložit.
+ */
+static bool saveOutput(Wave &wave, const string &filename)
 {
-    vector<string> params(argv, argv+argc);
+    if(FlacDecoder::isFlacName(filename))
+        return wave.saveToFlacFile(filename.data());
+    return wave.saveToWaveFile(filename.data());
+}
 
-    if(params.size() > 1)
+/**
+ * @brief   Testovací háček: při překladu s ZAPOCTAK_COUNT_ALLOCATIONS ověří,
+ *          že zpracování bloků po zahřátí nealokovalo na haldě.
+ * @return  Vrací návratový kód úspěšné úlohy, 2 pokud se v ustáleném stavu alokovalo.
+ */
+static int checkAllocations()
+{
+    if(AllocCounter::enabled())
     {
-        string input;
-        string output;
-        string preset;
-        int percentage = -1;
+        cerr << "Alokace v ustalenem stavu: " << AllocCounter::steadyStateAllocations() << endl;
+        if(AllocCounter::steadyStateAllocations() != 0)
+            return 2;
+    }
+    return 0;
+}
+
+/**
+ * @brief           Zpracuje jednu úlohu zadanou parametry příkazové řádky.
+ * @param params    Parametry včetně jména programu na indexu 0.
+ * @return          Vrací návratový kód programu.
+ */
+static int runJob(const vector<string> &params)
+{
+    string input;
+    string output;
+    string preset;
+    string analysis;
+    SpectralAnalysis::Options analysisOptions;
+    string cacheDir;
+    unsigned long long cacheSize = 1024;
+    string spectraFile;
+    Mixer mixer;
+    int percentage = -1;
+    double tempo = 100;
+    double semitones = 0;
+    double start = -1;
+    double end = -1;
+    bool inPlace = false;
+    bool rollback = false;
+    bool dither = false;
+    bool pipeline = false;
+    string denoise;
+    double noiseStart = 0;
+    double noiseEnd = 0;
+    Denoiser::Options denoiseOptions;
+    string chain;
+    string peaks;
+    string remix;
+    string catalog;
+    size_t probePeak = 0;
+    double silence = 0;
+    bool silenceSet = false;
+    string wisdomFile;
+    string autotune;
+    string rates = "44100,48000,96000";
+    bool lanesSet = false;
+    bool checkpointing = false;
+    bool resume = false;
+    vector<string> presets;
+    vector<string> outputs;
+
+    /* Globální nastavení se nastavuje pro každou úlohu zvlášť, démon jich zpracuje víc */
+    AsyncIO::options = AsyncIO::Options();
+    BatchFFT::maxLanes = BatchFFT::MaxLanes;
+    Arena::options = Arena::Options();
+    CFFT::tuning = CFFT::Tuning();
+    ThreadPool::instance().setActive(0);
 
-        for(size_t i = 1; i < params.size(); i+=2)
+    for(size_t i = 1; i < params.size(); i+=2)
+    {
+        /* Přepínače bez hodnoty posunou index jen o jedna */
+        if(params[i].compare("--direct-io") == 0)
+        {
+            AsyncIO::options.direct = true;
+            --i;
+        }
+        else if(params[i].compare("--in-place") == 0)
+        {
+            inPlace = true;
+            --i;
+        }
+        else if(params[i].compare("--rollback") == 0)
+        {
+            rollback = true;
+            --i;
+        }
+        else if(params[i].compare("--dither") == 0)
+        {
+            dither = true;
+            --i;
+        }
+        else if(params[i].compare("--pipeline") == 0)
+        {
+            pipeline = true;
+            --i;
+        }
+        else if(params[i].compare("--checkpoint") == 0)
         {
-            if(params[i].compare("-i") == 0 && i+1 < params.size())
+            checkpointing = true;
+            --i;
+        }
+        else if(params[i].compare("--resume") == 0)
+        {
+            checkpointing = true;
+            resume = true;
+            --i;
+        }
+        else if(params[i].compare("-i") == 0 && i+1 < params.size())
+        {
+            /* Opakované -i vstupy smíchá */
+            if(input.empty())
                 input = params[i+1];
-            else if(params[i].compare("-o") == 0 && i+1 < params.size())
-                output = params[i+1];
-            else if(params[i].compare("-e") == 0 && i+1 < params.size())
-                preset = params[i+1];
-            else if(params[i].compare("-v") == 0 && i+1 < params.size())
-                percentage = 1; //atoi(params[i+1].c_str());
-            else
-            {
-                cout << "Spatne nastavene parametry.";
-                return 1;
-            }
+            mixer.add(params[i+1]);
+        }
+        else if(params[i].compare("-g") == 0 && i+1 < params.size() && mixer.size())
+            mixer.setLastGain(atof(params[i+1].c_str()));
+        else if(params[i].compare("-o") == 0 && i+1 < params.size())
+        {
+            output = params[i+1];
+            outputs.push_back(output);
+        }
+        else if(params[i].compare("-e") == 0 && i+1 < params.size())
+        {
+            preset = params[i+1];
+            presets.push_back(preset);
+        }
+        else if(params[i].compare("-v") == 0 && i+1 < params.size() && atoi(params[i+1].c_str()) >= 0)
+            percentage = atoi(params[i+1].c_str());
+        else if(params[i].compare("--tempo") == 0 && i+1 < params.size() && atof(params[i+1].c_str()) > 0)
+            tempo = atof(params[i+1].c_str());
+        else if(params[i].compare("--pitch") == 0 && i+1 < params.size())
+            semitones = atof(params[i+1].c_str());
+        else if(params[i].compare("--start") == 0 && i+1 < params.size() && atof(params[i+1].c_str()) >= 0)
+            start = atof(params[i+1].c_str());
+        else if(params[i].compare("--end") == 0 && i+1 < params.size() && atof(params[i+1].c_str()) > 0)
+            end = atof(params[i+1].c_str());
+        else if(params[i].compare("--denoise") == 0 && i+1 < params.size()
+                && (params[i+1] == "auto"
+                    || (sscanf(params[i+1].c_str(),"%lf:%lf",&noiseStart,&noiseEnd) == 2 && noiseStart >= 0 && noiseEnd > noiseStart)))
+            denoise = params[i+1];
+        else if(params[i].compare("--denoise-reduce") == 0 && i+1 < params.size() && atof(params[i+1].c_str()) > 0)
+            denoiseOptions.reduction = atof(params[i+1].c_str());
+        else if(params[i].compare("--chain") == 0 && i+1 < params.size())
+            chain = params[i+1];
+        else if(params[i].compare("--peaks") == 0 && i+1 < params.size())
+            peaks = params[i+1];
+        else if(params[i].compare("--catalog") == 0 && i+1 < params.size())
+            catalog = params[i+1];
+        else if(params[i].compare("--probe-peak") == 0 && i+1 < params.size() && atoi(params[i+1].c_str()) >= 0)
+            probePeak = atoi(params[i+1].c_str());
+        else if(params[i].compare("--remix") == 0 && i+1 < params.size())
+            remix = params[i+1];
+        else if(params[i].compare("--huge-pages") == 0 && i+1 < params.size() && params[i+1] == "off")
+            Arena::options.hugePages = Arena::Off;
+        else if(params[i].compare("--huge-pages") == 0 && i+1 < params.size() && params[i+1] == "thp")
+            Arena::options.hugePages = Arena::Transparent;
+        else if(params[i].compare("--huge-pages") == 0 && i+1 < params.size() && params[i+1] == "explicit")
+            Arena::options.hugePages = Arena::Explicit;
+        else if(params[i].compare("--numa") == 0 && i+1 < params.size() && params[i+1] == "interleave")
+            Arena::options.interleave = true;
+        else if(params[i].compare("--numa") == 0 && i+1 < params.size() && !params[i+1].empty()
+                && strspn(params[i+1].c_str(),"0123456789") == params[i+1].size())
+            Arena::options.node = atoi(params[i+1].c_str());
+        else if(params[i].compare("--silence") == 0 && i+1 < params.size())
+        {
+            silence = atof(params[i+1].c_str());
+            silenceSet = true;
+        }
+        else if(params[i].compare("-a") == 0 && i+1 < params.size())
+            analysis = params[i+1];
+        else if(params[i].compare("--fft-size") == 0 && i+1 < params.size())
+            analysisOptions.size = atoi(params[i+1].c_str());
+        else if(params[i].compare("--hop") == 0 && i+1 < params.size())
+            analysisOptions.hop = atoi(params[i+1].c_str());
+        else if(params[i].compare("--window") == 0 && i+1 < params.size()
+                && SpectralAnalysis::windowFromName(params[i+1],analysisOptions.window))
+            continue;
+        else if(params[i].compare("--cache") == 0 && i+1 < params.size())
+            cacheDir = params[i+1];
+        else if(params[i].compare("--cache-size") == 0 && i+1 < params.size())
+            cacheSize = strtoull(params[i+1].c_str(),0,10);
+        else if(params[i].compare("--spectra") == 0 && i+1 < params.size())
+            spectraFile = params[i+1];
+        else if(params[i].compare("--io-depth") == 0 && i+1 < params.size() && atoi(params[i+1].c_str()) > 0)
+            AsyncIO::options.depth = atoi(params[i+1].c_str());
+        else if(params[i].compare("--io-chunk") == 0 && i+1 < params.size() && atoi(params[i+1].c_str()) > 0)
+            AsyncIO::options.chunkSize = size_t(atoi(params[i+1].c_str())) * 1024;
+        else if(params[i].compare("--fft-lanes") == 0 && i+1 < params.size()
+                && strspn(params[i+1].c_str(),"1248") == 1 && params[i+1].size() == 1)
+        {
+            BatchFFT::maxLanes = atoi(params[i+1].c_str());
+            lanesSet = true;
+        }
+        else if(params[i].compare("--wisdom") == 0 && i+1 < params.size())
+            wisdomFile = params[i+1];
+        else if(params[i].compare("--autotune") == 0 && i+1 < params.size())
+            autotune = params[i+1];
+        else if(params[i].compare("--rates") == 0 && i+1 < params.size())
+            rates = params[i+1];
+        else
+        {
+            cout << "Spatne nastavene parametry.";
+            return 1;
+        }
+    }
+
+    /* Obnova přerušeného přepisu na místě */
+    if(rollback)
+        return !input.empty() && InPlaceWriter::rollback(input) ? 0 : 1;
+
+    /* Katalog čte jen hlavičky souborů, s ostatními úpravami nemá nic společného */
+    if(!catalog.empty())
+    {
+        if(output.empty())
+        {
+            cout << "Spatne nastavene parametry.";
+            return 1;
         }
+        return Catalog::build(catalog,output,probePeak) ? 0 : 1;
+    }
 
-        if(input.empty() || output.empty())
+    /* Ladění FFT změří stroj pro zadané frekvence a doplní výsledky do souboru */
+    if(!autotune.empty())
+    {
+        vector<size_t> tuned;
+        istringstream list(rates);
+        string rate;
+        while(getline(list,rate,','))
+            if(atoi(rate.c_str()) > 0)
+                tuned.push_back(atoi(rate.c_str()));
+        Wisdom wisdom;
+        if(tuned.empty() || (ifstream(autotune.c_str()).is_open() && !wisdom.load(autotune)))
         {
             cout << "Spatne nastavene parametry.";
             return 1;
         }
+        wisdom.tune(tuned,cout);
+        return wisdom.save(autotune) ? 0 : 1;
+    }
+
+    /* Wisdom ze startu programu, soubor z parametru ho pro tuto úlohu doplní */
+    Wisdom wisdom = Wisdom::global();
+    if(!wisdomFile.empty() && !wisdom.load(wisdomFile))
+        return 1;
+
+    if(input.empty() || (output.empty() && analysis.empty() && !inPlace && peaks.empty()))
+    {
+        cout << "Spatne nastavene parametry.";
+        return 1;
+    }
+
+    /* Směs více vstupů se nedá svázat s jedním vstupním souborem, proto bez cache a uložených spekter */
+    bool mixing = mixer.size() > 1;
+
+    /* Zpracování úseku se vkládá zpět do raw dat, nesmí tedy měnit délku a spektra celého souboru nepoužije */
+    bool region = start >= 0 || end >= 0;
+    if(region && (mixing || tempo != 100 || semitones != 0))
+    {
+        cerr << "ERROR: --start/--end nelze kombinovat s vice vstupy ani se zmenou tempa." << endl;
+        return 1;
+    }
+
+    /* Více výstupů: každý -o má svůj -e, vstup se načte a dopředná FFT spočítá jen jednou */
+    bool multi = outputs.size() > 1;
+    if(multi && (presets.size() != outputs.size() || region || inPlace || tempo != 100 || semitones != 0
+                 || !chain.empty() || !analysis.empty() || !peaks.empty()))
+    {
+        cerr << "ERROR: Vice vystupu vyzaduje ke kazdemu -o jeden -e a nelze je kombinovat s --start/--end, --in-place, "
+                "--tempo, --pitch, --chain, -a ani --peaks." << endl;
+        return 1;
+    }
+
+    /* Přepis na místě zapisuje do vstupu, ten musí být jen jeden a délka se nesmí změnit */
+    if(inPlace)
+    {
+        if(mixing || tempo != 100 || semitones != 0 || !output.empty() || FlacDecoder::isFlac(input.data()))
+        {
+            cerr << "ERROR: --in-place nelze kombinovat s -o, vice vstupy, zmenou tempa ani s FLAC vstupem." << endl;
+            return 1;
+        }
+        /* Předchozí přerušený přepis se nejdřív vrátí */
+        if(!InPlaceWriter::rollback(input))
+            return 1;
+    }
+
+    /* Graf efektů nahrazuje pevné pořadí úprav, úpravy z parametrů se s ním nekombinují */
+    unique_ptr<EffectGraph> graph;
+    if(!chain.empty())
+    {
+        if(!preset.empty() || percentage != -1 || tempo != 100 || semitones != 0 || !denoise.empty() || region || inPlace)
+        {
+            cerr << "ERROR: --chain nelze kombinovat s -e, -v, --tempo, --pitch, --denoise, --start/--end ani --in-place." << endl;
+            return 1;
+        }
+        graph.reset(new EffectGraph);
+        if(!graph->load(chain.data()))
+            return 1;
+    }
+
+    /* Přemixování mění počet kanálů, výsledek tedy nejde vložit zpět do vstupu */
+    if(!remix.empty() && (region || inPlace || graph))
+    {
+        cerr << "ERROR: --remix nelze kombinovat s --start/--end, --in-place ani --chain (v grafu je uzel remix)." << endl;
+        return 1;
+    }
+
+    /* Kontrolní body má jen equalizace po blocích, která kóduje rovnou do výstupního WAV */
+    if(checkpointing && (preset.empty() || !denoise.empty() || !remix.empty() || !spectraFile.empty() || mixing || region
+                         || inPlace || graph || multi || !analysis.empty() || tempo != 100 || semitones != 0 || output.empty()
+                         || !peaks.empty() || FlacDecoder::isFlacName(output)))
+    {
+        cerr << "ERROR: --checkpoint a --resume vyzaduji -e a WAV vystup -o a nelze je kombinovat s dalsimi upravami "
+                "krome -v a --silence." << endl;
+        return 1;
+    }
+
+    /* Jen změna hlasitosti: data se neparsují, hlasitost se mění přímo v PCM datech po blocích.
+     * Pracuje jen s WAV soubory, FLAC se dekóduje, respektive kóduje v obecné cestě.
+     * I obecná cesta pak mění hlasitost přes Gain, výsledek s cache, FLAC nebo --in-place je tedy stejný. */
+    bool gainOnly = percentage != -1 && preset.empty() && denoise.empty() && analysis.empty() && tempo == 100 && semitones == 0
+                    && !mixing && !region && (!output.empty() || inPlace) && peaks.empty() && remix.empty();
+    if(dither && !gainOnly)
+    {
+        cerr << "ERROR: --dither lze pouzit jen se samotnou zmenou hlasitosti -v do vystupu -o nebo s --in-place." << endl;
+        return 1;
+    }
+    if(gainOnly && !inPlace && cacheDir.empty() && !FlacDecoder::isFlacName(output) && !FlacDecoder::isFlac(input.data()))
+        return Gain::process(input.data(),output.data(),percentage,dither) ? 0 : 1;
+
+    /* Uložená spektra bloků z minulého běhu, pokud se vstup mezitím nezměnil */
+    unique_ptr<SpectrumCache> spectra;
+    /* Profil šumu se učí z dat, s odšuměním se proto spektra nepoužijí */
+    if(!spectraFile.empty() && !preset.empty() && denoise.empty() && remix.empty() && !mixing && !region && !multi)
+    {
+        spectra.reset(new SpectrumCache(input,spectraFile));
+        spectra->open();
+    }
+
+    /* Data se zatím nerozparsují, při zásahu v cache to nebude potřeba.
+     * S platnými spektry se raw data vůbec nečtou, pokud je nepotřebuje cache. */
+    unique_ptr<Wave> wave(mixing ? mixer.mix()
+                                 : Wave::fromFilename(input.data(),
+                                                      spectra && spectra->isLoaded() && cacheDir.empty() ? Wave::Headers : Wave::Raw));
+    if(!wave)
+    {
+        cerr << "ERROR: Nelze nacist vstupni soubor." << endl;
+        return 1;
+    }
+
+    /* Gain umí jen 8 a 16bitové samply, ostatní mění hlasitost po naparsování bez ditheru */
+    const size_t SizeOfSample = wave->fchunk.BitsPerSample / 8;
+    gainOnly = gainOnly && (SizeOfSample == 1 || SizeOfSample == 2);
+    if(dither && !gainOnly)
+    {
+        cerr << "ERROR: --dither podporuje jen 8 a 16bitove samply." << endl;
+        return 1;
+    }
+
+    /* Nastavení FFT a vláken naměřené pro vzorkovací frekvenci vstupu, výsledek se tím nemění */
+    wisdom.apply(wave->fchunk.SampleRate,!lanesSet);
+
+    vector<double> tmpPreset;
+    if(!preset.empty())
+    {
+        tmpPreset = DataUtility::cachedPreset(preset.data());
+        if(tmpPreset.empty())
+            return 1;
+    }
+
+    ChannelMatrix matrix;
+    if(!remix.empty() && !matrix.load(remix,wave->fchunk.NumChannels))
+        return 1;
+
+    /* Cache výstupů, klíč obsahuje vše, co ovlivní výstupní data.
+     * Analýza ani přehled průběhu se do cache neukládají, proto se s nimi cache nepoužívá.
+     * Graf efektů odkazuje na další soubory (presety), proto se s ním cache také nepoužívá. */
+    unique_ptr<ResultCache> cache;
+    string cacheKey;
+    if(!cacheDir.empty() && !output.empty() && analysis.empty() && peaks.empty() && !mixing && !inPlace && !graph && !multi)
+    {
+        cache.reset(new ResultCache(cacheDir,cacheSize*1024*1024));
+        ResultCache::Hasher hasher;
+        hasher.update(ResultCache::EngineVersion,strlen(ResultCache::EngineVersion));
+        hasher.add(wave->fchunk);
+        hasher.add(wave->dchunk.head.length);
+        hasher.update(wave->dchunk.data,wave->dchunk.head.length);
+        hasher.add(tmpPreset.size());
+        if(!tmpPreset.empty())
+            hasher.update(&tmpPreset[0],tmpPreset.size()*sizeof(double));
+        hasher.add(percentage);
+        hasher.add(tempo);
+        hasher.add(semitones);
+        hasher.add(start);
+        hasher.add(end);
+        hasher.update(denoise.data(),denoise.size());
+        hasher.add(denoiseOptions.reduction);
+        hasher.add(silenceSet && denoise.empty() ? silence : 0.);
+        hasher.add(matrix.values().size());
+        if(!matrix.values().empty())
+            hasher.update(&matrix.values()[0],matrix.values().size()*sizeof(double));
+        /* Equalizace normalizuje hlasitost, změna hlasitosti ne */
+        hasher.add(!preset.empty() || !denoise.empty());
+        hasher.add(FlacDecoder::isFlacName(output));
+        hasher.add(dither);
+        /* Spektra se ukládají ve float, výsledek z nich se může lišit o 1 LSB */
+        hasher.add(spectra && spectra->isLoaded());
+        cacheKey = hasher.digest();
+
+        if(cache->fetch(cacheKey,output))
+        {
+            cache->printStats(cout);
+            return 0;
+        }
+    }
+
+    /* Úsek se zpracuje i s okraji, ve kterých se pak prolne s původními daty.
+     * Zbytek raw dat se nerozparsuje a uloží se beze změny. */
+    Wave *target = wave.get();
+    unique_ptr<Wave> regionWave;
+    size_t regionFrom = 0;
+    size_t fadeIn = 0;
+    size_t fadeOut = 0;
+    if(region)
+    {
+        size_t SampleRate = wave->fchunk.SampleRate;
+        size_t samples = wave->dchunk.head.length / (wave->fchunk.NumChannels * (wave->fchunk.BitsPerSample / 8));
+        size_t from = start > 0 ? min<size_t>(size_t(start * SampleRate),samples) : 0;
+        size_t to = end > 0 ? min<size_t>(size_t(end * SampleRate),samples) : samples;
+        if(from >= to)
+        {
+            cerr << "ERROR: Prazdny usek." << endl;
+            return 1;
+        }
+        /* Okraj a prolínání 20 ms */
+        size_t margin = SampleRate / 50;
+        regionFrom = from - min(margin,from);
+        size_t regionTo = min(to + margin,samples);
+        fadeIn = from - regionFrom;
+        fadeOut = regionTo - to;
+        regionWave.reset(wave->extract(regionFrom,regionTo - regionFrom));
+        target = regionWave.get();
+        if(!target)
+            return 1;
+    }
+
+    /* Tiché bloky se přeskočí. Bez prahu jen digitální ticho, výsledek je pak stejný jako bez přeskakování.
+     * Odšumění pracuje i s tichými bloky, proto s ním práh zůstává nulový. */
+    const double threshold = silenceSet && denoise.empty() ? pow(10., silence / 20) : 0;
+    ActivityMap activity(threshold);
+
+    /* Samotná equalizace do souboru: dekódování, FFT a kódování běží souběžně nad raw daty.
+     * Automaticky jen tehdy, když kanály samy nevytíží všechna vlákna poolu. */
+    bool pipelined = !preset.empty() && denoise.empty() && remix.empty() && !spectra && !mixing && !region && !inPlace && !graph && !multi
+                     && analysis.empty() && tempo == 100 && semitones == 0 && !output.empty()
+                     && (pipeline || checkpointing || wave->fchunk.NumChannels < ThreadPool::instance().size());
+
+    /* Výstup se zapisuje průběžně se stavem pro pokračování. Klíč obsahuje vše, co ovlivní výstup,
+     * včetně dat vstupu, rozepsaný výstup jiné úlohy se tak nedokončí. */
+    unique_ptr<Checkpoint> checkpoint;
+    if(checkpointing)
+    {
+        ResultCache::Hasher hasher;
+        hasher.update(ResultCache::EngineVersion,strlen(ResultCache::EngineVersion));
+        hasher.add(wave->fchunk);
+        hasher.add(wave->dchunk.head.length);
+        hasher.update(wave->dchunk.data,wave->dchunk.head.length);
+        hasher.add(tmpPreset.size());
+        if(!tmpPreset.empty())
+            hasher.update(&tmpPreset[0],tmpPreset.size()*sizeof(double));
+        hasher.add(percentage);
+        hasher.add(threshold);
+        checkpoint.reset(new Checkpoint(output,hasher.digest()));
+        if(!checkpoint->open(*wave,resume))
+            return 1;
+        if(checkpoint->phase() == 2 || checkpoint->nextBlock() != 0)
+            cout << "Pokracuje se od bloku " << checkpoint->nextBlock() << " ve fazi " << checkpoint->phase() << "." << endl;
+    }
+
+    if(pipelined && !Pipeline::equalize(*wave,tmpPreset,percentage,&activity,checkpoint.get()))
+    {
+        cerr << "ERROR: Vstupni soubor nelze zpracovat po blocich." << endl;
+        return 1;
+    }
+
+    if((!spectra || !spectra->isLoaded()) && !pipelined && remix.empty() && !gainOnly)
+        target->parse();
+
+    /* Přemixování kanálů přímo z raw dat, equalizuje se už jen výstupní počet kanálů */
+    if(!remix.empty())
+    {
+        wave.reset(matrix.apply(*wave));
+        if(!wave)
+            return 1;
+        target = wave.get();
+    }
+
+    /* Graf vytvoří nový wave, jeho formát může být jiný (převzorkování) */
+    if(graph)
+    {
+        wave.reset(graph->process(*wave));
+        if(!wave)
+            return 1;
+        target = wave.get();
+    }
 
-        Wave *wave = Wave::fromFilename(input.data());
+    /* Profil šumu se naučí z dat, která se budou zpracovávat */
+    unique_ptr<Denoiser> denoiser;
+    if(!denoise.empty())
+    {
+        denoiser.reset(new Denoiser(denoiseOptions));
+        if(denoise == "auto")
+        {
+            if(!denoiser->learnQuietest(*target))
+                return 1;
+        }
+        else
+        {
+            /* Úsek profilu je v čase celého souboru, při zpracování úseku se posune */
+            size_t SampleRate = target->fchunk.SampleRate;
+            size_t from = size_t(noiseStart * SampleRate);
+            size_t to = size_t(noiseEnd * SampleRate);
+            if(from < regionFrom)
+            {
+                cerr << "ERROR: Usek profilu sumu musi lezet uvnitr zpracovavaneho useku." << endl;
+                return 1;
+            }
+            if(!denoiser->learn(*target,from - regionFrom,to - from))
+                return 1;
+        }
+    }
 
-        if(!preset.empty())
+    if(multi)
+    {
+        vector<vector<double> > tmpPresets;
+        for(size_t k = 0; k != presets.size(); ++k)
         {
-            vector<double> tmpPreset = DataUtility::loadPreset(preset.data());
-            wave->equalizeWith(tmpPreset);
+            tmpPresets.push_back(DataUtility::cachedPreset(presets[k].data()));
+            if(tmpPresets.back().empty())
+                return 1;
         }
+        vector<Wave*> rendered = target->equalizeMany(tmpPresets,true,denoiser.get(),&activity);
+        if(activity.skippedCount() || silenceSet)
+            activity.printStats(cout);
+        /* Změna hlasitosti a uložení jednotlivých výstupů jsou nezávislé, běží paralelně */
+        vector<char> saved(rendered.size(), 0);
+        ThreadPool::instance().run(rendered.size(), [&](size_t k, size_t) {
+            if(percentage != -1)
+                rendered[k]->changeVolumeToPercentage(percentage,false);
+            saved[k] = saveOutput(*rendered[k],outputs[k]);
+            delete rendered[k];
+        });
+        return count(saved.begin(), saved.end(), 0) == 0 ? checkAllocations() : 1;
+    }
+
+    /* Bez presetu se equalizuje s jednotkovým presetem, jen kvůli odšumění */
+    if((!preset.empty() || denoiser) && !pipelined)
+        target->equalizeWith(tmpPreset,true,spectra.get(),denoiser.get(),&activity);
+    if(activity.skippedCount() || silenceSet)
+        activity.printStats(cout);
+
+    if(tempo != 100 || semitones != 0)
+        target->changeTempo(tempo,semitones);
+
+    if(gainOnly)
+        Gain(percentage,dither).applyData(target->dchunk.data,target->dchunk.head.length,SizeOfSample);
+    else if(percentage != -1 && !pipelined)
+        target->changeVolumeToPercentage(percentage,false);
 
-        if(percentage != -1)
-            wave->changeVolumeToPercentage(percentage,false);
+    /* Analýza se počítá ze zpracovaných dat, ještě než se složí zpět do WAV */
+    if(!analysis.empty() && !SpectralAnalysis::analyze(*target,analysisOptions,analysis.data()))
+        return 1;
+
+    if(region && !wave->splice(*target,regionFrom,fadeIn,fadeOut))
+        return 1;
+
+    if(inPlace && !wave->saveInPlace(input.data()))
+        return 1;
+
+    if(!output.empty() && !checkpoint)
+    {
+        /* Výstup mohl být hard link do cache ze starší verze, ten se nesmí přepsat */
+        if(cache)
+            remove(output.data());
+        if(!saveOutput(*wave,output))
+            return 1;
+    }
 
-        wave->saveToWaveFile(output.data());
+    /* Přehled průběhu celého výsledku, stejná data jako ve výstupu */
+    if(!peaks.empty() && !PeakIndex::write(*wave,peaks.data()))
+        return 1;
 
-        return 0;
+    if(cache)
+    {
+        cache->store(cacheKey,output);
+        cache->printStats(cout);
     }
 
+    return checkAllocations();
+}
+
+/**
+ * @brief           Zpracuje úlohu a na jejím konci vrátí jádru všechny držené velké buffery.
+ * @param params    Parametry včetně jména programu na indexu 0.
+ * @return          Vrací návratový kód programu.
+ */
+static int runJobAndRelease(const vector<string> &params)
+{
+    int result = runJob(params);
+    Arena::releaseAll();
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    vector<string> params(argv, argv+argc);
+
+    /* Wisdom z proměnné prostředí platí pro všechny úlohy, i pro úlohy démona */
+    const char *wisdomFile = getenv("ZAPOCTAK_WISDOM");
+    if(wisdomFile && *wisdomFile)
+        Wisdom::global().load(wisdomFile);
+
+    /* Démon drží mezi úlohami presety, pracovní prostory a vlákna */
+    if(params.size() == 3 && params[1].compare("--daemon") == 0)
+        return Daemon(params[2],runJobAndRelease).run();
+
+    if(params.size() > 1)
+        return runJobAndRelease(params);
+
     char end = '\0';
     while( end != 'e' )
     {
@@ -87,10 +709,13 @@ int main(int argc, char **argv)
                 cesta = "c:/ZSound/bass.preset";
             cout << "Zpracovavam preset...";
             vector<double> preset = DataUtility::loadPreset(cesta.data());
-            cout << " Hotovo." << endl;
-            cout << "Equalizuji WAV...";
-            wave->equalizeWith(preset);
-            cout << " Hotovo." << endl;
+            if(!preset.empty())
+            {
+                cout << " Hotovo." << endl;
+                cout << "Equalizuji WAV...";
+                wave->equalizeWith(preset);
+                cout << " Hotovo." << endl;
+            }
         }
 
         cout << "Zadejte cestu, kam chcete WAV ulozit. default = c:/ZSound/output.wav" << endl;
@@ -114,7 +739,8 @@ int main(int argc, char **argv)
 
     Co program umí:
     - měnit hlasitost
-    - měnit frekvenční spektrum, dle daného presetu.
+    - měnit frekvenční spektrum, dle daného presetu
+    - měnit tempo a výšku tónu.
 
     Co je to preset a jak vypadá:
     - Preset je soubor obsahující modifikující koeficienty, kterými se změní frekvenční spektrum.
@@ -127,12 +753,103 @@ int main(int argc, char **argv)
     Ovládání přes paramety:
 
     zapoctak.exe -i Vstupni_soubor -o Vystupni_soubor [-v Procentuelni_zmena] [-e Preset]
+                 [-e Dalsi_preset -o Dalsi_vystup]...
+                 [-i Dalsi_vstup [-g Procenta]]...
+                 [--tempo Procenta] [--pitch Pultony] [--start Sekundy] [--end Sekundy]
+                 [--in-place] [--rollback] [--dither] [--denoise auto|Od:Do [--denoise-reduce dB]]
+                 [--chain Graf] [--remix stereo|mono|ms|lr|Matice] [--checkpoint] [--resume]
+                 [-a Analyza.npy [--fft-size N] [--hop H] [--window rect|hann|hamming|blackman]]
+                 [--cache Adresar [--cache-size MB]] [--spectra Soubor]
+                 [--io-depth N] [--io-chunk KB] [--direct-io] [--fft-lanes N]
+                 [--pipeline] [--peaks Soubor] [--silence dB]
+                 [--huge-pages off|thp|explicit] [--numa Uzel|interleave] [--wisdom Soubor]
+
+    zapoctak.exe --catalog Adresar -o Index.csv|Index.json|Index.bin [--probe-peak N]
+
+    zapoctak.exe --autotune Wisdom [--rates 44100,48000,...]
+
+    zapoctak.exe --daemon Socket
 
     parametry:<br />
-    -i  Vstupni_soubor - Cesta k WAV souboru, který se bude měnit.<br />
-    -o  Vystupni_soubor - Cesta k výstupnímu souboru, kam se vstupní WAV uloží.<br />
-    -v  Procentuelni_zmena - Číslo v procentech, jak se zvuk zeslabí/zesílí.<br />
-    -e  Preset - Cesta k presetu, který modifikuje frekvenční spektrum vstupního WAVu.<br />
+    -i  Vstupni_soubor - Cesta k WAV souboru, který se bude měnit. Při opakování se všechny vstupy smíchají
+        do jednoho (stejná vzorkovací frekvence) a dál se zpracovává jejich součet. Jediný vstup může být
+        i FLAC (8 nebo 16 bitů), pozná se podle obsahu.<br />
+    -g  Procenta - Zesílení předchozího vstupu -i ve směsi. Výchozí 100.<br />
+    --tempo Procenta - Změní tempo beze změny výšky tónu, 200 = dvakrát rychlejší. Mění délku výstupu.<br />
+    --pitch Pultony - Posune výšku tónu o daný počet půltónů (i záporný) beze změny tempa.<br />
+    --start Sekundy, --end Sekundy - Zpracuje jen úsek mezi danými časy, na okrajích se 20 ms prolíná s původním
+        signálem. Zbytek souboru se zkopíruje beze změny. Analýza -a se pak počítá jen z úseku.<br />
+    --in-place - Místo -o přepíše vstupní soubor, zapíšou se jen změněné bloky. Jejich původní obsah se
+        předtím uloží do Vstupni_soubor.journal, přerušený přepis se při dalším spuštění vrátí.<br />
+    --rollback - Jen vrátí přerušený přepis vstupního souboru podle journalu a skončí.<br />
+    -o  Vystupni_soubor - Cesta k výstupnímu souboru, kam se vstupní WAV uloží. S příponou .flac se uloží
+        bezeztrátově komprimovaný FLAC, rámce se kódují paralelně.<br />
+    -v  Procentuelni_zmena - Číslo v procentech, jak se zvuk zeslabí/zesílí. Pokud se mění jen hlasitost,
+        počítá se přímo s PCM daty v celých číslech, bez parsování a po blocích.<br />
+    --dither - Při změně jen hlasitosti přidá před zaokrouhlením trojúhelníkový dither ±1 LSB. Jen pro 8
+                 a 16bitové samply, s jinými úpravami než --in-place ho nelze použít.<br />
+    --daemon Socket - Spustí démona, který přijímá úlohy přes Unix socket. Každý řádek je jedna úloha
+        s výše uvedenými parametry, odpověď je "OK ms" nebo "ERROR kod ms". Řádek "stats" vrátí percentily
+        latence úloh, "quit" démona ukončí. Presety, buffery a vlákna zůstávají mezi úlohami připravené.<br />
+    -e  Preset - Cesta k presetu, který modifikuje frekvenční spektrum vstupního WAVu. Při opakování
+        (-e p1 -o out1 -e p2 -o out2 ...) se každý preset uloží do svého výstupu, vstup se načte a dopředná FFT
+        spočítá jen jednou. Výstupy jsou stejné jako při samostatných bězích.<br />
+    --denoise auto|Od:Do - Potlačí stálý šum (spectral gating). Profil šumu se naučí z úseku Od:Do v sekundách,
+        nebo s auto z 10 % nejtišších rámců vstupu. Šum se potlačí ve spektru bloku equalizace, FFT se nepočítá
+        navíc. Bez -e se použije jen odšumění.<br />
+    --denoise-reduce dB - Největší potlačení šumu. Výchozí 12 dB.<br />
+    --chain Graf - Zpracuje vstup grafem efektů z konfiguračního souboru místo -e, -v, --tempo a --denoise.
+        Každý řádek je uzel "jmeno typ vstup[,vstup...] [klic=hodnota]...", vstup "input" je vstupní soubor,
+        řádek "output jmeno" vybere výstup (jinak poslední uzel). Typy: gain (percent, db), fft-eq (preset),
+        iir-eq (type=peak|lowpass|highpass|lowshelf|highshelf, freq, q, gain), limiter (ceiling, release),
+        resample (rate), mix (gains=P1,P2,...) a remix (matrix, viz --remix). Data se zpracovávají po blocích,
+        nezávislé větve a kanály paralelně.<br />
+    --remix stereo|mono|ms|lr|Matice - Před equalizací přemixuje kanály: stereo je downmix 5.1 podle ITU-R BS.775
+        (L + C/√2 + Ls/√2, LFE se zahodí), mono průměr kanálů, ms kódování stereo na mid/side, lr zpět.
+        Matice je soubor, každý řádek jsou koeficienty jednoho výstupního kanálu pro všechny vstupní kanály.
+        Equalizace pak pracuje jen s výstupními kanály.<br />
+    -a  Analyza.npy - Uloží STFT spektrogram výstupu (float32 .npy) a souhrn energie v pásmech (.bands.csv).
+        Parametr -o je pak nepovinný.<br />
+    --fft-size N - Velikost rámce analýzy, mocnina dvojky. Výchozí 2048.<br />
+    --hop H - Posun mezi rámci analýzy. Výchozí 512.<br />
+    --window W - Okno analýzy: rect, hann, hamming nebo blackman. Výchozí hann.<br />
+    --cache Adresar - Adresář cache výstupů. Pokud už byl stejný vstup se stejným nastavením zpracován,
+        výstup se jen zkopíruje z cache. Na konci se vypíše úspěšnost cache.<br />
+    --cache-size MB - Maximální velikost cache, nejdéle nepoužité výstupy se mažou. Výchozí 1024 MB.<br />
+    --spectra Soubor - Soubor se spektry bloků vstupu. Při prvním běhu s -e se spektra uloží, při dalších
+        bězích se stejným vstupem se jen namapují a počítá se pouze filtr a inverzní FFT. Vhodné pro ladění presetu.<br />
+    --io-depth N - Počet bloků, které se najednou čtou dopředu, respektive zapisují na pozadí. Výchozí 4.<br />
+    --io-chunk KB - Velikost bloku pro čtení a zápis v KB. Výchozí 1024.<br />
+    --fft-lanes N - Kolik kanálů se equalizuje najednou v jedné FFT (1, 2, 4 nebo 8), 1 dávkování vypne. Výchozí 8.<br />
+    --direct-io - Čte a zapisuje mimo page cache (O_DIRECT), vhodné pro velmi velké soubory.<br />
+    --pipeline - Equalizace s -e (bez dalších úprav) běží ve třech souběžných fázích: dekódování, FFT a kódování
+                 bloků. Automaticky se zapne, pokud má vstup méně kanálů než je vláken.<br />
+    --peaks Soubor - Uloží k výsledku pyramidu minim, maxim a RMS pro vykreslení průběhu v libovolném
+                 měřítku (úroveň 0 po 256 samplech, každá další dvakrát hrubší). Lze použít i bez -o.<br />
+    --silence dB - Bloky equalizace, jejichž špička nepřesáhne práh v dB plného rozsahu (např. -90), se nefiltrují
+                 a projdou beze změny. Bez této volby se přeskakuje jen digitální ticho, což výsledek nemění.
+                 Vypíše, jaká část bloků se přeskočila. S --denoise se přeskakuje jen digitální ticho.<br />
+    --huge-pages off|thp|explicit - Velké buffery (raw data a rozparsovaná data) se mapují zarovnané na 2 MB
+                 a jádro je pokryje velkými stránkami: thp transparentními (výchozí), explicit vyhrazenými
+                 (hugetlbfs, když nejsou, tak transparentními), off jen běžnými stránkami.<br />
+    --numa Uzel|interleave - Velké buffery se alokují na zadaném NUMA uzlu, nebo rozložené po všech uzlech.<br />
+    --catalog Adresar - Projde adresář i podadresáře paralelně a do -o uloží katalog WAV souborů: cesta,
+                 kanály, vzorkovací frekvence, bity, počet samplů, délka a špička. Čtou se jen hlavičky. Formát podle
+                 přípony: .csv, .json, jinak binární.<br />
+    --probe-peak N - Špička v katalogu se odhadne z N rovnoměrně rozmístěných úseků po 4096 samplech.
+                 Výchozí 0, bez odhadu.<br />
+    --autotune Wisdom - Změří na tomto stroji nejrychlejší FFT jádro (přímé, nebo po blocích s různou délkou
+                 bloku a dlaždice), dávku --fft-lanes a počet vláken pro velikost FFT každé vzorkovací frekvence
+                 a doplní je do souboru Wisdom. Velikost FFT se neladí, určuje ji preset. Výsledek se tím nemění.<br />
+    --rates F1,F2,... - Vzorkovací frekvence pro --autotune. Výchozí 44100,48000,96000.<br />
+    --wisdom Soubor - Použije nastavení z --autotune pro vzorkovací frekvenci vstupu. Soubor z proměnné
+                 prostředí ZAPOCTAK_WISDOM se načte při startu a platí pro všechny úlohy. Ručně zadané
+                 --fft-lanes má přednost.<br />
+    --checkpoint - Equalizace s -e zapisuje hotové bloky rovnou do výstupu a nejvýš každé 2 s uloží stav
+                 (číslo bloku a největší sampl pro normalizaci) do Vystupni_soubor.checkpoint. Jen WAV výstup,
+                 z dalších úprav jen -v a --silence. Po úspěšném dokončení se stav smaže.<br />
+    --resume - Jako --checkpoint, ale přerušenou úlohu se stejnými parametry dokončí od posledního uloženého
+                 bloku. Výstup je stejný jako bez přerušení. Bez platného stavu začne od začátku.<br />
 
 
     Jak program funguje:
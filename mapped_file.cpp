@@ -0,0 +1,146 @@
+﻿#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+MappedFile::MappedFile() : ptr(0), length(0), file(INVALID_HANDLE_VALUE), mapping(0) {}
+
+bool MappedFile::open(const std::string &filename, bool writable)
+{
+    close();
+    file = CreateFileA(filename.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ, 0,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    length = size.QuadPart;
+    return map(writable);
+}
+
+bool MappedFile::create(const std::string &filename, uint64_t size)
+{
+    close();
+    file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    length = size;
+    return map(true);
+}
+
+bool MappedFile::map(bool writable)
+{
+    /* Prázdný soubor namapovat nejde */
+    if(length == 0)
+    {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, 0, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                 DWORD(length >> 32), DWORD(length & 0xffffffff), 0);
+    if(mapping)
+        ptr = static_cast<char*>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+    if(!ptr)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::flush()
+{
+    return ptr && FlushViewOfFile(ptr, 0) && FlushFileBuffers(file);
+}
+
+void MappedFile::close()
+{
+    if(ptr)
+        UnmapViewOfFile(ptr);
+    if(mapping)
+        CloseHandle(mapping);
+    if(file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    ptr = 0;
+    mapping = 0;
+    file = INVALID_HANDLE_VALUE;
+    length = 0;
+}
+
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : ptr(0), length(0), fd(-1) {}
+
+bool MappedFile::open(const std::string &filename, bool writable)
+{
+    close();
+    fd = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close();
+        return false;
+    }
+    length = st.st_size;
+    return map(writable);
+}
+
+bool MappedFile::create(const std::string &filename, uint64_t size)
+{
+    close();
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || ftruncate(fd, size) != 0)
+    {
+        close();
+        return false;
+    }
+    length = size;
+    return map(true);
+}
+
+bool MappedFile::map(bool writable)
+{
+    /* Prázdný soubor namapovat nejde */
+    if(length == 0)
+    {
+        close();
+        return false;
+    }
+    void *p = mmap(0, length, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    ptr = static_cast<char*>(p);
+    return true;
+}
+
+bool MappedFile::flush()
+{
+    return ptr && msync(ptr, length, MS_SYNC) == 0;
+}
+
+void MappedFile::close()
+{
+    if(ptr)
+        munmap(ptr, length);
+    if(fd >= 0)
+        ::close(fd);
+    ptr = 0;
+    fd = -1;
+    length = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,69 @@
+﻿#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Soubor namapovaný do paměti.
+ *
+ * Tenká obálka nad mmap (POSIX), respektive MapViewOfFile (Windows).
+ * Data souboru jsou přístupná přes ukazatel a načítají se až při prvním přístupu.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+
+    /**
+     * @brief   Destruktor, odmapuje a zavře soubor.
+     */
+    ~MappedFile();
+
+    /**
+     * @brief           Namapuje existující soubor.
+     * @param filename  Jméno souboru.
+     * @param writable  Jestli se do souboru bude zapisovat.
+     * @return          Vrací, jestli se mapování podařilo.
+     */
+    bool open(const std::string &filename, bool writable = false);
+
+    /**
+     * @brief           Vytvoří (nebo přepíše) soubor dané velikosti a namapuje ho pro zápis.
+     * @param filename  Jméno souboru.
+     * @param size      Velikost souboru v Bajtech.
+     * @return          Vrací, jestli se mapování podařilo.
+     */
+    bool create(const std::string &filename, uint64_t size);
+
+    /**
+     * @brief   Zapíše změněné stránky na disk a počká na dokončení.
+     * @return  Vrací, jestli zápis proběhl v pořádku.
+     */
+    bool flush();
+
+    /**
+     * @brief Odmapuje a zavře soubor.
+     */
+    void close();
+
+    char* data() const { return ptr; }
+    uint64_t size() const { return length; }
+    bool isOpen() const { return ptr != 0; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    bool map(bool writable);
+
+    char *ptr;          /**< Začátek namapovaných dat. */
+    uint64_t length;    /**< Velikost namapovaných dat. */
+#ifdef _WIN32
+    void *file;         /**< Handle souboru. */
+    void *mapping;      /**< Handle mapování. */
+#else
+    int fd;             /**< Deskriptor souboru. */
+#endif
+};
+
+#endif // MAPPED_FILE_H
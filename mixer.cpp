@@ -0,0 +1,153 @@
+﻿#include "mixer.h"
+#include "data_utility.h"
+#include <algorithm>
+#include <fstream>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define ZAPOCTAK_MIXER_SSE
+#endif
+
+namespace
+{
+    /* Počet samplů v kanálu, které se čtou ze všech vstupů najednou */
+    const size_t BlockSamples = 65536;
+
+    /**
+     * @brief Otevřený vstup směsi.
+     */
+    struct Source
+    {
+        std::ifstream in;
+        Wave::FmtChunk fmt;
+        size_t SizeOfSample;
+        size_t FrameSize;
+        size_t samples;     /**< Počet celých samplů v kanálu. */
+        float gain;
+        std::vector<char> raw;
+    };
+}
+
+void Mixer::add(const std::string &filename, double gain)
+{
+    Input input = { filename, gain };
+    inputs.push_back(input);
+}
+
+void Mixer::setLastGain(double gain)
+{
+    if(!inputs.empty())
+        inputs.back().gain = gain;
+}
+
+void Mixer::accumulate(float *acc, const float *in, float gain, size_t count)
+{
+    size_t i = 0;
+#ifdef ZAPOCTAK_MIXER_SSE
+    const __m128 g = _mm_set1_ps(gain);
+    for(; i + 4 <= count; i += 4)
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(in + i), g)));
+#endif
+    for(; i != count; ++i)
+        acc[i] += in[i] * gain;
+}
+
+Wave* Mixer::mix() const
+{
+    if(inputs.empty())
+        return 0;
+
+    /* Otevření vstupů a sjednocení formátu */
+    std::vector<Source> sources(inputs.size());
+    Wave::FmtChunk out;
+    size_t samples = 0;
+    for(size_t i = 0; i != inputs.size(); ++i)
+    {
+        Source &src = sources[i];
+        Wave::RiffChunk rch;
+        Wave::DataChunkHeader dchh;
+        src.in.open(inputs[i].filename.c_str(), std::ios_base::in | std::ios_base::binary);
+        if(!src.in.is_open() || !Wave::readHeaders(src.in,rch,src.fmt,dchh))
+        {
+            std::cerr << "ERROR: Nelze nacist vstup smesi: " << inputs[i].filename << std::endl;
+            return 0;
+        }
+        src.SizeOfSample = src.fmt.BitsPerSample / 8;
+        src.FrameSize = src.fmt.NumChannels * src.SizeOfSample;
+        if(src.SizeOfSample < 1 || src.SizeOfSample > 2 || src.fmt.NumChannels == 0)
+        {
+            std::cerr << "ERROR: Nepodporovany format vstupu smesi: " << inputs[i].filename << std::endl;
+            return 0;
+        }
+
+        /* Délka podle data chunku, ale nejvýš do konce souboru */
+        std::streamoff begin = src.in.tellg();
+        src.in.seekg(0, std::ios::end);
+        uint64_t available = uint64_t(src.in.tellg() - begin);
+        src.in.seekg(begin);
+        src.samples = size_t(std::min<uint64_t>(dchh.length, available) / src.FrameSize);
+        src.gain = float(inputs[i].gain / 100);
+        src.raw.resize(BlockSamples * src.FrameSize);
+
+        if(i == 0)
+            out = src.fmt;
+        else if(src.fmt.SampleRate != out.SampleRate)
+        {
+            std::cerr << "ERROR: Vstupy smesi maji ruznou vzorkovaci frekvenci: " << inputs[i].filename << std::endl;
+            return 0;
+        }
+        out.NumChannels = std::max(out.NumChannels, src.fmt.NumChannels);
+        out.BitsPerSample = std::max(out.BitsPerSample, src.fmt.BitsPerSample);
+        samples = std::max(samples, src.samples);
+    }
+
+    Wave *ret = Wave::create(out, samples);
+    const size_t NumChannels = out.NumChannels;
+    std::vector<float> acc(BlockSamples * NumChannels);
+    std::vector<float> converted(BlockSamples * NumChannels);
+    std::vector<float> frame(NumChannels);
+
+    /* Zpracování po blocích, ze všech vstupů se čte stejný úsek */
+    for(size_t first = 0; first < samples; first += BlockSamples)
+    {
+        const size_t count = std::min(BlockSamples, samples - first);
+        std::fill(acc.begin(), acc.begin() + count * NumChannels, 0.f);
+
+        for(size_t s = 0; s != sources.size(); ++s)
+        {
+            Source &src = sources[s];
+            if(first >= src.samples)
+                continue;
+            const size_t n = std::min(count, src.samples - first);
+            src.in.read(&src.raw[0], n * src.FrameSize);
+            const size_t inChannels = src.fmt.NumChannels;
+
+            /* Převod na float ve výstupním rozložení kanálů */
+            for(size_t i = 0; i != n; ++i)
+            {
+                for(size_t c = 0; c != inChannels; ++c)
+                {
+                    complex tmp = DataUtility::fromCharsToComplex(&src.raw[i * src.FrameSize + c * src.SizeOfSample], src.SizeOfSample);
+                    DataUtility::scaleComplex(tmp, src.SizeOfSample, false);
+                    frame[c] = float(tmp.re());
+                }
+                float *dst = &converted[i * NumChannels];
+                if(inChannels == NumChannels)
+                    std::copy(frame.begin(), frame.end(), dst);
+                else if(inChannels == 1)
+                    std::fill(dst, dst + NumChannels, frame[0]);
+                else
+                    /* Méně kanálů než výstup (a ne mono): chybějící kanály zůstanou tiché */
+                    for(size_t c = 0; c != NumChannels; ++c)
+                        dst[c] = c < inChannels ? frame[c] : 0.f;
+            }
+            accumulate(&acc[0], &converted[0], src.gain, n * NumChannels);
+        }
+
+        /* Součet do rozparsovaných dat výstupu */
+        for(size_t i = 0; i != count; ++i)
+            for(size_t c = 0; c != NumChannels; ++c)
+                ret->PData[c][first + i] = complex(acc[i * NumChannels + c]);
+    }
+    return ret;
+}
@@ -0,0 +1,68 @@
+﻿#ifndef MIXER_H
+#define MIXER_H
+#include "wave.h"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Smíchá několik WAV souborů do jednoho.
+ *
+ * Vstupy se čtou souběžně po blocích, takže paměť na vstupy nezávisí na jejich délce.
+ * Každý blok se převede na float, vynásobí zesílením vstupu a přičte do součtu.
+ * Vstupy musí mít stejnou vzorkovací frekvenci, počet kanálů a velikost samplu se sjednotí:
+ * výstup má nejvíce kanálů a největší velikost samplu ze všech vstupů, mono vstup se rozkopíruje
+ * do všech kanálů, ostatním vstupům s méně kanály zůstanou chybějící kanály tiché.
+ * Kratší vstupy se doplní tichem.
+ */
+class Mixer
+{
+public:
+    /**
+     * @brief           Přidá vstup.
+     * @param filename  Cesta k WAV souboru.
+     * @param gain      Zesílení vstupu v procentech.
+     */
+    void add(const std::string &filename, double gain = 100);
+
+    /**
+     * @brief           Nastaví zesílení posledního přidaného vstupu.
+     * @param gain      Zesílení v procentech.
+     */
+    void setLastGain(double gain);
+
+    /**
+     * @brief   Počet vstupů.
+     */
+    size_t size() const { return inputs.size(); }
+
+    /**
+     * @brief   Smíchá všechny vstupy.
+     * @return  Vrací nový Wave s rozparsovanými daty součtu, nebo 0 při chybě.
+     */
+    Wave* mix() const;
+
+    /**
+     * @brief           Přičte vstup vynásobený zesílením k součtu.
+     * @param acc       Součet.
+     * @param in        Vstup.
+     * @param gain      Zesílení.
+     * @param count     Počet hodnot.
+     *
+     * Na procesorech s SSE se sčítají čtyři hodnoty najednou.
+     */
+    static void accumulate(float *acc, const float *in, float gain, size_t count);
+
+private:
+    /**
+     * @brief Jeden vstup směsi.
+     */
+    struct Input
+    {
+        std::string filename;   /**< Cesta k souboru. */
+        double gain;            /**< Zesílení v procentech. */
+    };
+
+    std::vector<Input> inputs;  /**< Vstupy. */
+};
+
+#endif // MIXER_H
@@ -0,0 +1,133 @@
+﻿#include "peak_index.h"
+#include "wave.h"
+#include "data_utility.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    /* Sampl v rozsahu 16bitových samplů ze složených raw dat */
+    inline int32_t decodeSample(const char *raw, size_t SizeOfSample)
+    {
+        if(SizeOfSample == 2)
+            return int16_t(static_cast<unsigned char>(raw[0]) | (static_cast<unsigned char>(raw[1]) << 8));
+        return (int32_t(static_cast<unsigned char>(raw[0])) - 128) * 256;
+    }
+
+    template<class T>
+    void put(std::ofstream &out, T value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+}
+
+bool PeakIndex::write(const Wave &wave, const char *filename)
+{
+    const size_t NumChannels = wave.fchunk.NumChannels;
+    const size_t SizeOfSample = wave.fchunk.BitsPerSample / 8;
+    if(NumChannels == 0 || (SizeOfSample != 1 && SizeOfSample != 2))
+    {
+        std::cerr << "ERROR: Pro tento format nelze spocitat prehled prubehu." << std::endl;
+        return false;
+    }
+    const bool parsed = wave.PData != 0;
+    const size_t samples = parsed ? wave.PData[0].size() : wave.dchunk.head.length / (NumChannels * SizeOfSample);
+
+    /* Úroveň 0 paralelně po souvislých kusech položek, součty čtverců se drží v double kvůli slučování */
+    size_t bins = std::max<size_t>(1, (samples + BaseBin - 1) / BaseBin);
+    std::vector<std::vector<Entry> > levels(1, std::vector<Entry>(bins * NumChannels));
+    std::vector<Entry> &entries = levels[0];
+    std::vector<double> squares(bins * NumChannels);
+    ThreadPool &pool = ThreadPool::instance();
+    const size_t BinsPerTask = 256;
+    pool.run((bins + BinsPerTask - 1) / BinsPerTask, [&](size_t task, size_t) {
+        char buffer[2];
+        size_t last = std::min(bins, (task + 1) * BinsPerTask);
+        for(size_t bin = task * BinsPerTask; bin != last; ++bin)
+        {
+            size_t from = bin * BaseBin;
+            size_t to = std::min(samples, from + BaseBin);
+            for(size_t ch = 0; ch != NumChannels; ++ch)
+            {
+                int32_t low = 32767;
+                int32_t high = -32768;
+                double sum = 0;
+                for(size_t i = from; i < to; ++i)
+                {
+                    const char *raw = wave.dchunk.data + (i * NumChannels + ch) * SizeOfSample;
+                    if(parsed)
+                    {
+                        /* Stejný převod jako při skládání raw dat */
+                        complex tmp = wave.PData[ch][i];
+                        DataUtility::scaleComplex(tmp,SizeOfSample,true);
+                        DataUtility::fromComplexToChars(tmp,SizeOfSample,buffer);
+                        raw = buffer;
+                    }
+                    int32_t v = decodeSample(raw,SizeOfSample);
+                    low = std::min(low, v);
+                    high = std::max(high, v);
+                    sum += double(v) * v;
+                }
+                Entry &e = entries[bin * NumChannels + ch];
+                e.min = int16_t(from < to ? low : 0);
+                e.max = int16_t(from < to ? high : 0);
+                e.rms = uint16_t(from < to ? std::min(65535., std::sqrt(sum / (to - from)) + 0.5) : 0);
+                squares[bin * NumChannels + ch] = sum;
+            }
+        }
+    });
+
+    /* Vyšší úrovně sloučením dvojic položek předchozí úrovně */
+    for(size_t binSize = 2 * BaseBin; bins > 1; binSize *= 2)
+    {
+        size_t merged = (bins + 1) / 2;
+        const std::vector<Entry> &previous = levels.back();
+        std::vector<Entry> level(merged * NumChannels);
+        for(size_t bin = 0; bin != merged; ++bin)
+        {
+            size_t count = std::min(binSize, samples - bin * binSize);
+            bool pair = 2 * bin + 1 < bins;
+            for(size_t ch = 0; ch != NumChannels; ++ch)
+            {
+                const Entry &a = previous[2 * bin * NumChannels + ch];
+                const Entry &b = previous[(pair ? 2 * bin + 1 : 2 * bin) * NumChannels + ch];
+                double sum = squares[2 * bin * NumChannels + ch] + (pair ? squares[(2 * bin + 1) * NumChannels + ch] : 0);
+                Entry &e = level[bin * NumChannels + ch];
+                e.min = std::min(a.min, b.min);
+                e.max = std::max(a.max, b.max);
+                e.rms = uint16_t(std::min(65535., std::sqrt(sum / std::max<size_t>(1, count)) + 0.5));
+                squares[bin * NumChannels + ch] = sum;
+            }
+        }
+        bins = merged;
+        levels.push_back(std::move(level));
+    }
+
+    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    out.write("ZPKS", 4);
+    put<uint32_t>(out, Version);
+    put<uint32_t>(out, NumChannels);
+    put<uint32_t>(out, wave.fchunk.SampleRate);
+    put<uint64_t>(out, samples);
+    put<uint32_t>(out, BaseBin);
+    put<uint32_t>(out, levels.size());
+    uint64_t offset = 4 + 3 * 4 + 8 + 2 * 4 + levels.size() * 16;
+    for(size_t l = 0; l != levels.size(); ++l)
+    {
+        put<uint64_t>(out, offset);
+        put<uint64_t>(out, levels[l].size() / NumChannels);
+        offset += levels[l].size() * sizeof(Entry);
+    }
+    static_assert(sizeof(Entry) == 6, "Polozka musi mit 6 Bajtu bez zarovnani.");
+    for(size_t l = 0; l != levels.size(); ++l)
+        out.write(reinterpret_cast<const char*>(&levels[l][0]), levels[l].size() * sizeof(Entry));
+    if(!out)
+    {
+        std::cerr << "ERROR: Nelze zapsat prehled prubehu: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+﻿#ifndef PEAK_INDEX_H
+#define PEAK_INDEX_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Wave;
+
+/**
+ * @brief Pyramida minim, maxim a RMS pro rychlé vykreslení průběhu v libovolném měřítku.
+ *
+ * Úroveň 0 shrnuje každých BaseBin samplů, každá další úroveň dvakrát víc, až poslední úroveň
+ * shrnuje celý soubor do jedné položky. Položka obsahuje pro každý kanál minimum, maximum
+ * a RMS samplů, vše v rozsahu 16bitových samplů (8bitové se vynásobí 256).
+ *
+ * Formát souboru (little endian):
+ *
+ *     "ZPKS", uint32 verze, uint32 kanály, uint32 vzorkovací frekvence, uint64 samply v kanálu,
+ *     uint32 BaseBin, uint32 počet úrovní,
+ *     pro každou úroveň: uint64 pozice dat v souboru, uint64 počet položek,
+ *     data úrovní: položky za sebou, v položce kanály za sebou, kanál je int16 min, int16 max, uint16 RMS.
+ *
+ * Úsek průběhu v daném měřítku je tedy souvislý kus jedné úrovně, stačí přečíst pár KB.
+ */
+class PeakIndex
+{
+public:
+    static const uint32_t Version = 1;      /**< Verze formátu. */
+    static const size_t BaseBin = 256;      /**< Počet samplů shrnutých v položce úrovně 0. */
+
+    /**
+     * @brief Jedna položka pyramidy pro jeden kanál.
+     */
+    struct Entry
+    {
+        int16_t min;        /**< Nejmenší sampl. */
+        int16_t max;        /**< Největší sampl. */
+        uint16_t rms;       /**< Odmocnina průměru čtverců samplů. */
+    };
+
+    /**
+     * @brief           Spočítá pyramidu wavu a uloží ji do souboru.
+     * @param wave      Wave, bere se rozparsovaná data, pokud jsou, jinak raw data.
+     * @param filename  Jméno souboru.
+     * @return          Vrací false při chybě zápisu.
+     *
+     * Rozparsovaná data se převádějí stejně jako při ukládání, pyramida tedy odpovídá uloženému výstupu.
+     * Položky úrovně 0 se počítají paralelně na poolu vláken, vyšší úrovně se z nich jen slučují.
+     */
+    static bool write(const Wave &wave, const char *filename);
+};
+
+#endif // PEAK_INDEX_H
@@ -0,0 +1,176 @@
+﻿#include "phase_vocoder.h"
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const double Pi = 3.14159265358979323846;
+
+    /* Zabalí úhel do rozsahu [-pi, pi] */
+    inline double wrap(double angle)
+    {
+        return angle - 2 * Pi * std::floor(angle / (2 * Pi) + .5);
+    }
+}
+
+PhaseVocoder::PhaseVocoder(const Options &options) : options(options), hop(options.size / 4)
+{
+    const size_t N = options.size;
+    const size_t bins = N / 2 + 1;
+    window.resize(N);
+    norm = 0;
+    for(size_t n = 0; n != N; ++n)
+    {
+        window[n] = .5 - .5 * cos(2 * Pi * n / N);
+        norm += window[n] * window[n];
+    }
+    /* Okno se použije při analýze i syntéze, v každém bodě výstupu se sečte norm / hop čtverců */
+    norm /= hop;
+    magnitude.resize(bins);
+    phase.resize(bins);
+    lastPhase.resize(bins);
+    synthPhase.resize(bins);
+    peaks.reserve(bins);
+}
+
+size_t PhaseVocoder::outputLength(size_t inputLength, const Options &options)
+{
+    return size_t(inputLength * options.stretch + .5);
+}
+
+void PhaseVocoder::advancePhases(double advance, bool first)
+{
+    const size_t N = options.size;
+    const size_t bins = N / 2 + 1;
+    if(first)
+    {
+        std::copy(phase.begin(), phase.end(), synthPhase.begin());
+        return;
+    }
+
+    /* Špičky jsou lokální maxima amplitudy přes dva sousedy na každou stranu */
+    peaks.clear();
+    for(size_t k = 2; k + 2 < bins; ++k)
+        if(magnitude[k] > magnitude[k - 1] && magnitude[k] >= magnitude[k + 1]
+           && magnitude[k] > magnitude[k - 2] && magnitude[k] >= magnitude[k + 2])
+            peaks.push_back(k);
+
+    /* Fáze se posune podle skutečné frekvence, odhadnuté z odchylky od očekávaného posunu */
+    const double ratio = double(hop) / advance;
+    if(peaks.empty())
+    {
+        for(size_t k = 0; k != bins; ++k)
+        {
+            double omega = 2 * Pi * k / N;
+            double deviation = wrap(phase[k] - lastPhase[k] - omega * advance);
+            synthPhase[k] += (omega * advance + deviation) * ratio;
+        }
+        return;
+    }
+    for(size_t p = 0; p != peaks.size(); ++p)
+    {
+        size_t k = peaks[p];
+        double omega = 2 * Pi * k / N;
+        double deviation = wrap(phase[k] - lastPhase[k] - omega * advance);
+        synthPhase[k] += (omega * advance + deviation) * ratio;
+    }
+
+    /* Ostatní frekvence si zachovají fázový rozdíl vůči nejbližší špičce (hranice oblasti je uprostřed) */
+    size_t p = 0;
+    for(size_t k = 0; k != bins; ++k)
+    {
+        while(p + 1 < peaks.size() && k > (peaks[p] + peaks[p + 1]) / 2)
+            ++p;
+        size_t peak = peaks[p];
+        if(k != peak)
+            synthPhase[k] = synthPhase[peak] + phase[k] - phase[peak];
+    }
+}
+
+void PhaseVocoder::emit(size_t count, ChannelData &out)
+{
+    /* Hotové samply z overlap-add bufferu přejdou do převzorkování, buffer se posune o count.
+     * Samply před začátkem výstupu (od první poloviny prvních rámců) se zahodí. */
+    for(size_t i = 0; i != count; ++i)
+        if(accumulatorBase + long(i) >= 0)
+            pending.push_back(accumulator[i]);
+    accumulatorBase += long(count);
+    std::copy(accumulator.begin() + count, accumulator.end(), accumulator.begin());
+    std::fill(accumulator.end() - count, accumulator.end(), 0.);
+
+    /* Převzorkování o poměr výšky tónu lineární interpolací. Výstup i leží mezi samply j a j + 1. */
+    while(produced < out.size())
+    {
+        double position = produced * options.pitch;
+        size_t j = size_t(position);
+        if(std::min(j + 2, stretchedLength) > pendingBase + pending.size())
+            break;
+        double a = j < stretchedLength ? pending[j - pendingBase] : 0.;
+        double b = j + 1 < stretchedLength ? pending[j + 1 - pendingBase] : 0.;
+        out[produced++] = complex(a + (b - a) * (position - j));
+    }
+
+    /* Samply před posledním použitým už nebudou potřeba */
+    size_t keep = std::min<size_t>(size_t(produced * options.pitch), pendingBase + pending.size());
+    if(keep > pendingBase)
+    {
+        pending.erase(pending.begin(), pending.begin() + (keep - pendingBase));
+        pendingBase = keep;
+    }
+}
+
+void PhaseVocoder::process(const ChannelData &in, ChannelData &out, Workspace &ws)
+{
+    const size_t N = options.size;
+    const size_t bins = N / 2 + 1;
+    const double alpha = options.stretch * options.pitch;
+    const size_t length = in.size();
+    /* Délka po natažení, ze které se pak převzorkuje výška tónu */
+    stretchedLength = size_t(std::ceil(length * alpha));
+    out.resize(outputLength(length, options));
+    produced = 0;
+    pending.clear();
+    pendingBase = 0;
+    accumulator.assign(N, 0.);
+    accumulatorBase = -long(N / 2);
+
+    /* Rámec m má střed v m * hop na výstupu a v m * hop / alpha na vstupu.
+     * Overlap-add buffer vždy začíná na začátku aktuálního rámce. */
+    long lastStart = 0;
+    for(size_t m = 0; m * hop < stretchedLength + N / 2; ++m)
+    {
+        long start = long(std::floor(m * hop / alpha + .5)) - long(N / 2);
+        for(size_t n = 0; n != N; ++n)
+        {
+            long idx = start + long(n);
+            double sample = idx >= 0 && size_t(idx) < length ? in[idx].re() : 0.;
+            ws.block[n] = complex(sample * window[n]);
+        }
+        CFFT::Forward(&ws.block[0], N);
+        for(size_t k = 0; k != bins; ++k)
+        {
+            magnitude[k] = sqrt(ws.block[k].norm());
+            phase[k] = atan2(ws.block[k].im(), ws.block[k].re());
+        }
+
+        advancePhases(double(start - lastStart), m == 0);
+        std::copy(phase.begin(), phase.end(), lastPhase.begin());
+        lastStart = start;
+
+        /* Spektrum s novými fázemi, horní polovina je komplexně sdružená */
+        for(size_t k = 0; k != bins; ++k)
+            ws.block[k] = complex(magnitude[k] * cos(synthPhase[k]), magnitude[k] * sin(synthPhase[k]));
+        for(size_t k = bins; k != N; ++k)
+            ws.block[k] = ws.block[N - k].conjugate();
+        CFFT::Inverse(&ws.block[0], N);
+
+        /* Všechno před začátkem tohoto rámce je hotové */
+        if(m != 0)
+            emit(hop, out);
+        for(size_t n = 0; n != N; ++n)
+            accumulator[n] += ws.block[n].re() * window[n] / norm;
+    }
+    /* Zbytek posledního rámce */
+    emit(N, out);
+}
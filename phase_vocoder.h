@@ -0,0 +1,89 @@
+﻿#ifndef PHASE_VOCODER_H
+#define PHASE_VOCODER_H
+#include "arena.h"
+#include "workspace.h"
+#include <vector>
+
+/**
+ * @brief Fázový vokodér pro změnu tempa a výšky tónu.
+ *
+ * Kanál se rozdělí na rámce s oknem, analytický posun mezi rámci je syntetický posun
+ * vydělený poměrem natažení. Fáze každého rámce se posune podle skutečné frekvence složek
+ * a rámce se sečtou se syntetickým posunem (overlap-add). Fáze jsou zamčené ke špičkám
+ * spektra (identity phase locking), takže se tranzienty a harmonické tolik nerozmazávají.
+ * Změna výšky tónu = natažení o poměr výšky a následné převzorkování zpět na délku,
+ * která odpovídá jen změně tempa.
+ */
+class PhaseVocoder
+{
+public:
+    /**
+     * @brief Nastavení vokodéru.
+     */
+    struct Options
+    {
+        size_t size;        /**< Velikost rámce a FFT, mocnina dvojky. */
+        double stretch;     /**< Poměr délky výstupu ku délce vstupu, 2 = dvakrát pomalejší. */
+        double pitch;       /**< Poměr výšky tónu, 2 = o oktávu výš. */
+
+        Options() : size(4096), stretch(1), pitch(1) {}
+    };
+
+    /**
+     * @brief           Konstruktor, připraví okno a stav pro jeden kanál.
+     * @param options   Nastavení vokodéru.
+     */
+    explicit PhaseVocoder(const Options &options);
+
+    /**
+     * @brief               Délka výstupu pro danou délku vstupu.
+     * @param inputLength   Počet samplů vstupu.
+     * @param options       Nastavení vokodéru.
+     * @return              Vrací počet samplů výstupu.
+     */
+    static size_t outputLength(size_t inputLength, const Options &options);
+
+    /**
+     * @brief           Zpracuje jeden kanál.
+     * @param in        Vstupní samply kanálu, používá se reálná část.
+     * @param[out] out  Výstupní samply, velikost se nastaví podle outputLength().
+     * @param ws        Pracovní prostor vlákna připravený pro velikost rámce.
+     *
+     * Rámce se zpracovávají postupně, mezi nimi se drží jen fáze předchozího rámce
+     * a buffery o velikosti rámce, natažený signál se celý v paměti nedrží.
+     */
+    void process(const ChannelData &in, ChannelData &out, Workspace &ws);
+
+private:
+    /**
+     * @brief           Spočítá syntetické fáze jednoho rámce se zamčením ke špičkám.
+     * @param advance   Analytický posun od předchozího rámce.
+     * @param first     Jestli jde o první rámec, pak se fáze jen převezmou.
+     */
+    void advancePhases(double advance, bool first);
+
+    /**
+     * @brief           Předá hotové samply z overlap-add bufferu do převzorkování.
+     * @param count     Počet samplů ze začátku bufferu, které už žádný další rámec nezmění.
+     * @param[out] out  Výstup, doplní se samply, pro které už jsou k dispozici data.
+     */
+    void emit(size_t count, ChannelData &out);
+
+    Options options;                    /**< Nastavení. */
+    size_t hop;                         /**< Syntetický posun mezi rámci. */
+    double norm;                        /**< Součet čtverců oken v jednom bodě výstupu. */
+    std::vector<double> window;         /**< Hannovo okno. */
+    std::vector<double> magnitude;      /**< Amplitudy aktuálního rámce. */
+    std::vector<double> phase;          /**< Analytické fáze aktuálního rámce. */
+    std::vector<double> lastPhase;      /**< Analytické fáze předchozího rámce. */
+    std::vector<double> synthPhase;     /**< Syntetické fáze, po advancePhases() aktuálního rámce. */
+    std::vector<size_t> peaks;          /**< Indexy špiček aktuálního rámce. */
+    std::vector<double> accumulator;    /**< Overlap-add buffer od začátku aktuálního rámce. */
+    long accumulatorBase;               /**< Pozice začátku bufferu v nataženém signálu. */
+    std::vector<double> pending;        /**< Hotové natažené samply čekající na převzorkování. */
+    size_t pendingBase;                 /**< Pozice prvního samplu v pending. */
+    size_t stretchedLength;             /**< Délka nataženého signálu. */
+    size_t produced;                    /**< Počet hotových výstupních samplů. */
+};
+
+#endif // PHASE_VOCODER_H
@@ -0,0 +1,219 @@
+﻿#include "pipeline.h"
+#include "wave.h"
+#include "activity_map.h"
+#include "alloc_counter.h"
+#include "checkpoint.h"
+#include "data_utility.h"
+#include "spsc_ring.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+void Pipeline::encode(Wave &wave, const std::vector<std::vector<double> > &processed, size_t from, size_t count,
+                      unsigned int attenuation, int percentage)
+{
+    const size_t NumChannels = wave.fchunk.NumChannels;
+    const size_t SizeOfSample = wave.fchunk.BitsPerSample / 8;
+    char *out = wave.dchunk.data + from * NumChannels * SizeOfSample;
+    for(size_t i = from; i != from + count; ++i)
+        for(size_t ch = 0; ch != NumChannels; ++ch, out += SizeOfSample)
+        {
+            /* Stejné operace jako loudnessNormalization(), changeVolumeToPercentage() a composeRange() */
+            complex tmp(processed[ch][i]);
+            if(attenuation)
+                tmp = tmp * attenuation / 100;
+            if(percentage != -1)
+                tmp = tmp * percentage / 100;
+            DataUtility::scaleComplex(tmp,SizeOfSample,true);
+            DataUtility::fromComplexToChars(tmp,SizeOfSample,out);
+        }
+}
+
+bool Pipeline::equalize(Wave &wave, std::vector<double> &preset, int percentage, ActivityMap *activity, Checkpoint *checkpoint)
+{
+    const size_t NumChannels = wave.fchunk.NumChannels;
+    const size_t SizeOfSample = wave.fchunk.BitsPerSample / 8;
+    const size_t SampleRate = wave.fchunk.SampleRate;
+    if(NumChannels == 0 || SizeOfSample < 1 || SizeOfSample > 2 || SampleRate == 0)
+        return false;
+    const size_t FrameSize = NumChannels * SizeOfSample;
+    const size_t samples = wave.dchunk.head.length / FrameSize;
+    if(samples == 0)
+        return false;
+    const size_t count_for_FFT = DataUtility::findNextTo2Exp(SampleRate);
+    const size_t blocks = (samples + SampleRate - 1) / SampleRate;
+    /* Poslední sampl equalizace nemění, stejně jako v equalizeChannel() */
+    const size_t size_of_samples = samples - 1;
+    Wave::padPreset(preset,count_for_FFT);
+    if(activity)
+        activity->reset(NumChannels,blocks);
+
+    /* Pokračování po přerušení: hotové bloky fáze 1 se přeskočí, ve fázi 2 se filtruje jen znovu při kódování */
+    const size_t first = !checkpoint ? 0 : checkpoint->phase() == 1 ? std::min(checkpoint->nextBlock(), blocks) : blocks;
+    const size_t encodeFrom = checkpoint && checkpoint->phase() == 2 ? std::min(checkpoint->nextBlock(), blocks) : 0;
+
+    ThreadPool &pool = ThreadPool::instance();
+    std::vector<Workspace> &workspaces = Workspace::shared();
+    Workspace::prepareAll(workspaces,pool.size(),count_for_FFT);
+
+    /* Výstup filtru se drží celý kvůli případné normalizaci, buffery dekódování se recyklují */
+    std::vector<std::vector<double> > processed(NumChannels, std::vector<double>(samples));
+    std::vector<std::vector<double> > buffers(Depth, std::vector<double>(NumChannels * SampleRate));
+    SpscRing<size_t> empty(Depth);
+    SpscRing<size_t> decoded(Depth);
+    SpscRing<size_t> filtered(Depth);
+    for(size_t b = 0; b != Depth; ++b)
+        empty.push(b);
+    std::atomic<bool> overflow(checkpoint && checkpoint->loudest() > 1);
+    std::atomic<bool> failed(false);
+
+    /* Raw data bloku na double po kanálech, se špičkami pro mapu aktivity */
+    auto decodeBlock = [&](size_t block, double *data) {
+        size_t from = block * SampleRate;
+        size_t count = std::min(SampleRate, samples - from);
+        char *raw = wave.dchunk.data + from * FrameSize;
+        for(size_t i = 0; i != count; ++i)
+            for(size_t ch = 0; ch != NumChannels; ++ch, raw += SizeOfSample)
+            {
+                complex tmp = DataUtility::fromCharsToComplex(raw,SizeOfSample);
+                DataUtility::scaleComplex(tmp,SizeOfSample,false);
+                data[ch * SampleRate + i] = tmp.re();
+            }
+        if(activity)
+            for(size_t ch = 0; ch != NumChannels; ++ch)
+            {
+                double peak = 0;
+                for(size_t i = 0; i != count; ++i)
+                    peak = std::max(peak, std::fabs(data[ch * SampleRate + i]));
+                activity->record(ch,block,peak);
+            }
+    };
+
+    /* Filtr jednoho kanálu bloku do processed, vrací největší sampl kanálu v bloku */
+    auto filterChannel = [&](size_t block, size_t ch, const double *in, Workspace &ws) {
+        size_t from = block * SampleRate;
+        size_t count = std::min(SampleRate, samples - from);
+        size_t count_of_Data = from < size_of_samples ? std::min(SampleRate, size_of_samples - from) : 0;
+        double *out = &processed[ch][from];
+        if(activity && !activity->active(ch,block))
+        {
+            /* Tichý blok projde beze změny */
+            activity->skip(1);
+            std::copy(in, in + count, out);
+            return *std::max_element(out, out + count);
+        }
+        if(count_of_Data)
+        {
+            for(size_t k = 0; k != count_of_Data; ++k)
+                ws.block[k] = complex(in[k]);
+            std::fill(ws.block.begin() + count_of_Data, ws.block.end(), complex(0));
+            CFFT::Forward(&ws.block[0],count_for_FFT);
+            Wave::applyFilter(ws.block,preset,ws.filtered);
+            CFFT::Inverse(&ws.filtered[0],count_for_FFT,true);
+            for(size_t k = 0; k != count_of_Data; ++k)
+                out[k] = ws.filtered[k].re();
+        }
+        std::copy(in + count_of_Data, in + count, out + count_of_Data);
+        return *std::max_element(out, out + count);
+    };
+
+    /* Dekódování: raw data bloku do volného bufferu, filtr špičky uvidí až po předání bufferu */
+    std::thread decoder([&]() {
+        for(size_t block = first; block != blocks; ++block)
+        {
+            size_t buffer;
+            empty.pop(buffer);
+            decodeBlock(block,&buffers[buffer][0]);
+            decoded.push(buffer);
+        }
+    });
+
+    /* Kódování: průběžně, dokud není jasné, že bude potřeba normalizace.
+     * Nulový blok zůstává nulový při jakékoliv hlasitosti a jeho raw data už na místě jsou.
+     * S kontrolními body se hotový blok zapíše do výstupu a postup fáze 1 se uloží i po přetečení. */
+    std::vector<double> progress(blocks);
+    std::thread encoder([&]() {
+        for(size_t block = first; block != blocks; ++block)
+        {
+            size_t done;
+            filtered.pop(done);
+            size_t from = done * SampleRate;
+            size_t count = std::min(SampleRate, samples - from);
+            bool encoded = !overflow.load(std::memory_order_relaxed);
+            if(encoded && !(activity && activity->zero(done)))
+                encode(wave,processed,from,count,0,percentage);
+            if(checkpoint && !failed.load(std::memory_order_relaxed)
+               && ((encoded && !checkpoint->write(wave,from,count)) || !checkpoint->commit(1,done + 1,progress[done])))
+                failed.store(true, std::memory_order_relaxed);
+        }
+    });
+
+    /* FFT filtr v tomto vlákně, kanály bloku paralelně na poolu.
+     * Úloha poolu se vytvoří jednou, blok a buffer čte z proměnných, aby se v cyklu nealokovalo. */
+    double loudest = checkpoint ? checkpoint->loudest() : 0;
+    std::vector<double> channelLoudest(NumChannels);
+    size_t block = first;
+    size_t buffer = 0;
+    const ThreadPool::Task filterBlock = [&](size_t ch, size_t worker) {
+        channelLoudest[ch] = filterChannel(block,ch,&buffers[buffer][ch * SampleRate],workspaces[worker]);
+    };
+    bool warmedUp = false;
+    for(; block != blocks; ++block)
+    {
+        size_t allocations = AllocCounter::count();
+        decoded.pop(buffer);
+        pool.run(NumChannels, filterBlock);
+        empty.push(buffer);
+
+        /* Největší sampl jako v loudnessNormalization(), začíná prvním samplem prvního kanálu */
+        if(block == 0)
+            loudest = processed[0][0];
+        for(size_t ch = 0; ch != NumChannels; ++ch)
+            loudest = std::max(loudest, channelLoudest[ch]);
+        if(loudest > 1)
+            overflow.store(true, std::memory_order_relaxed);
+        progress[block] = loudest;
+        filtered.push(block);
+
+        /* Po prvním bloku už se nesmí alokovat nic */
+        if(warmedUp)
+            AllocCounter::reportSteadyState(AllocCounter::count() - allocations);
+        warmedUp = true;
+    }
+    decoder.join();
+    encoder.join();
+    if(failed || (checkpoint && first != blocks && !checkpoint->commit(1,blocks,loudest,true)))
+        return false;
+
+    /* Přetečení: všechno se zakóduje znovu se ztlumením, bloky paralelně.
+     * Bloky zpracované před přerušením se nejdřív znovu dekódují a filtrují, výsledek je stejný.
+     * S kontrolními body po skupinách, po každé se skupina zapíše a postup uloží. */
+    if(loudest > 1)
+    {
+        unsigned int attenuation = 100 / loudest;
+        const size_t group = checkpoint ? pool.size() * Depth : blocks;
+        std::vector<std::vector<double> > scratch(first ? pool.size() : 0);
+        for(size_t begin = encodeFrom; begin < blocks; begin += group)
+        {
+            size_t groupEnd = std::min(begin + group, blocks);
+            pool.run(groupEnd - begin, [&](size_t k, size_t worker) {
+                size_t block = begin + k;
+                if(block < first)
+                {
+                    scratch[worker].resize(NumChannels * SampleRate);
+                    decodeBlock(block,&scratch[worker][0]);
+                    for(size_t ch = 0; ch != NumChannels; ++ch)
+                        filterChannel(block,ch,&scratch[worker][ch * SampleRate],workspaces[worker]);
+                }
+                if(!activity || !activity->zero(block))
+                    encode(wave,processed,block * SampleRate,std::min(SampleRate, samples - block * SampleRate),attenuation,percentage);
+            });
+            if(checkpoint && (!checkpoint->write(wave,begin * SampleRate,std::min(groupEnd * SampleRate, samples) - begin * SampleRate)
+                              || !checkpoint->commit(2,groupEnd,loudest,groupEnd == blocks)))
+                return false;
+        }
+    }
+    return !checkpoint || checkpoint->finish();
+}
@@ -0,0 +1,63 @@
+﻿#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <cstddef>
+#include <vector>
+
+class Wave;
+class ActivityMap;
+class Checkpoint;
+
+/**
+ * @brief Equalizace rozdělená do tří souběžných fází: dekódování, FFT filtr a kódování.
+ *
+ * Každá fáze běží ve svém vlákně a zpracovává jiný blok (SampleRate samplů ve všech kanálech).
+ * Dekódování převádí raw data na double do jednoho z Depth bufferů, FFT filtr je equalizuje
+ * (kanály paralelně na poolu vláken) a kódování je skládá zpět do raw dat. Fáze si předávají
+ * čísla bufferů a bloků přes fronty SpscRing, použitý buffer se vrací zpět dekódování.
+ * Rozpracovaných je tak nejvýš Depth bloků a i mono soubor využije několik jader.
+ *
+ * Výstup je stejný jako Wave::equalizeWith() s normalizací a následná změna hlasitosti.
+ * Normalizace potřebuje největší sampl celého výstupu: dokud žádný sampl nepřetekl, kóduje se
+ * průběžně, jinak se kódování zastaví a po dokončení filtru se všechno zakóduje znovu se ztlumením.
+ *
+ * S kontrolními body (Checkpoint) se zakódované bloky rovnou zapisují do výstupu a po přerušení
+ * se pokračuje od posledního uloženého bloku. Bloky zpracované před přerušením se při případném
+ * ztlumení filtrují znovu, výstup je tak stejný jako bez přerušení.
+ */
+class Pipeline
+{
+public:
+    /**
+     * @brief   Počet bloků, které mohou být najednou rozpracované.
+     */
+    static const size_t Depth = 4;
+
+    /**
+     * @brief               Equalizuje raw data wavu na místě.
+     * @param wave          Wave s načtenými raw daty, PData se nepoužijí.
+     * @param preset        Preset, doplní se na velikost FFT.
+     * @param percentage    Změna hlasitosti po equalizaci v procentech, nebo -1.
+     * @param activity      Mapa aktivity, nebo 0. Vyplní ji dekódování, tiché bloky kanálů filtr přeskočí
+     *                      a úplně nulové bloky se vůbec nekódují.
+     * @param checkpoint    Otevřený výstup s kontrolními body, nebo 0. Raw data wavu pak po pokračování
+     *                      neobsahují celý výstup, ten je jen v souboru.
+     * @return              Vrací false, pokud wave nemá žádná data, má nepodporovaný formát, nebo selhal zápis výstupu.
+     */
+    static bool equalize(Wave &wave, std::vector<double> &preset, int percentage, ActivityMap *activity = 0,
+                         Checkpoint *checkpoint = 0);
+
+private:
+    /**
+     * @brief               Zakóduje úsek equalizovaných samplů do raw dat.
+     * @param wave          Cílový wave.
+     * @param processed     Equalizované samply po kanálech.
+     * @param from          První sampl.
+     * @param count         Počet samplů.
+     * @param attenuation   Ztlumení z normalizace v procentech, nebo 0.
+     * @param percentage    Změna hlasitosti v procentech, nebo -1.
+     */
+    static void encode(Wave &wave, const std::vector<std::vector<double> > &processed, size_t from, size_t count,
+                       unsigned int attenuation, int percentage);
+};
+
+#endif // PIPELINE_H
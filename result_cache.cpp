@@ -0,0 +1,274 @@
+﻿#include "result_cache.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    /* Reflink sdílí bloky souboru jen do prvního zápisu (copy-on-write), jinak obyčejná kopie */
+    bool cloneFile(const fs::path &from, const fs::path &to, std::error_code &ec)
+    {
+#if defined(__linux__) && defined(FICLONE)
+        int in = ::open(from.c_str(), O_RDONLY);
+        if(in >= 0)
+        {
+            int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool cloned = out >= 0 && ioctl(out, FICLONE, in) == 0;
+            if(out >= 0)
+                ::close(out);
+            ::close(in);
+            if(cloned)
+                return true;
+        }
+#endif
+        return fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+    }
+
+    /* Dočasný soubor v adresáři cache, jméno je jedinečné pro proces i pro každý zápis v něm */
+    fs::path tempPath(const std::string &directory, const std::string &name)
+    {
+        static std::atomic<unsigned int> counter(0);
+        std::ostringstream unique;
+        unique << name << '.' << getpid() << '.' << counter++ << ".tmp";
+        return fs::path(directory) / unique.str();
+    }
+
+    inline uint64_t read64(const unsigned char *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+
+    inline uint64_t mix(uint64_t acc, uint64_t value)
+    {
+        return rotl(acc + value * Prime2, 31) * Prime1;
+    }
+
+    inline uint64_t avalanche(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= Prime2;
+        h ^= h >> 29;
+        h *= Prime3;
+        h ^= h >> 32;
+        return h;
+    }
+}
+
+const char *const ResultCache::EngineVersion = "zapoctak-1";
+
+ResultCache::Hasher::Hasher() : tailSize(0), total(0)
+{
+    lanes[0] = Prime1 + Prime2;
+    lanes[1] = Prime2;
+    lanes[2] = 0;
+    lanes[3] = 0 - Prime1;
+}
+
+void ResultCache::Hasher::stripe(const unsigned char *data)
+{
+    /* Čtyři nezávislé dráhy, aby procesor mohl počítat paralelně */
+    lanes[0] = mix(lanes[0], read64(data));
+    lanes[1] = mix(lanes[1], read64(data + 8));
+    lanes[2] = mix(lanes[2], read64(data + 16));
+    lanes[3] = mix(lanes[3], read64(data + 24));
+}
+
+void ResultCache::Hasher::update(const void *data, size_t size)
+{
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    total += size;
+    /* Nejdřív doplním zbytek z minula */
+    if(tailSize)
+    {
+        size_t fill = std::min(size, sizeof(tail) - tailSize);
+        std::memcpy(tail + tailSize, p, fill);
+        tailSize += fill;
+        p += fill;
+        size -= fill;
+        if(tailSize < sizeof(tail))
+            return;
+        stripe(tail);
+        tailSize = 0;
+    }
+    for(; size >= sizeof(tail); p += sizeof(tail), size -= sizeof(tail))
+        stripe(p);
+    std::memcpy(tail, p, size);
+    tailSize = size;
+}
+
+std::string ResultCache::Hasher::digest() const
+{
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    for(size_t i = 0; i != 4; ++i)
+        h = (h ^ mix(0, lanes[i])) * Prime1 + Prime3;
+    h += total;
+    /* Zbytek dat po Bajtech */
+    for(size_t i = 0; i != tailSize; ++i)
+        h = rotl(h ^ (tail[i] * Prime3), 11) * Prime1;
+
+    /* Dvě různé dokončovací funkce dají 128 bitů */
+    std::ostringstream out;
+    out << std::hex << std::setfill('0') << std::setw(16) << avalanche(h)
+        << std::setw(16) << avalanche(h ^ rotl(lanes[2] ^ lanes[3], 29) ^ Prime2);
+    return out.str();
+}
+
+ResultCache::ResultCache(const std::string &directory, uint64_t maxBytes) : directory(directory), maxBytes(maxBytes), hits(0), lookups(0)
+{
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if(ec)
+        std::cerr << "ERROR: Nelze vytvorit adresar cache: " << directory << std::endl;
+    loadStats();
+}
+
+std::string ResultCache::entryPath(const std::string &key) const
+{
+    return (fs::path(directory) / (key + ".wav")).string();
+}
+
+bool ResultCache::fetch(const std::string &key, const std::string &output)
+{
+    ++lookups;
+    std::error_code ec;
+    std::string entry = entryPath(key);
+    if(!fs::is_regular_file(entry, ec))
+    {
+        saveStats();
+        return false;
+    }
+
+    /* Výstup je samostatný soubor, pozdější zápis do něj (třeba --in-place) záznam nezmění.
+     * Starý výstup se nejdřív smaže, mohl to být hard link ze starší verze. */
+    fs::remove(output, ec);
+    ec.clear();
+    if(!cloneFile(entry, output, ec))
+    {
+        std::cerr << "ERROR: Nelze zkopirovat vystup z cache: " << ec.message() << std::endl;
+        saveStats();
+        return false;
+    }
+
+    /* Čas poslední změny záznamu slouží jako čas posledního použití pro LRU, výstupu se netýká */
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+    ++hits;
+    saveStats();
+    return true;
+}
+
+void ResultCache::store(const std::string &key, const std::string &output)
+{
+    std::error_code ec;
+    /* Zápis přes vlastní dočasný soubor a přejmenování, aby souběžné běhy neviděly polovičatý výstup
+     * a nezapisovaly jeden do druhého */
+    fs::path tmp = tempPath(directory, key);
+    fs::copy_file(output, tmp, ec);
+    if(!ec)
+        fs::rename(tmp, entryPath(key), ec);
+    if(ec)
+    {
+        std::cerr << "ERROR: Nelze ulozit vystup do cache: " << ec.message() << std::endl;
+        fs::remove(tmp, ec);
+        return;
+    }
+    evict();
+}
+
+void ResultCache::evict()
+{
+    struct Entry
+    {
+        fs::path path;
+        fs::file_time_type used;
+        uint64_t size;
+        bool operator<(const Entry &other) const { return used < other.used; }
+    };
+
+    std::error_code ec;
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    for(fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if(it->path().extension() != ".wav" || !it->is_regular_file(ec))
+            continue;
+        Entry e = { it->path(), it->last_write_time(ec), it->file_size(ec) };
+        total += e.size;
+        entries.push_back(e);
+    }
+
+    /* Mažu od nejdéle nepoužitých, dokud se úložiště nevejde do limitu */
+    std::sort(entries.begin(), entries.end());
+    for(size_t i = 0; i != entries.size() && total > maxBytes; ++i)
+    {
+        fs::remove(entries[i].path, ec);
+        if(!ec)
+            total -= entries[i].size;
+    }
+}
+
+void ResultCache::loadStats()
+{
+    std::ifstream in((fs::path(directory) / "stats").string().c_str());
+    if(!(in >> hits >> lookups))
+        hits = lookups = 0;
+}
+
+void ResultCache::saveStats() const
+{
+    std::error_code ec;
+    fs::path stats = fs::path(directory) / "stats";
+    fs::path tmp = tempPath(directory, "stats");
+    {
+        std::ofstream out(tmp.string().c_str());
+        out << hits << ' ' << lookups << std::endl;
+    }
+    fs::rename(tmp, stats, ec);
+    if(ec)
+        fs::remove(tmp, ec);
+}
+
+void ResultCache::printStats(std::ostream &out) const
+{
+    std::error_code ec;
+    uint64_t total = 0;
+    for(fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+        if(it->path().extension() == ".wav")
+            total += it->file_size(ec);
+
+    out << "Cache: " << hits << " zasahu z " << lookups << " hledani ("
+        << std::fixed << std::setprecision(1) << (lookups ? 100. * hits / lookups : 0.) << " %), "
+        << total / (1024. * 1024) << " / " << maxBytes / (1024. * 1024) << " MB" << std::endl;
+}
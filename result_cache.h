@@ -0,0 +1,102 @@
+﻿#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+/**
+ * @brief Diskové úložiště již spočítaných výstupů.
+ *
+ * Výstupní WAV se uloží do adresáře pod jménem odvozeným z hashe všeho, co výstup ovlivňuje
+ * (data a FMT chunk vstupu, preset, změna hlasitosti, normalizace a verze zpracování).
+ * Při dalším spuštění se stejnými vstupy se výstup jen zkopíruje (kde to jde, reflinkem) a zpracování
+ * se úplně přeskočí. Velikost adresáře je omezená, nejdéle nepoužité výstupy se mažou.
+ */
+class ResultCache
+{
+public:
+    /**
+     * @brief Rychlý 128bitový hash pro klíč výstupu.
+     *
+     * Data zpracovává po 32 Bajtech ve čtyřech nezávislých drahách, takže hashování
+     * dat chunku běží rychlostí čtení z paměti.
+     */
+    class Hasher
+    {
+    public:
+        Hasher();
+
+        /**
+         * @brief       Přidá data do hashe.
+         * @param data  Ukazatel na data.
+         * @param size  Velikost dat v Bajtech.
+         */
+        void update(const void *data, size_t size);
+
+        /**
+         * @brief       Přidá hodnotu do hashe.
+         * @param value Hodnota libovolného jednoduchého typu.
+         */
+        template<typename T> void add(const T &value) { update(&value, sizeof(T)); }
+
+        /**
+         * @brief   Dokončí výpočet.
+         * @return  Vrací hash jako 32 hexadecimálních znaků.
+         */
+        std::string digest() const;
+
+    private:
+        uint64_t lanes[4];      /**< Stav jednotlivých drah. */
+        unsigned char tail[32]; /**< Nezpracovaný zbytek dat. */
+        size_t tailSize;        /**< Velikost nezpracovaného zbytku. */
+        uint64_t total;         /**< Celková velikost zpracovaných dat. */
+
+        void stripe(const unsigned char *data);
+    };
+
+    /**
+     * @brief Verze zpracování, musí se změnit při každé změně výstupu programu.
+     */
+    static const char *const EngineVersion;
+
+    /**
+     * @brief               Konstruktor.
+     * @param directory     Adresář úložiště, vytvoří se, pokud neexistuje.
+     * @param maxBytes      Maximální velikost úložiště v Bajtech.
+     */
+    ResultCache(const std::string &directory, uint64_t maxBytes);
+
+    /**
+     * @brief           Zkusí najít výstup podle klíče a umístit ho na místo výstupu.
+     * @param key       Klíč z Hasher::digest().
+     * @param output    Cesta k výstupnímu souboru.
+     * @return          Vrací true, pokud byl výstup nalezen a vytvořen.
+     */
+    bool fetch(const std::string &key, const std::string &output);
+
+    /**
+     * @brief           Uloží výstup pod daným klíčem a případně uvolní místo.
+     * @param key       Klíč z Hasher::digest().
+     * @param output    Cesta k hotovému výstupnímu souboru.
+     */
+    void store(const std::string &key, const std::string &output);
+
+    /**
+     * @brief   Vypíše řádek se statistikou úspěšnosti úložiště.
+     * @param out Výstupní stream.
+     */
+    void printStats(std::ostream &out) const;
+
+private:
+    std::string directory;  /**< Adresář úložiště. */
+    uint64_t maxBytes;      /**< Maximální velikost úložiště. */
+    uint64_t hits;          /**< Počet nalezených výstupů za celou historii úložiště. */
+    uint64_t lookups;       /**< Počet hledání za celou historii úložiště. */
+
+    std::string entryPath(const std::string &key) const;
+    void loadStats();
+    void saveStats() const;
+    void evict();
+};
+
+#endif // RESULT_CACHE_H
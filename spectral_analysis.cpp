@@ -0,0 +1,191 @@
+﻿#include "spectral_analysis.h"
+#include "thread_pool.h"
+#include "workspace.h"
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+namespace
+{
+    /* Středy oktávových pásem podle ISO 266 */
+    const double bandCenters[] = { 31.5, 63, 125, 250, 500, 1000, 2000, 4000, 8000, 16000 };
+    const size_t bandCount = sizeof(bandCenters) / sizeof(bandCenters[0]);
+
+    /* Počet rámců, které si vlákno bere najednou */
+    const size_t framesPerTask = 16;
+}
+
+bool SpectralAnalysis::windowFromName(const std::string &name, WindowType &type)
+{
+    if(name == "rect")
+        type = Rectangular;
+    else if(name == "hann")
+        type = Hann;
+    else if(name == "hamming")
+        type = Hamming;
+    else if(name == "blackman")
+        type = Blackman;
+    else
+        return false;
+    return true;
+}
+
+std::vector<double> SpectralAnalysis::makeWindow(WindowType type, size_t size)
+{
+    const double pi = 3.14159265358979323846;
+    std::vector<double> window(size, 1.);
+    /* Periodická okna, aby se při posunu o zlomek velikosti správně sčítala */
+    for(size_t i = 0; i != size; ++i)
+    {
+        double x = 2 * pi * i / size;
+        switch(type)
+        {
+        case Hann:
+            window[i] = 0.5 - 0.5 * cos(x);
+            break;
+        case Hamming:
+            window[i] = 0.54 - 0.46 * cos(x);
+            break;
+        case Blackman:
+            window[i] = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+            break;
+        default:
+            break;
+        }
+    }
+    return window;
+}
+
+void SpectralAnalysis::writeNpyHeader(std::ostream &out, const std::vector<size_t> &shape)
+{
+    std::ostringstream dict;
+    dict << "{'descr': '<f4', 'fortran_order': False, 'shape': (";
+    for(size_t i = 0; i != shape.size(); ++i)
+        dict << shape[i] << (shape.size() == 1 || i + 1 != shape.size() ? ", " : "");
+    dict << "), }";
+    std::string header = dict.str();
+    /* Magic (6) + verze (2) + délka hlavičky (2) + hlavička zakončená \n, celkem zarovnáno na 64 Bajtů */
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header.push_back('\n');
+
+    unsigned short length = static_cast<unsigned short>(header.size());
+    out.write("\x93NUMPY\x01\x00", 8);
+    char len[2] = { char(length & 0xff), char((length >> 8) & 0xff) };
+    out.write(len, 2);
+    out.write(header.data(), header.size());
+}
+
+bool SpectralAnalysis::analyze(const Wave &wave, const Options &options, const char *filename)
+{
+    const size_t N = options.size;
+    if(N < 2 || N & (N - 1) || options.hop == 0)
+    {
+        std::cerr << "ERROR: Velikost FFT musi byt mocnina dvojky a posun nenulovy." << std::endl;
+        return false;
+    }
+
+    const size_t NumChannels = wave.fchunk.NumChannels;
+    const size_t NumberOfSamples = wave.PData[0].size();
+    const size_t bins = N / 2 + 1;
+    const size_t frames = NumberOfSamples <= N ? 1 : 1 + (NumberOfSamples - N + options.hop - 1) / options.hop;
+    const double binWidth = double(wave.fchunk.SampleRate) / N;
+
+    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+    if(!out.is_open())
+    {
+        std::cerr << "ERROR: Nelze otevrit soubor pro analyzu: " << filename << std::endl;
+        return false;
+    }
+    std::vector<size_t> shape;
+    shape.push_back(NumChannels);
+    shape.push_back(frames);
+    shape.push_back(bins);
+    writeNpyHeader(out, shape);
+
+    /* Okno a jeho součet pro převod na amplitudy */
+    std::vector<double> window = makeWindow(options.window, N);
+    double windowSum = 0;
+    for(size_t i = 0; i != N; ++i)
+        windowSum += window[i];
+
+    /* Přiřazení frekvencí do oktávových pásem, frekvence mimo pásma mají index bandCount */
+    std::vector<size_t> bandOfBin(bins, bandCount);
+    for(size_t k = 0; k != bins; ++k)
+        for(size_t b = 0; b != bandCount; ++b)
+            if(k * binWidth >= bandCenters[b] / sqrt(2.) && k * binWidth < bandCenters[b] * sqrt(2.))
+                bandOfBin[k] = b;
+
+    ThreadPool &pool = ThreadPool::instance();
+    std::vector<Workspace> workspaces;
+    Workspace::prepareAll(workspaces, pool.size(), N);
+
+    /* Výstup se počítá po dávkách rámců, aby paměť nerostla s délkou souboru */
+    const size_t framesPerBatch = framesPerTask * pool.size() * 4;
+    std::vector<float> magnitudes(framesPerBatch * bins);
+    std::vector<double> frameEnergy(framesPerBatch * bandCount);
+    std::vector<double> energy(NumChannels * bandCount, 0.);
+
+    for(size_t ch = 0; ch != NumChannels; ++ch)
+    {
+        const ChannelData &channel = wave.PData[ch];
+        for(size_t first = 0; first < frames; first += framesPerBatch)
+        {
+            const size_t count = std::min(framesPerBatch, frames - first);
+            const size_t tasks = (count + framesPerTask - 1) / framesPerTask;
+            pool.run(tasks, [&](size_t task, size_t worker) {
+                std::vector<complex> &block = workspaces[worker].block;
+                for(size_t f = task * framesPerTask; f < count && f < (task + 1) * framesPerTask; ++f)
+                {
+                    /* Načtu rámec, vynásobím oknem a doplním nulami za koncem kanálu */
+                    size_t from = (first + f) * options.hop;
+                    for(size_t i = 0; i != N; ++i)
+                        block[i] = from + i < NumberOfSamples ? complex(channel[from + i].re() * window[i]) : complex(0);
+                    CFFT::Forward(&block[0], N);
+
+                    float *mag = &magnitudes[f * bins];
+                    double *bandEnergy = &frameEnergy[f * bandCount];
+                    std::fill(bandEnergy, bandEnergy + bandCount, 0.);
+                    for(size_t k = 0; k != bins; ++k)
+                    {
+                        /* Jednostranné amplitudové spektrum */
+                        double a = sqrt(block[k].norm()) / windowSum * (k == 0 || k == N / 2 ? 1 : 2);
+                        mag[k] = static_cast<float>(a);
+                        if(bandOfBin[k] != bandCount)
+                            bandEnergy[bandOfBin[k]] += a * a;
+                    }
+                }
+            });
+
+            out.write(reinterpret_cast<const char*>(&magnitudes[0]), count * bins * sizeof(float));
+            /* Sčítání energie sériově, aby výsledek nezávisel na počtu vláken */
+            for(size_t f = 0; f != count; ++f)
+                for(size_t b = 0; b != bandCount; ++b)
+                    energy[ch * bandCount + b] += frameEnergy[f * bandCount + b];
+        }
+    }
+    out.close();
+
+    /* Souhrn energie v pásmech: průměrný výkon na rámec a jeho hodnota v dB */
+    std::string bandsName = filename;
+    if(bandsName.size() > 4 && bandsName.compare(bandsName.size() - 4, 4, ".npy") == 0)
+        bandsName.erase(bandsName.size() - 4);
+    bandsName += ".bands.csv";
+    std::ofstream bands(bandsName.c_str());
+    bands << "channel,center_hz,low_hz,high_hz,mean_power,mean_db" << std::endl;
+    for(size_t ch = 0; ch != NumChannels; ++ch)
+        for(size_t b = 0; b != bandCount; ++b)
+        {
+            double power = energy[ch * bandCount + b] / frames;
+            bands << ch << ',' << bandCenters[b] << ',' << bandCenters[b] / sqrt(2.) << ','
+                  << bandCenters[b] * sqrt(2.) << ',' << power << ','
+                  << (power > 0 ? 10 * log10(power) : -200.) << std::endl;
+        }
+
+    if(!out || !bands)
+    {
+        std::cerr << "ERROR: Zapis analyzy selhal." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+﻿#ifndef SPECTRAL_ANALYSIS_H
+#define SPECTRAL_ANALYSIS_H
+#include "wave.h"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Spektrální analýza wavu pomocí krátkodobé Fourierovy transformace (STFT).
+ *
+ * Rozdělí každý kanál na překrývající se rámce, každý rámec vynásobí oknem,
+ * pošle do dopředné FFT a uloží amplitudy frekvencí. Výsledek se zapíše do souboru
+ * ve formátu .npy (float32, tvar [kanály, rámce, frekvence]) a k němu se do souboru
+ * s příponou .bands.csv zapíše souhrn energie v oktávových pásmech.
+ */
+class SpectralAnalysis
+{
+public:
+    /**
+     * @brief Typ okna, kterým se násobí rámec před FFT.
+     */
+    enum WindowType
+    {
+        Rectangular,
+        Hann,
+        Hamming,
+        Blackman
+    };
+
+    /**
+     * @brief Nastavení analýzy.
+     */
+    struct Options
+    {
+        size_t size;        /**< Velikost rámce a FFT, musí být mocnina dvojky. */
+        size_t hop;         /**< Posun mezi začátky sousedních rámců. */
+        WindowType window;  /**< Typ okna. */
+
+        Options() : size(2048), hop(512), window(Hann) {}
+    };
+
+    /**
+     * @brief           Převede jméno okna na typ.
+     * @param name      Jméno okna (rect, hann, hamming, blackman).
+     * @param[out] type Typ okna.
+     * @return          Vrací false, pokud jméno neodpovídá žádnému oknu.
+     */
+    static bool windowFromName(const std::string &name, WindowType &type);
+
+    /**
+     * @brief           Provede analýzu a zapíše výsledky.
+     * @param wave      Wave, jehož rozparsovaná data se analyzují.
+     * @param options   Nastavení analýzy.
+     * @param filename  Jméno výstupního .npy souboru.
+     * @return          Vrací, jestli nenastala chyba.
+     *
+     * Rámce každého kanálu se zpracovávají paralelně na globálním poolu vláken.
+     */
+    static bool analyze(const Wave &wave, const Options &options, const char *filename);
+
+private:
+    /**
+     * @brief           Vytvoří koeficienty okna.
+     * @param type      Typ okna.
+     * @param size      Délka okna.
+     * @return          Vrací vektor koeficientů.
+     */
+    static std::vector<double> makeWindow(WindowType type, size_t size);
+
+    /**
+     * @brief           Zapíše hlavičku .npy souboru.
+     * @param out       Výstupní stream.
+     * @param shape     Rozměry pole.
+     */
+    static void writeNpyHeader(std::ostream &out, const std::vector<size_t> &shape);
+};
+
+#endif // SPECTRAL_ANALYSIS_H
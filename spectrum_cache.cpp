@@ -0,0 +1,132 @@
+﻿#include "spectrum_cache.h"
+#include <cstring>
+#include <filesystem>
+
+namespace
+{
+    const uint32_t FormatVersion = 1;
+}
+
+SpectrumCache::SpectrumCache(const std::string &input, const std::string &filename) : input(input), filename(filename), bins(0), dataOffset(0), loaded(false)
+{
+    std::memset(&header, 0, sizeof(Header));
+}
+
+size_t SpectrumCache::blockCount(size_t samples, size_t blockSize)
+{
+    /* Equalizace zpracovává samply [0, samples-1), stejně jako smyčka v Wave::equalizeChannel */
+    return samples < 2 ? 0 : (samples - 1 + blockSize - 1) / blockSize;
+}
+
+bool SpectrumCache::inputInfo(uint64_t &size, int64_t &time) const
+{
+    std::error_code ec;
+    size = std::filesystem::file_size(input, ec);
+    if(ec)
+        return false;
+    time = std::filesystem::last_write_time(input, ec).time_since_epoch().count();
+    return !ec;
+}
+
+bool SpectrumCache::open()
+{
+    loaded = false;
+    if(!file.open(filename) || file.size() < sizeof(Header))
+    {
+        file.close();
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(Header));
+    bins = header.countForFFT / 2 + 1;
+    dataOffset = (sizeof(Header) + header.numChannels * 2 * sizeof(double) + 63) / 64 * 64;
+
+    /* Soubor musí být dokončený, stejné verze, patřit k nezměněnému vstupu a mít správnou velikost */
+    uint64_t size;
+    int64_t time;
+    if(std::memcmp(header.magic, "ZSPC", 4) != 0 || header.version != FormatVersion || !inputInfo(size, time)
+       || size != header.inputSize || time != header.inputTime
+       || file.size() != dataOffset + header.numChannels * header.blocks * bins * 2 * sizeof(float))
+    {
+        file.close();
+        return false;
+    }
+    loaded = true;
+    return true;
+}
+
+bool SpectrumCache::create(const Wave::FmtChunk &fmt, size_t samples, size_t countForFFT)
+{
+    loaded = false;
+    std::memset(&header, 0, sizeof(Header));
+    header.version = FormatVersion;
+    if(!inputInfo(header.inputSize, header.inputTime))
+        return false;
+    header.numChannels = fmt.NumChannels;
+    header.sampleRate = fmt.SampleRate;
+    header.countForFFT = countForFFT;
+    header.samples = samples;
+    header.blocks = blockCount(samples, fmt.SampleRate);
+    bins = countForFFT / 2 + 1;
+    dataOffset = (sizeof(Header) + header.numChannels * 2 * sizeof(double) + 63) / 64 * 64;
+
+    if(!file.create(filename, dataOffset + header.numChannels * header.blocks * bins * 2 * sizeof(float)))
+    {
+        std::cerr << "ERROR: Nelze vytvorit soubor se spektry: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SpectrumCache::finish()
+{
+    if(!isRecording())
+        return false;
+    /* Hlavička se zapíše až nakonec, nedokončený soubor tak nikdy neprojde kontrolou */
+    std::memcpy(header.magic, "ZSPC", 4);
+    std::memcpy(file.data(), &header, sizeof(Header));
+    bool ok = file.flush();
+    file.close();
+    return ok;
+}
+
+float* SpectrumCache::blockData(size_t channel, size_t block) const
+{
+    return reinterpret_cast<float*>(file.data() + dataOffset) + (channel * header.blocks + block) * bins * 2;
+}
+
+double* SpectrumCache::tailData() const
+{
+    return reinterpret_cast<double*>(file.data() + sizeof(Header));
+}
+
+void SpectrumCache::storeBlock(size_t channel, size_t block, const std::vector<complex> &spectrum)
+{
+    float *out = blockData(channel, block);
+    for(size_t k = 0; k != bins; ++k)
+    {
+        out[2 * k] = static_cast<float>(spectrum[k].re());
+        out[2 * k + 1] = static_cast<float>(spectrum[k].im());
+    }
+}
+
+void SpectrumCache::loadBlock(size_t channel, size_t block, std::vector<complex> &spectrum) const
+{
+    const float *in = blockData(channel, block);
+    const size_t N = header.countForFFT;
+    for(size_t k = 0; k != bins; ++k)
+        spectrum[k] = complex(in[2 * k], in[2 * k + 1]);
+    /* Spektrum reálného signálu je symetrické: X[N-k] = X[k]* */
+    for(size_t k = bins; k < N; ++k)
+        spectrum[k] = spectrum[N - k].conjugate();
+}
+
+void SpectrumCache::storeTail(size_t channel, const complex &sample)
+{
+    tailData()[2 * channel] = sample.re();
+    tailData()[2 * channel + 1] = sample.im();
+}
+
+complex SpectrumCache::tail(size_t channel) const
+{
+    return complex(tailData()[2 * channel], tailData()[2 * channel + 1]);
+}
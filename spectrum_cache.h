@@ -0,0 +1,128 @@
+﻿#ifndef SPECTRUM_CACHE_H
+#define SPECTRUM_CACHE_H
+#include "wave.h"
+#include "mapped_file.h"
+#include <string>
+
+/**
+ * @brief Soubor s uloženými spektry bloků pro rychlou opakovanou equalizaci.
+ *
+ * Při ladění presetu se stejný vstup equalizuje pořád dokola a přitom se vždy znovu
+ * parsují data a počítá dopředná FFT každého bloku, i když na presetu nezávisí.
+ * Tato třída uloží spektra všech bloků vedle vstupu (float32, jen polovina spektra,
+ * protože vstup je reálný a druhá polovina je komplexně sdružená) a při dalším běhu
+ * je namapuje do paměti, takže zbývá jen aplikovat filtr a inverzní FFT.
+ *
+ * Soubor je platný, jen pokud se vstup od jeho vytvoření nezměnil (velikost a čas změny).
+ */
+class SpectrumCache
+{
+public:
+    /**
+     * @brief           Konstruktor.
+     * @param input     Cesta ke vstupnímu WAV souboru.
+     * @param filename  Cesta k souboru se spektry.
+     */
+    SpectrumCache(const std::string &input, const std::string &filename);
+
+    /**
+     * @brief   Namapuje existující soubor se spektry a ověří, že patří k aktuálnímu vstupu.
+     * @return  Vrací true, pokud lze spektra použít.
+     */
+    bool open();
+
+    /**
+     * @brief               Vytvoří nový soubor pro ukládání spekter.
+     * @param fmt           FMT chunk vstupu.
+     * @param samples       Počet samplů v kanálu.
+     * @param countForFFT   Velikost FFT.
+     * @return              Vrací, jestli se soubor podařilo vytvořit.
+     */
+    bool create(const Wave::FmtChunk &fmt, size_t samples, size_t countForFFT);
+
+    /**
+     * @brief   Zapíše hlavičku a uloží soubor na disk. Do té doby se soubor nepovažuje za platný.
+     * @return  Vrací, jestli zápis proběhl v pořádku.
+     */
+    bool finish();
+
+    /**
+     * @brief   Zjistí, jestli jsou spektra načtená z platného souboru.
+     */
+    bool isLoaded() const { return loaded; }
+
+    /**
+     * @brief   Zjistí, jestli se do souboru právě ukládá.
+     */
+    bool isRecording() const { return file.isOpen() && !loaded; }
+
+    /**
+     * @brief               Uloží spektrum bloku.
+     * @param channel       Číslo kanálu.
+     * @param block         Pořadí bloku v kanálu.
+     * @param spectrum      Celé spektrum bloku z dopředné FFT.
+     */
+    void storeBlock(size_t channel, size_t block, const std::vector<complex> &spectrum);
+
+    /**
+     * @brief               Načte spektrum bloku a doplní jeho zrcadlovou polovinu.
+     * @param channel       Číslo kanálu.
+     * @param block         Pořadí bloku v kanálu.
+     * @param[out] spectrum Celé spektrum bloku, velikost musí být alespoň velikost FFT.
+     */
+    void loadBlock(size_t channel, size_t block, std::vector<complex> &spectrum) const;
+
+    /**
+     * @brief           Uloží poslední sampl kanálu, který equalizace nemění.
+     * @param channel   Číslo kanálu.
+     * @param sample    Hodnota samplu.
+     */
+    void storeTail(size_t channel, const complex &sample);
+
+    /**
+     * @brief           Vrátí uložený poslední sampl kanálu.
+     * @param channel   Číslo kanálu.
+     * @return          Vrací hodnotu samplu.
+     */
+    complex tail(size_t channel) const;
+
+    /**
+     * @brief               Spočítá počet bloků, na které equalizace rozdělí kanál.
+     * @param samples       Počet samplů v kanálu.
+     * @param blockSize     Velikost bloku (SampleRate).
+     * @return              Vrací počet bloků.
+     */
+    static size_t blockCount(size_t samples, size_t blockSize);
+
+private:
+    /**
+     * @brief Hlavička souboru se spektry.
+     */
+    struct Header
+    {
+        char magic[4];          /**< "ZSPC", zapisuje se až po uložení všech spekter. */
+        uint32_t version;       /**< Verze formátu. */
+        uint64_t inputSize;     /**< Velikost vstupního souboru. */
+        int64_t inputTime;      /**< Čas poslední změny vstupního souboru. */
+        uint32_t numChannels;   /**< Počet kanálů. */
+        uint32_t sampleRate;    /**< Vzorkovací frekvence, zároveň velikost bloku. */
+        uint32_t countForFFT;   /**< Velikost FFT. */
+        uint32_t reserved;      /**< Zarovnání. */
+        uint64_t samples;       /**< Počet samplů v kanálu. */
+        uint64_t blocks;        /**< Počet bloků v kanálu. */
+    };
+
+    bool inputInfo(uint64_t &size, int64_t &time) const;
+    float* blockData(size_t channel, size_t block) const;
+    double* tailData() const;
+
+    std::string input;      /**< Cesta ke vstupu. */
+    std::string filename;   /**< Cesta k souboru se spektry. */
+    MappedFile file;        /**< Namapovaný soubor. */
+    Header header;          /**< Kopie hlavičky. */
+    size_t bins;            /**< Počet uložených frekvencí bloku. */
+    uint64_t dataOffset;    /**< Začátek spekter v souboru. */
+    bool loaded;            /**< Jestli jsou spektra načtená. */
+};
+
+#endif // SPECTRUM_CACHE_H
@@ -0,0 +1,140 @@
+﻿#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fronta bez zámků pro jednoho zapisovatele a jednoho čtenáře.
+ *
+ * Kapacita je pevná mocnina dvojky. Zapisovatel mění jen head, čtenář jen tail, každý index
+ * leží ve vlastní cache line. Plná fronta brzdí zapisovatele (backpressure), takže mezi
+ * vlákny nikdy neleží víc než capacity položek.
+ *
+ * push() a pop() na plné, respektive prázdné frontě chvíli zkouší znovu a pak usnou na
+ * podmínkové proměnné. Druhá strana je vzbudí jen tehdy, když někdo čeká, rychlá cesta
+ * tak zůstává bez zámků.
+ */
+template<class T>
+class SpscRing
+{
+public:
+    /**
+     * @brief           Konstruktor.
+     * @param capacity  Kapacita, zaokrouhlí se nahoru na mocninu dvojky.
+     */
+    explicit SpscRing(size_t capacity) : head(0), tail(0), waiting(0)
+    {
+        size_t size = 1;
+        while(size < capacity)
+            size <<= 1;
+        items.resize(size);
+        mask = size - 1;
+    }
+
+    /**
+     * @brief       Vloží položku, pokud je místo.
+     * @param item  Položka.
+     * @return      Vrací false, pokud je fronta plná.
+     */
+    bool tryPush(const T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h - tail.load(std::memory_order_acquire) == items.size())
+            return false;
+        items[h & mask] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief           Vyjme položku, pokud nějaká je.
+     * @param[out] item Položka.
+     * @return          Vrací false, pokud je fronta prázdná.
+     */
+    bool tryPop(T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(head.load(std::memory_order_acquire) == t)
+            return false;
+        item = items[t & mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief       Vloží položku, při plné frontě počká.
+     * @param item  Položka.
+     */
+    void push(const T &item)
+    {
+        block([&]() { return tryPush(item); });
+    }
+
+    /**
+     * @brief           Vyjme položku, při prázdné frontě počká.
+     * @param[out] item Položka.
+     */
+    void pop(T &item)
+    {
+        block([&]() { return tryPop(item); });
+    }
+
+private:
+    /**
+     * @brief   Kolikrát se operace zkusí znovu, než vlákno usne.
+     */
+    static const unsigned int Spins = 64;
+
+    /**
+     * @brief           Opakuje operaci, dokud se nepovede, po Spins pokusech vlákno usne.
+     * @param attempt   Pokus o operaci.
+     */
+    template<class F>
+    void block(F attempt)
+    {
+        for(unsigned int i = 0; !attempt(); ++i)
+        {
+            if(i != Spins)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            waiting.fetch_add(1);
+            /* Spolu s bariérou ve wake(): buď druhá strana uvidí čekatele, nebo pokus uvidí její změnu */
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            ready.wait(lock, attempt);
+            waiting.fetch_sub(1);
+            break;
+        }
+        wake();
+    }
+
+    /**
+     * @brief   Vzbudí druhou stranu, pokud čeká.
+     */
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiting.load(std::memory_order_relaxed))
+        {
+            /* Zámek zaručí, že čekatel už podmínku vyhodnotil a spí */
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.notify_all();
+        }
+    }
+
+    std::vector<T> items;                   /**< Položky. */
+    size_t mask;                            /**< Kapacita - 1. */
+    alignas(64) std::atomic<size_t> head;   /**< Počet vložených položek, mění jen zapisovatel. */
+    alignas(64) std::atomic<size_t> tail;   /**< Počet vyjmutých položek, mění jen čtenář. */
+    alignas(64) std::atomic<int> waiting;   /**< Počet spících vláken. */
+    std::mutex mutex;                       /**< Zámek pro uspání. */
+    std::condition_variable ready;          /**< Buzení spících vláken. */
+};
+
+#endif // SPSC_RING_H
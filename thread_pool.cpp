@@ -0,0 +1,114 @@
+﻿#include "thread_pool.h"
+#include <algorithm>
+
+namespace
+{
+    /* Příznak, že aktuální vlákno právě zpracovává kus nějaké úlohy */
+    thread_local bool insideTask = false;
+}
+
+ThreadPool::ThreadPool(size_t threads) : task(0), count(0), next(0), running(0), generation(0), active(1), stop(false)
+{
+    if(threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if(threads == 0)
+        threads = 1;
+    /* Volající vlákno je vlákno číslo 0, pomocných je tedy o jedno méně */
+    for(size_t i = 1; i < threads; ++i)
+        workers.push_back(std::thread(&ThreadPool::loop, this, i));
+    active = workers.size() + 1;
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for(size_t i = 0; i != workers.size(); ++i)
+        workers[i].join();
+}
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::setActive(size_t threads)
+{
+    std::lock_guard<std::mutex> runLock(runMutex);
+    std::lock_guard<std::mutex> lock(mutex);
+    active = threads == 0 ? capacity() : std::min(threads, capacity());
+}
+
+void ThreadPool::run(size_t count, const Task &task)
+{
+    /* Vnořené volání z úlohy, nebo pool bez aktivních pomocných vláken, se zpracuje sériově */
+    if(insideTask || active < 2 || count < 2)
+    {
+        for(size_t i = 0; i != count; ++i)
+            task(i, 0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> runLock(runMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        this->count = count;
+        this->next = 0;
+        this->running = workers.size();
+        ++this->generation;
+    }
+    wake.notify_all();
+
+    /* Volající vlákno pracuje také */
+    work(0);
+
+    /* Počká, až všechna pomocná vlákna dokončí své kusy */
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return running == 0; });
+    this->task = 0;
+}
+
+void ThreadPool::work(size_t worker)
+{
+    insideTask = true;
+    for(;;)
+    {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(next >= count)
+                break;
+            index = next++;
+        }
+        (*task)(index, worker);
+    }
+    insideTask = false;
+}
+
+void ThreadPool::loop(size_t worker)
+{
+    size_t seen = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return stop || generation != seen; });
+            if(stop)
+                return;
+            seen = generation;
+        }
+        /* Neaktivní vlákno jen potvrdí, že nic nezpracovává */
+        if(worker < active)
+            work(worker);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --running;
+        }
+        done.notify_one();
+    }
+}
@@ -0,0 +1,103 @@
+﻿#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Jednoduchý pool vláken pro paralelní zpracování úloh.
+ *
+ * Vlákna se vytvoří jednou a pak se znovu používají pro každou úlohu.
+ * Úloha je rozdělena na count nezávislých kusů, které si vlákna postupně berou.
+ * Každé vlákno má své číslo (worker), podle kterého si může vybrat svůj
+ * předalokovaný pracovní prostor.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @brief   Funkce zpracovávající jeden kus úlohy.
+     *
+     * První parametr je index kusu, druhý je číslo vlákna v rozsahu [0, size()).
+     */
+    typedef std::function<void(size_t index, size_t worker)> Task;
+
+    /**
+     * @brief           Konstruktor.
+     * @param threads   Počet vláken, 0 znamená podle počtu jader.
+     */
+    explicit ThreadPool(size_t threads = 0);
+
+    /**
+     * @brief   Destruktor, počká na ukončení všech vláken.
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief   Počet vláken, která zpracovávají úlohy.
+     * @return  Vrací počet aktivních vláken včetně volajícího.
+     */
+    size_t size() const { return active; }
+
+    /**
+     * @brief   Počet vytvořených vláken, nejvyšší možný počet aktivních.
+     * @return  Vrací počet vláken včetně volajícího.
+     */
+    size_t capacity() const { return workers.size() + 1; }
+
+    /**
+     * @brief           Omezí počet vláken, která zpracovávají úlohy. Nesmí se volat během úlohy.
+     * @param threads   Počet aktivních vláken včetně volajícího, 0 znamená všechna.
+     *
+     * Ostatní vlákna zůstanou vytvořená, jen si nebudou brát kusy úloh.
+     */
+    void setActive(size_t threads);
+
+    /**
+     * @brief       Spustí úlohu a počká na její dokončení.
+     * @param count Počet kusů úlohy.
+     * @param task  Funkce, která se zavolá pro každý kus.
+     *
+     * Volající vlákno se do zpracování také zapojí jako vlákno číslo 0.
+     */
+    void run(size_t count, const Task &task);
+
+    /**
+     * @brief   Sdílený pool vláken pro celý program.
+     * @return  Vrací odkaz na globální pool.
+     */
+    static ThreadPool& instance();
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    /**
+     * @brief           Zpracovává kusy aktuální úlohy, dokud nějaké zbývají.
+     * @param worker    Číslo vlákna.
+     */
+    void work(size_t worker);
+
+    /**
+     * @brief           Hlavní smyčka pomocného vlákna.
+     * @param worker    Číslo vlákna.
+     */
+    void loop(size_t worker);
+
+    std::vector<std::thread> workers;   /**< Pomocná vlákna. */
+    std::mutex mutex;                   /**< Zámek chránící stav úlohy. */
+    std::mutex runMutex;                /**< Zámek, aby běžela vždy jen jedna úloha. */
+    std::condition_variable wake;       /**< Probouzí vlákna při nové úloze. */
+    std::condition_variable done;       /**< Oznamuje dokončení úlohy. */
+    const Task *task;                   /**< Aktuální úloha. */
+    size_t count;                       /**< Počet kusů aktuální úlohy. */
+    size_t next;                        /**< Index dalšího nezpracovaného kusu. */
+    size_t running;                     /**< Počet vláken, která ještě pracují. */
+    size_t generation;                  /**< Pořadové číslo úlohy. */
+    size_t active;                      /**< Počet vláken, která si berou kusy úloh. */
+    bool stop;                          /**< Příznak ukončení poolu. */
+};
+
+#endif // THREAD_POOL_H
@@ -1,58 +1,173 @@
 ﻿#include "data_utility.h"
 #include "wave.h"
+#include "thread_pool.h"
+#include "alloc_counter.h"
+#include "spectrum_cache.h"
+#include "async_io.h"
+#include "batch_fft.h"
+#include "phase_vocoder.h"
+#include "in_place.h"
+#include "denoise.h"
+#include "flac.h"
+#include "activity_map.h"
+#include <algorithm>
 #include <fstream>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <iostream>
 
-Wave* Wave::fromFilename(const char *filename)
+Wave* Wave::fromFilename(const char *filename, LoadMode mode)
 {
+    if(FlacDecoder::isFlac(filename))
+        return fromFlacFile(filename, mode);
+
     std::ifstream in;
     in.open(filename, std::ios_base::in | std::ios_base::binary);
-    Wave *ret = fromFileStream(in);
-    ret->ParseData();
+    /* Synchronně se načtou jen hlavičky, data se čtou asynchronně po blocích */
+    Wave *ret = fromFileStream(in, false);
+    if(!ret)
+        return 0;
+    std::streamoff offset = in.tellg();
+    in.seekg(0, std::ios::end);
+    uint64_t available = uint64_t(in.tellg() - offset);
     in.close();
+    if(mode == Headers)
+        return ret;
+
+    uint64_t length = std::min<uint64_t>(ret->dchunk.head.length, available);
+    AsyncReader reader(filename, offset, ret->dchunk.data, length);
+    if(mode == Parsed)
+    {
+        /* Bloky se parsují, jakmile jsou načtené, mezitím se na pozadí čtou další */
+        size_t FrameSize = ret->fchunk.NumChannels * (ret->fchunk.BitsPerSample / 8);
+        size_t NumberOfSamples = ret->dchunk.head.length / FrameSize;
+        size_t step = std::max<size_t>(1, AsyncIO::options.chunkSize / FrameSize);
+        ret->allocateData();
+        for(size_t first = 0; first < NumberOfSamples; first += step)
+        {
+            size_t count = std::min(step, NumberOfSamples - first);
+            reader.wait((first + count) * FrameSize);
+            ret->parseRange(first, count);
+        }
+    }
+
+    /* Toto by nemělo nikdy nastat :D, ale co kdyby */
+    if(reader.wait(length) != length || !reader.ok())
+        std::cerr << "ERROR: Reading data." << std::endl;
     return ret;
 }
 
-Wave* Wave::fromFileStream(std::ifstream& in)
+void Wave::parse()
 {
-    /* Pokud je file stream otevřen */
-    if (in.is_open())
+    if(!this->PData)
+        this->ParseData();
+}
+
+bool Wave::readHeaders(std::istream &in, RiffChunk &rch, FmtChunk &fch, DataChunkHeader &dchh)
+{
+    /* Tak se pokusí načíst RIFF chunk */
+    in.read(reinterpret_cast<char*>(&rch),sizeof(RiffChunk));
+    std::string a(rch.ID,4);
+    /* Pokud není ID RIFF, pak konec s chybou */
+    if(!in || a != "RIFF")
     {
-        RiffChunk rch;
-        FmtChunk fch;
-        DataChunkHeader dchh;
-
-        /* Tak se pokusí načíst RIFF chunk */
-        in.read(reinterpret_cast<char*>(&rch),sizeof(RiffChunk));
-        std::string a(rch.ID,4);
-        /* Pokud není ID RIFF, pak konec s chybou */
-        if(a != "RIFF")
-        {
-            std::cerr << "Nespravny format: " << a << std::endl;
-            return 0;
-        }
+        std::cerr << "Nespravny format: " << a << std::endl;
+        return false;
+    }
 
-        /* Pokusí se načíst FMT chunk */
-        in.read(reinterpret_cast<char*>(&fch),sizeof(FmtChunk));
-        a = std::string(fch.ID,4);
-        /* Pokud není ID FMT, pak konec s chybou */
-        if(a != "fmt ")
-        {
-            std::cerr << "Nespravny format: " << a << std::endl;
-            return 0;
-        }
+    /* Pokusí se načíst FMT chunk */
+    in.read(reinterpret_cast<char*>(&fch),sizeof(FmtChunk));
+    a = std::string(fch.ID,4);
+    /* Pokud není ID FMT, pak konec s chybou */
+    if(!in || a != "fmt ")
+    {
+        std::cerr << "Nespravny format: " << a << std::endl;
+        return false;
+    }
 
-        /* Pokusí se načíst DATA chunk */
-        in.read(reinterpret_cast<char*>(&dchh),sizeof(DataChunkHeader));
-        a = std::string(dchh.ID,4);
-        /* Pokud není ID DATA, pak konec s chybou */
-        if(a != "data")
-        {
-            std::cerr << "Nespravny format: " << a << std::endl;
-            return 0;
-        }
+    /* Pokusí se načíst DATA chunk */
+    in.read(reinterpret_cast<char*>(&dchh),sizeof(DataChunkHeader));
+    a = std::string(dchh.ID,4);
+    /* Pokud není ID DATA, pak konec s chybou */
+    if(!in || a != "data")
+    {
+        std::cerr << "Nespravny format: " << a << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Wave::makeHeaders(const FmtChunk &fmt, size_t numberOfSamples, RiffChunk &rch, FmtChunk &fch,
+                       DataChunkHeader &dchh)
+{
+    fch = fmt;
+    std::copy("fmt ","fmt "+4,fch.ID);
+    fch.length = 16;
+    fch.AudioFormat = 1;
+    fch.BlockAlign = fch.NumChannels * (fch.BitsPerSample / 8);
+    fch.ByteRate = fch.SampleRate * fch.BlockAlign;
+
+    std::copy("data","data"+4,dchh.ID);
+    dchh.length = numberOfSamples * fch.BlockAlign;
+
+    std::copy("RIFF","RIFF"+4,rch.ID);
+    std::copy("WAVE","WAVE"+4,rch.Format);
+    rch.length = 4 + sizeof(FmtChunk) + sizeof(DataChunkHeader) + dchh.length;
+}
 
+Wave* Wave::create(const FmtChunk &fmt, size_t numberOfSamples)
+{
+    RiffChunk rch;
+    FmtChunk fch;
+    DataChunkHeader dchh;
+    makeHeaders(fmt,numberOfSamples,rch,fch,dchh);
+
+    Wave *ret = new Wave(rch,fch,DataChunk(dchh,static_cast<char*>(Arena::allocate(dchh.length,true))));
+    ret->allocateData();
+    return ret;
+}
+
+Wave* Wave::fromFlacFile(const char *filename, LoadMode mode)
+{
+    FlacDecoder decoder;
+    if(!decoder.open(filename))
+        return 0;
+    FmtChunk fmt;
+    fmt.NumChannels = decoder.NumChannels;
+    fmt.SampleRate = decoder.SampleRate;
+    fmt.BitsPerSample = decoder.BitsPerSample;
+    /* DATA chunk má jen 32bitovou délku */
+    if(decoder.samples * decoder.NumChannels * (decoder.BitsPerSample / 8) > 0xFFFFFFF0u)
+    {
+        std::cerr << "ERROR: FLAC je prilis dlouhy pro WAV." << std::endl;
+        return 0;
+    }
+
+    RiffChunk rch;
+    FmtChunk fch;
+    DataChunkHeader dchh;
+    makeHeaders(fmt,decoder.samples,rch,fch,dchh);
+    Wave *ret = new Wave(rch,fch,DataChunk(dchh,static_cast<char*>(Arena::allocate(dchh.length,true))));
+    if(mode != Headers && !decoder.decode(ret->dchunk.data))
+    {
+        delete ret;
+        return 0;
+    }
+    if(mode == Parsed)
+        ret->ParseData();
+    return ret;
+}
+
+Wave* Wave::fromFileStream(std::ifstream& in, bool readData)
+{
+    RiffChunk rch;
+    FmtChunk fch;
+    DataChunkHeader dchh;
+
+    /* Pokud je file stream otevřen a obsahuje správné hlavičky */
+    if (in.is_open() && readHeaders(in,rch,fch,dchh))
+    {
         /* Zjištění délky do konce souboru od aktuální pozice čtecí hlavy */
         int begin = in.tellg();
         in.seekg (0, std::ios::end);
@@ -70,49 +185,159 @@ Wave* Wave::fromFileStream(std::ifstream& in)
             std::cerr << "ERROR: Delka do konce souboru - " << length << std::endl;
             dchh.length = length + length%fch.BlockAlign;
             std::cerr << "ERROR: Delka do konce + zarovnani - " << dchh.length << std::endl;
-            /* Inicializace pole dat podle správné délky */
-            data = new char[length]();
-            /* Zarovnání dat na požadovanou délku */
-            for(size_t i = length; i != dchh.length; ++i)
-                data[i] = '\0';
+            /* Inicializace pole dat podle zarovnané délky, zarovnání zůstane vynulované */
+            data = static_cast<char*>(Arena::allocate(dchh.length,true));
         }
         else
         {
-            /* Inicializace pole dat podle správné délky */
-            data = new char[dchh.length]();
+            /* Inicializace pole dat podle správné délky, při načtení dat se celé přepíše */
+            data = static_cast<char*>(Arena::allocate(dchh.length,!readData));
         }
 
         /* Toto by nemělo nikdy nastat :D, ale co kdyby */
-        if(!in.read(data,dchh.length))
+        if(readData && !in.read(data,dchh.length))
             std::cerr << "ERROR: Reading data." << std::endl;
 
-        /* Inicializace data chunku */
-        DataChunk dch(dchh,data);
-        /* Inicializace a vrácení wave struktury */
-        return new Wave(rch,fch,dch);
+        /* Inicializace a vrácení wave struktury, data chunk data převezme */
+        return new Wave(rch,fch,DataChunk(dchh,data));
     }
     else
         return 0;
 }
 
-void Wave::saveToWaveFile(const char * filename)
+bool Wave::saveToWaveFile(const char * filename)
 {
-    /* Uložení naparsovaných dat do výstupního pole s kontrolou chyb */
-    if(!this->ComposeData())
+    /* Kontrola, že se naparsovaná data dají složit zpět. Bez PData se raw data jen zkopírují. */
+    bool parsed = this->PData != 0;
+    if(parsed && (!this->resizeData() || !this->composable()))
     {
         std::cerr << "ERROR: Neukladam, nastala chyba." << std::endl;
-        return;
+        return false;
     }
 
     /* Vytvoření streamu, kontrola velikostí chunků a následné uložení chunků v pořadí:
         RIFF chunk, FMT Chunk, DATA chunk, DATA a nasledne zavření streamu */
-    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+    AsyncWriter out(filename);
     assert(sizeof(RiffChunk) == 12 && sizeof(FmtChunk) == 24 && sizeof(DataChunkHeader) == 8);
     out.write(reinterpret_cast<char*>(&rchunk),sizeof(RiffChunk));
     out.write(reinterpret_cast<char*>(&fchunk),sizeof(FmtChunk));
     out.write(reinterpret_cast<char*>(&dchunk.head),sizeof(DataChunkHeader));
-    out.write(dchunk.data,dchunk.head.length);
-    out.close();
+
+    /* Data se skládají po blocích, hotové bloky se zapisují na pozadí, zatímco se skládají další */
+    size_t FrameSize = this->fchunk.NumChannels * (this->fchunk.BitsPerSample / 8);
+    size_t NumberOfSamples = this->dchunk.head.length / FrameSize;
+    size_t step = std::max<size_t>(1, AsyncIO::options.chunkSize / FrameSize);
+    for(size_t first = 0; first < NumberOfSamples; first += step)
+    {
+        size_t count = std::min(step, NumberOfSamples - first);
+        if(parsed)
+            this->composeRange(first,count);
+        out.write(dchunk.data + first * FrameSize, count * FrameSize);
+    }
+    /* Zarovnání za posledním celým samplem */
+    out.write(dchunk.data + NumberOfSamples * FrameSize, dchunk.head.length - NumberOfSamples * FrameSize);
+
+    if(!out.finish())
+    {
+        std::cerr << "ERROR: Zapis do souboru selhal." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+Wave* Wave::extract(size_t from, size_t count) const
+{
+    size_t FrameSize = this->fchunk.NumChannels * (this->fchunk.BitsPerSample / 8);
+    if(count == 0 || (from + count) * FrameSize > this->dchunk.head.length)
+    {
+        std::cerr << "ERROR: Usek je mimo data." << std::endl;
+        return 0;
+    }
+    DataChunkHeader dchh = this->dchunk.head;
+    dchh.length = count * FrameSize;
+    RiffChunk rch = this->rchunk;
+    rch.length = this->rchunk.length - this->dchunk.head.length + dchh.length;
+    char *data = static_cast<char*>(Arena::allocate(dchh.length));
+    std::copy(this->dchunk.data + from * FrameSize, this->dchunk.data + (from + count) * FrameSize, data);
+    return new Wave(rch,this->fchunk,DataChunk(dchh,data));
+}
+
+bool Wave::splice(Wave &region, size_t from, size_t fadeIn, size_t fadeOut)
+{
+    size_t NumChannels = this->fchunk.NumChannels;
+    size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
+    size_t FrameSize = NumChannels * SizeOfSample;
+    size_t count = region.dchunk.head.length / FrameSize;
+    /* Úsek musí mít pořád stejnou délku a formát, jinak ho nejde vložit zpět */
+    if(!region.PData || region.PData[0].size() != count || fadeIn + fadeOut > count
+       || region.fchunk.BitsPerSample != this->fchunk.BitsPerSample
+       || (from + count) * FrameSize > this->dchunk.head.length || !region.ComposeData())
+    {
+        std::cerr << "ERROR: Zpracovany usek nelze vlozit zpet." << std::endl;
+        return false;
+    }
+
+    /* Mimo prolínání stačí zkopírovat složená data úseku */
+    std::copy(region.dchunk.data + fadeIn * FrameSize, region.dchunk.data + (count - fadeOut) * FrameSize,
+              this->dchunk.data + (from + fadeIn) * FrameSize);
+
+    /* Prolínání na okrajích, původní samply se rozparsují jen tady */
+    for(size_t i = 0; i != fadeIn; ++i)
+        this->blendSample(region,from,i,(i + .5) / fadeIn);
+    for(size_t i = count - fadeOut; i != count; ++i)
+        this->blendSample(region,from,i,(count - i - .5) / fadeOut);
+    return true;
+}
+
+void Wave::blendSample(const Wave &region, size_t from, size_t i, double weight)
+{
+    size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
+    char *sample = this->dchunk.data + (from + i) * this->fchunk.NumChannels * SizeOfSample;
+    for(size_t j = 0; j != this->fchunk.NumChannels; ++j, sample += SizeOfSample)
+    {
+        complex original = DataUtility::fromCharsToComplex(sample,SizeOfSample);
+        DataUtility::scaleComplex(original,SizeOfSample,false);
+        complex mixed = original * (1 - weight) + region.PData[j][i] * weight;
+        DataUtility::scaleComplex(mixed,SizeOfSample,true);
+        DataUtility::fromComplexToChars(mixed,SizeOfSample,sample);
+    }
+}
+
+bool Wave::saveInPlace(const char * filename)
+{
+    bool parsed = this->PData != 0;
+    if(parsed && (!this->resizeData() || !this->composable()))
+    {
+        std::cerr << "ERROR: Neprepisuji, nastala chyba." << std::endl;
+        return false;
+    }
+
+    InPlaceWriter out(filename);
+    if(!out.open())
+        return false;
+    uint64_t offset = sizeof(RiffChunk) + sizeof(FmtChunk) + sizeof(DataChunkHeader);
+    if(!out.write(0,reinterpret_cast<char*>(&rchunk),sizeof(RiffChunk))
+       || !out.write(sizeof(RiffChunk),reinterpret_cast<char*>(&fchunk),sizeof(FmtChunk))
+       || !out.write(sizeof(RiffChunk) + sizeof(FmtChunk),reinterpret_cast<char*>(&dchunk.head),sizeof(DataChunkHeader)))
+        return false;
+
+    /* Data se skládají po blocích a každý blok se porovná se souborem */
+    size_t FrameSize = this->fchunk.NumChannels * (this->fchunk.BitsPerSample / 8);
+    size_t NumberOfSamples = this->dchunk.head.length / FrameSize;
+    size_t step = std::max<size_t>(1, AsyncIO::options.chunkSize / FrameSize);
+    for(size_t first = 0; first < NumberOfSamples; first += step)
+    {
+        size_t count = std::min(step, NumberOfSamples - first);
+        if(parsed)
+            this->composeRange(first,count);
+        if(!out.write(offset + first * FrameSize, dchunk.data + first * FrameSize, count * FrameSize))
+            return false;
+    }
+    if(!out.write(offset + NumberOfSamples * FrameSize, dchunk.data + NumberOfSamples * FrameSize,
+                  dchunk.head.length - NumberOfSamples * FrameSize) || !out.commit())
+        return false;
+    std::cout << "Prepsano " << out.dirtyBytes() / 1024 << " z " << out.totalBytes() / 1024 << " KB." << std::endl;
+    return true;
 }
 
 void Wave::changeVolumeToPercentage(unsigned int per, const bool loudnessNormalization)
@@ -134,71 +359,206 @@ void Wave::changeVolumeToPercentage(unsigned int per, const bool loudnessNormali
         this->loudnessNormalization();
 }
 
+void Wave::changeTempo(double tempo, double semitones)
+{
+    PhaseVocoder::Options options;
+    options.stretch = 100. / tempo;
+    options.pitch = std::pow(2., semitones / 12);
+    if(options.stretch == 1 && options.pitch == 1)
+        return;
+    this->parse();
+
+    /* Kanály jsou nezávislé, každý má svůj vokodér a vlákno svůj pracovní prostor */
+    size_t NumChannels = this->fchunk.NumChannels;
+    ThreadPool &pool = ThreadPool::instance();
+    std::vector<Workspace> &workspaces = Workspace::shared();
+    Workspace::prepareAll(workspaces,pool.size(),options.size);
+    ChannelData *stretched = new ChannelData[NumChannels];
+    pool.run(NumChannels, [&](size_t ch, size_t worker) {
+        PhaseVocoder vocoder(options);
+        vocoder.process(this->PData[ch],stretched[ch],workspaces[worker]);
+    });
+
+    delete [] this->PData;
+    this->PData = stretched;
+    this->resizeData();
+}
+
+bool Wave::resizeData()
+{
+    if(!this->PData)
+        return true;
+    size_t NumChannels = this->fchunk.NumChannels;
+    size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
+    size_t NumberOfSamples = this->PData[0].size();
+    for(size_t j = 1; j != NumChannels; ++j)
+        if(this->PData[j].size() != NumberOfSamples)
+        {
+            std::cerr << "ERROR: Kanaly maji ruznou delku." << std::endl;
+            return false;
+        }
+
+    /* Délka se shoduje, není co měnit */
+    unsigned int length = NumberOfSamples * NumChannels * SizeOfSample;
+    if(length == this->dchunk.head.length)
+        return true;
+    Arena::release(this->dchunk.data);
+    this->dchunk.data = static_cast<char*>(Arena::allocate(length,true));
+    this->rchunk.length = this->rchunk.length - this->dchunk.head.length + length;
+    this->dchunk.head.length = length;
+    return true;
+}
+
+void Wave::allocateData()
+{
+    size_t NumChannels = this->fchunk.NumChannels;
+    size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
+    size_t NumberOfSamples = ( this->dchunk.head.length / NumChannels ) / SizeOfSample;
+    this->PData = new ChannelData[NumChannels];
+    for(size_t j = 0; j != NumChannels; ++j)
+        this->PData[j].resize(NumberOfSamples);
+}
+
 void Wave::ParseData()
 {
-    /* Načtení důležitých proměnných, abych pro ně furt nemusel lézt v cyklech */
     size_t NumChannels = this->fchunk.NumChannels;
     size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
     size_t NumberOfSamples = ( this->dchunk.head.length / NumChannels ) / SizeOfSample;
-    this->PData = new std::vector<complex>[NumChannels];
+    this->allocateData();
+    this->parseRange(0,NumberOfSamples);
+}
+
+void Wave::parseRange(size_t from, size_t count)
+{
+    /* Načtení důležitých proměnných, abych pro ně furt nemusel lézt v cyklech */
+    size_t NumChannels = this->fchunk.NumChannels;
+    size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
 
-    size_t k = 0;
+    size_t k = from * NumChannels * SizeOfSample;
     /* Pro každý sampl */
-    for(size_t i = 0; i != NumberOfSamples; ++i)
+    for(size_t i = from; i != from + count; ++i)
         /* A pro každý kanál */
         for(size_t j = 0; j != NumChannels; ++j)
         {
             /* Zjistím hodnotu dat, nascaluju ji a uložím do PDat */
             complex tmp = DataUtility::fromCharsToComplex(this->dchunk.data + k,SizeOfSample);
             DataUtility::scaleComplex(tmp,SizeOfSample,false);
-            this->PData[j].push_back(tmp);
+            this->PData[j][i] = tmp;
             k += SizeOfSample;
         }
 }
 
-bool Wave::ComposeData()
+bool Wave::composable() const
 {
-    /* Načtení důležitých proměnných, abych pro ně furt nemusel lézt v cyklech */
     size_t NumChannels = this->fchunk.NumChannels;
     size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
-    size_t NumberOfSamples = ( this->dchunk.head.length / NumChannels ) / SizeOfSample;
-    if(NumChannels*this->PData[0].size()*SizeOfSample != this->dchunk.head.length)
+    if(!this->PData || NumChannels*this->PData[0].size()*SizeOfSample != this->dchunk.head.length)
     {
         std::cerr << "ERROR: Nelze composovat data, protoze upravena jsou jinak dlouha." << std::endl;
         return false;
     }
+    return true;
+}
+
+bool Wave::saveToFlacFile(const char * filename)
+{
+    bool parsed = this->PData != 0;
+    if(parsed && (!this->resizeData() || !this->composable()))
+    {
+        std::cerr << "ERROR: Neukladam, nastala chyba." << std::endl;
+        return false;
+    }
+
+    size_t FrameSize = this->fchunk.NumChannels * (this->fchunk.BitsPerSample / 8);
+    size_t NumberOfSamples = this->dchunk.head.length / FrameSize;
+    ThreadPool &pool = ThreadPool::instance();
+    FlacEncoder encoder(this->fchunk.NumChannels,this->fchunk.BitsPerSample,this->fchunk.SampleRate,NumberOfSamples,pool.size());
+    if(!encoder.supported())
+    {
+        std::cerr << "ERROR: Tento format nelze ulozit do FLAC." << std::endl;
+        return false;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    AsyncWriter out(filename);
+    std::vector<unsigned char> header;
+    encoder.header(header);
+    out.write(reinterpret_cast<char*>(&header[0]),header.size());
+    uint64_t written = header.size();
+
+    /* Skupina rámců se paralelně složí a zakóduje, mezitím se na pozadí zapisuje předchozí skupina */
+    const size_t BlockSize = FlacEncoder::BlockSize;
+    const size_t Group = 4 * pool.size();
+    size_t frames = (NumberOfSamples + BlockSize - 1) / BlockSize;
+    std::vector<std::vector<unsigned char> > encoded(Group);
+    for(size_t first = 0; first < frames; first += Group)
+    {
+        size_t count = std::min(Group, frames - first);
+        pool.run(count, [&](size_t f, size_t worker) {
+            size_t from = (first + f) * BlockSize;
+            size_t samples = std::min(BlockSize, NumberOfSamples - from);
+            if(parsed)
+                this->composeRange(from,samples);
+            encoder.encodeFrame(dchunk.data + from * FrameSize,samples,first + f,worker,encoded[f]);
+        });
+        for(size_t f = 0; f != count; ++f)
+        {
+            out.write(reinterpret_cast<char*>(&encoded[f][0]),encoded[f].size());
+            written += encoded[f].size();
+        }
+    }
+
+    if(!out.finish())
+    {
+        std::cerr << "ERROR: Zapis do souboru selhal." << std::endl;
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = double(NumberOfSamples * FrameSize) / (1024 * 1024);
+    std::cout << "FLAC: " << NumberOfSamples * FrameSize / 1024 << " KB -> " << written / 1024 << " KB, "
+              << megabytes / std::max(seconds, 1e-9) << " MB/s." << std::endl;
+    return true;
+}
+
+bool Wave::ComposeData()
+{
+    if(!this->resizeData() || !this->composable())
+        return false;
+    this->composeRange(0,this->PData[0].size());
+    return true;
+}
+
+void Wave::composeRange(size_t from, size_t count)
+{
+    /* Načtení důležitých proměnných, abych pro ně furt nemusel lézt v cyklech */
+    size_t NumChannels = this->fchunk.NumChannels;
+    size_t SizeOfSample = this->fchunk.BitsPerSample / 8;
 
-    size_t k = 0;
+    size_t k = from * NumChannels * SizeOfSample;
     /* Pro každý sampl */
-    for(size_t i = 0; i != NumberOfSamples; ++i)
+    for(size_t i = from; i != from + count; ++i)
         /* A pro každý kanál */
         for(size_t j = 0; j != NumChannels; ++j)
         {
             /* Nactu komplexni cislo z Pdat, prescaluju zpet, zjistim a ulozim do dat */
             complex tmp = this->PData[j][i];
             DataUtility::scaleComplex(tmp,SizeOfSample,true);
-            std::vector<char> ret = DataUtility::fromComplexToChars(tmp, SizeOfSample);
-            for(size_t l = 0; l != ret.size(); ++l)
-                this->dchunk.data[k+l] = ret[l];
+            DataUtility::fromComplexToChars(tmp, SizeOfSample, this->dchunk.data + k);
             k += SizeOfSample;
         }
-    return true;
 }
 
-std::vector<complex> Wave::getPieceOfChannel(size_t channel, size_t from, size_t countData, size_t countForFFT)
+void Wave::getPieceOfChannel(size_t channel, size_t from, size_t countData, size_t countForFFT, std::vector<complex> &out)
 {
-    if(from+countData >= this->PData[channel].size())
+    if(from+countData >= this->PData[channel].size() || out.size() < countForFFT)
     {
         std::cerr << "Nekonzistence poctu dat ke zkopirovani v dataToComplexPiece." << std::endl;
-        return std::vector<complex>();
+        return;
     }
-    std::vector<complex> forReturn;
     /* Jednoduché zkopírování dat z PDat od indexu from do indexu from+countData
-     * s následným přidáním nul do délky countForFFT*/
-    std::copy(this->PData[channel].begin()+from,this->PData[channel].begin()+from+countData,std::back_inserter(forReturn));
-    for(size_t i = from + countData; i != from + countForFFT; ++i)
-            forReturn.push_back(complex(0));
-    return forReturn;
+     * s následným doplněním nul do délky countForFFT*/
+    std::copy(this->PData[channel].begin()+from,this->PData[channel].begin()+from+countData,out.begin());
+    std::fill(out.begin()+countData,out.begin()+countForFFT,complex(0));
 }
 
 void Wave::setPieceOfChannel(const std::vector<complex> &data, size_t channel, size_t from, size_t countData)
@@ -209,57 +569,335 @@ void Wave::setPieceOfChannel(const std::vector<complex> &data, size_t channel, s
     std::copy(data.begin(),data.begin()+countData,this->PData[channel].begin()+from);
 }
 
-void Wave::equalizeWith(std::vector<double> &other, bool loudnessNormalization)
+void Wave::equalizeWith(std::vector<double> &other, bool loudnessNormalization, SpectrumCache *spectra,
+                        const Denoiser *denoiser, ActivityMap *activity)
 {
-    /* Pro každý kanál */
-    for(size_t ch = 0; ch < this->fchunk.NumChannels; ++ch)
+    size_t count_for_FFT = DataUtility::findNextTo2Exp(this->fchunk.SampleRate);
+    /* Preset doplním jednou předem, aby se při zpracování bloků už neměnil */
+    padPreset(other,count_for_FFT);
+
+    /* S načtenými spektry se data neparsují, všechny samply se spočítají znovu */
+    if(spectra && spectra->isLoaded())
     {
-        size_t i = 0;
-        size_t size_of_samples = this->PData[ch].size() - 1;
-        size_t count_of_Data = 0, count_for_FFT = 0;
-        size_t SampleRate = this->fchunk.SampleRate;
-        /* Pro každý sampl z kanálu */
-        while(i < size_of_samples)
-        {
-            /* Nastavím počáteční počty */
-            count_of_Data = i + SampleRate > size_of_samples ? size_of_samples-i : SampleRate; //Pojistka, ze nebudu zpracovavat vic dat nez existuje v channelu
-            count_for_FFT = DataUtility::findNextTo2Exp(SampleRate);
-            /* Načtu blok dat ke zpracování */
-            std::vector<complex> InputData = getPieceOfChannel(ch,i,count_of_Data,count_for_FFT);
-            /* Pošlu je do Forward FFT */
-            CFFT::Forward(&InputData[0],count_for_FFT);
-            /* Použiju na ně filtr */
-            std::vector<complex> InverseInput = applyFilter(InputData,other);
-            /* Pošlu je do Inverze FFT */
-            CFFT::Inverse(&InverseInput[0],count_for_FFT,true);
-            /* Změním PData na daném rozmezí equalizovanými daty */
-            setPieceOfChannel(InverseInput,ch,i,count_of_Data);
-            /* Posunu se na další blok dat */
-            i += count_of_Data;
-        }
+        if(!this->PData)
+            this->allocateData();
+    }
+    else
+    {
+        this->parse();
+        if(spectra && !spectra->isRecording()
+           && !spectra->create(this->fchunk,this->PData[0].size(),count_for_FFT))
+            spectra = 0;
     }
 
+    /* Spektra se ukládají, respektive načítají pro všechny bloky, tiché bloky se s nimi nepřeskakují */
+    if(spectra)
+        activity = 0;
+    else if(activity)
+        activity->scan(*this);
+
+    /* Kanály se seskupí do dávek, které projdou FFT najednou. Se spektry se zpracovává po kanálech. */
+    ThreadPool &pool = ThreadPool::instance();
+    size_t lanes = spectra ? 1 : BatchFFT::lanesFor(this->fchunk.NumChannels,pool.size());
+    std::vector<std::pair<size_t,size_t> > groups = channelGroups(lanes);
+
+    /* Každé vlákno dostane svůj pracovní prostor, alokovaný jen při první úloze */
+    std::vector<Workspace> &workspaces = Workspace::shared();
+    Workspace::prepareAll(workspaces,pool.size(),count_for_FFT,lanes,denoiser != 0);
+
+    /* Dávky jsou na sobě nezávislé, takže je zpracuji paralelně */
+    pool.run(groups.size(), [&](size_t g, size_t worker) {
+        if(groups[g].second == 1)
+            equalizeChannel(other,groups[g].first,workspaces[worker],spectra,denoiser,activity);
+        else
+            equalizeChannels(other,groups[g].first,groups[g].second,workspaces[worker],denoiser,activity);
+    });
+
+    if(spectra && spectra->isRecording() && !spectra->finish())
+        std::cerr << "ERROR: Nepodarilo se ulozit spektra." << std::endl;
+
     /* Pokud chceme opravit hlasitost, tak ji opravíme. Defaultně ji opravujem. */
     if(loudnessNormalization)
         this->loudnessNormalization();
 }
 
-std::vector<complex> Wave::applyFilter(const std::vector<complex> &a, std::vector<double> &b)
+std::vector<Wave*> Wave::equalizeMany(std::vector<std::vector<double> > &presets, bool loudnessNormalization,
+                                      const Denoiser *denoiser, ActivityMap *activity)
 {
-    std::vector<complex> ret;
+    size_t count_for_FFT = DataUtility::findNextTo2Exp(this->fchunk.SampleRate);
+    size_t SampleRate = this->fchunk.SampleRate;
+    size_t NumChannels = this->fchunk.NumChannels;
+    const size_t K = presets.size();
+    this->parse();
+    for(size_t k = 0; k != K; ++k)
+        padPreset(presets[k],count_for_FFT);
+
+    /* Výstupy mají stejné hlavičky jako vstup. Poslední sampl equalizace nemění, zkopíruje se. */
+    size_t size_of_samples = this->PData[0].size() - 1;
+    std::vector<Wave*> outputs(K);
+    for(size_t k = 0; k != K; ++k)
+    {
+        outputs[k] = this->extract(0,this->PData[0].size());
+        outputs[k]->allocateData();
+        for(size_t ch = 0; ch != NumChannels; ++ch)
+            outputs[k]->PData[ch][size_of_samples] = this->PData[ch][size_of_samples];
+    }
+
+    /* Spektrum každé dávky kanálů se drží mezi fázemi, pracovní prostory vláken slouží pro filtr */
+    ThreadPool &pool = ThreadPool::instance();
+    size_t lanes = BatchFFT::lanesFor(NumChannels,pool.size());
+    std::vector<std::pair<size_t,size_t> > groups = channelGroups(lanes);
+    std::vector<Workspace> spectra(groups.size());
+    for(size_t g = 0; g != groups.size(); ++g)
+        spectra[g].prepare(count_for_FFT,groups[g].second,denoiser != 0);
+    std::vector<Workspace> &workspaces = Workspace::shared();
+    Workspace::prepareAll(workspaces,pool.size(),count_for_FFT,lanes);
+    if(activity)
+        activity->scan(*this);
+    std::vector<char> silent(groups.size(),0);
 
-    size_t max_freq = floor(a.size()/2);
+    /* Úlohy poolu se vytvoří jednou, blok čtou z proměnných, aby se v cyklu nealokovalo */
+    size_t i = 0;
+    size_t count_of_Data = 0;
+    size_t block = 0;
+
+    /* Dopředná FFT (a odšumění) jednou pro každou dávku */
+    const ThreadPool::Task forward = [&](size_t g, size_t) {
+        size_t first = groups[g].first;
+        size_t width = groups[g].second;
+        Workspace &spectrum = spectra[g];
+        silent[g] = activity && !activity->active(first,width,block);
+        if(silent[g])
+        {
+            activity->skip(width);
+            return;
+        }
+        if(width == 1)
+        {
+            getPieceOfChannel(first,i,count_of_Data,count_for_FFT,spectrum.block);
+            CFFT::Forward(&spectrum.block[0],count_for_FFT);
+            if(denoiser)
+                denoiser->apply(&spectrum.block[0],count_for_FFT,first,count_of_Data,spectrum);
+            return;
+        }
+        const size_t Width = 2 * width;
+        double *data = &spectrum.batch[0];
+        for(size_t l = 0; l != width; ++l)
+        {
+            const complex *in = &this->PData[first + l][i];
+            for(size_t n = 0; n != count_of_Data; ++n)
+            {
+                data[n * Width + l] = in[n].re();
+                data[n * Width + width + l] = in[n].im();
+            }
+        }
+        std::fill(data + count_of_Data * Width, data + count_for_FFT * Width, 0.);
+        BatchFFT::forward(data,count_for_FFT,width);
+        if(denoiser)
+            denoiser->apply(data,count_for_FFT,first,width,count_of_Data,spectrum);
+    };
+
+    /* Filtr a inverzní FFT pro každou dávku a každý preset zvlášť */
+    const ThreadPool::Task filter = [&](size_t task, size_t worker) {
+        size_t g = task / K;
+        size_t k = task % K;
+        size_t first = groups[g].first;
+        size_t width = groups[g].second;
+        Workspace &ws = workspaces[worker];
+        Wave &out = *outputs[k];
+        if(silent[g])
+        {
+            /* Tichý blok projde beze změny */
+            for(size_t l = 0; l != width; ++l)
+                std::copy(&this->PData[first + l][i],&this->PData[first + l][i] + count_of_Data,&out.PData[first + l][i]);
+            return;
+        }
+        if(width == 1)
+        {
+            applyFilter(spectra[g].block,presets[k],ws.filtered);
+            CFFT::Inverse(&ws.filtered[0],count_for_FFT,true);
+            out.setPieceOfChannel(ws.filtered,first,i,count_of_Data);
+            return;
+        }
+        const size_t Width = 2 * width;
+        double *data = &ws.batch[0];
+        std::copy(spectra[g].batch.begin(),spectra[g].batch.begin() + count_for_FFT * Width,data);
+        BatchFFT::filter(data,&presets[k][0],count_for_FFT,width);
+        BatchFFT::inverse(data,count_for_FFT,width,true);
+        for(size_t l = 0; l != width; ++l)
+        {
+            complex *o = &out.PData[first + l][i];
+            for(size_t n = 0; n != count_of_Data; ++n)
+                o[n] = complex(data[n * Width + l],data[n * Width + width + l]);
+        }
+    };
+
+    bool warmedUp = false;
+    for(; i < size_of_samples; i += SampleRate)
+    {
+        size_t allocations = AllocCounter::count();
+        count_of_Data = std::min(SampleRate, size_of_samples - i);
+        block = i / SampleRate;
+        pool.run(groups.size(), forward);
+        pool.run(groups.size() * K, filter);
+
+        /* Po prvním bloku už se nesmí alokovat nic */
+        if(warmedUp)
+            AllocCounter::reportSteadyState(AllocCounter::count() - allocations);
+        warmedUp = true;
+    }
+
+    /* Výstupy jsou nezávislé, normalizují se paralelně */
+    if(loudnessNormalization)
+        pool.run(K, [&](size_t k, size_t) { outputs[k]->loudnessNormalization(); });
+    return outputs;
+}
+
+std::vector<std::pair<size_t,size_t> > Wave::channelGroups(size_t lanes) const
+{
+    std::vector<std::pair<size_t,size_t> > groups;
+    for(size_t ch = 0; ch < this->fchunk.NumChannels; ch += groups.back().second)
+    {
+        size_t width = lanes;
+        while(width > this->fchunk.NumChannels - ch)
+            width /= 2;
+        groups.push_back(std::make_pair(ch,width));
+    }
+    return groups;
+}
+
+void Wave::equalizeChannel(const std::vector<double> &preset, size_t ch, Workspace &ws, SpectrumCache *spectra,
+                           const Denoiser *denoiser, ActivityMap *activity)
+{
+    size_t i = 0;
+    size_t size_of_samples = this->PData[ch].size() - 1;
+    size_t count_of_Data = 0;
+    size_t SampleRate = this->fchunk.SampleRate;
+    size_t count_for_FFT = DataUtility::findNextTo2Exp(SampleRate);
+    size_t block = 0;
+    bool warmedUp = false;
+
+    /* Poslední sampl equalizace nemění, se spektry ho tedy musím uložit, respektive obnovit */
+    if(spectra && spectra->isLoaded())
+        this->PData[ch][size_of_samples] = spectra->tail(ch);
+    else if(spectra)
+        spectra->storeTail(ch,this->PData[ch][size_of_samples]);
+
+    /* Pro každý sampl z kanálu */
+    while(i < size_of_samples)
+    {
+        size_t allocations = AllocCounter::count();
+        /* Nastavím počáteční počty */
+        count_of_Data = i + SampleRate > size_of_samples ? size_of_samples-i : SampleRate; //Pojistka, ze nebudu zpracovavat vic dat nez existuje v channelu
+        /* Tichý blok přeskočím, data zůstanou */
+        if(activity && !activity->active(ch,block))
+        {
+            activity->skip(1);
+            i += count_of_Data;
+            ++block;
+            continue;
+        }
+        if(spectra && spectra->isLoaded())
+            /* Spektrum bloku už je spočítané z minula */
+            spectra->loadBlock(ch,block,ws.block);
+        else
+        {
+            /* Načtu blok dat ke zpracování */
+            getPieceOfChannel(ch,i,count_of_Data,count_for_FFT,ws.block);
+            /* Pošlu je do Forward FFT */
+            CFFT::Forward(&ws.block[0],count_for_FFT);
+            if(spectra)
+                spectra->storeBlock(ch,block,ws.block);
+        }
+        /* Potlačím šum ve stejném spektru, FFT se kvůli tomu nepočítá znovu */
+        if(denoiser)
+            denoiser->apply(&ws.block[0],count_for_FFT,ch,count_of_Data,ws);
+        /* Použiju na ně filtr */
+        applyFilter(ws.block,preset,ws.filtered);
+        /* Pošlu je do Inverze FFT */
+        CFFT::Inverse(&ws.filtered[0],count_for_FFT,true);
+        /* Změním PData na daném rozmezí equalizovanými daty */
+        setPieceOfChannel(ws.filtered,ch,i,count_of_Data);
+        /* Posunu se na další blok dat */
+        i += count_of_Data;
+        ++block;
+        /* Po prvním bloku už se nesmí alokovat nic */
+        if(warmedUp)
+            AllocCounter::reportSteadyState(AllocCounter::count() - allocations);
+        warmedUp = true;
+    }
+}
+
+void Wave::equalizeChannels(const std::vector<double> &preset, size_t first, size_t lanes, Workspace &ws,
+                            const Denoiser *denoiser, ActivityMap *activity)
+{
+    size_t size_of_samples = this->PData[first].size() - 1;
+    size_t count_for_FFT = DataUtility::findNextTo2Exp(this->fchunk.SampleRate);
+    const size_t Width = 2 * lanes;
+    double *data = &ws.batch[0];
+    bool warmedUp = false;
+
+    /* Bloky jsou stejné jako v equalizeChannel(), jen se kanály proloží do jednoho bufferu */
+    for(size_t i = 0; i < size_of_samples; )
+    {
+        size_t allocations = AllocCounter::count();
+        size_t count_of_Data = std::min<size_t>(this->fchunk.SampleRate, size_of_samples - i);
+        /* Blok se přeskočí, jen když jsou tiché všechny kanály dávky */
+        if(activity && !activity->active(first,lanes,i / this->fchunk.SampleRate))
+        {
+            activity->skip(lanes);
+            i += count_of_Data;
+            continue;
+        }
+        for(size_t l = 0; l != lanes; ++l)
+        {
+            const complex *in = &this->PData[first + l][i];
+            for(size_t k = 0; k != count_of_Data; ++k)
+            {
+                data[k * Width + l] = in[k].re();
+                data[k * Width + lanes + l] = in[k].im();
+            }
+        }
+        std::fill(data + count_of_Data * Width, data + count_for_FFT * Width, 0.);
+
+        BatchFFT::forward(data,count_for_FFT,lanes);
+        if(denoiser)
+            denoiser->apply(data,count_for_FFT,first,lanes,count_of_Data,ws);
+        BatchFFT::filter(data,&preset[0],count_for_FFT,lanes);
+        BatchFFT::inverse(data,count_for_FFT,lanes,true);
+
+        for(size_t l = 0; l != lanes; ++l)
+        {
+            complex *out = &this->PData[first + l][i];
+            for(size_t k = 0; k != count_of_Data; ++k)
+                out[k] = complex(data[k * Width + l],data[k * Width + lanes + l]);
+        }
+        i += count_of_Data;
+
+        if(warmedUp)
+            AllocCounter::reportSteadyState(AllocCounter::count() - allocations);
+        warmedUp = true;
+    }
+}
+
+void Wave::padPreset(std::vector<double> &preset, size_t countForFFT)
+{
     /* Doplnění presetu, pokud je moc krátkej. Doplňuji neměnícími frekvencemi. */
-    for(size_t i = b.size(); i != max_freq; ++i)
-        b.push_back(1);
+    size_t max_freq = countForFFT / 2;
+    if(preset.size() < max_freq)
+        preset.resize(max_freq,1);
+}
+
+void Wave::applyFilter(const std::vector<complex> &a, const std::vector<double> &b, std::vector<complex> &ret)
+{
+    size_t max_freq = a.size()/2;
 
     /* Aplikování filtru na první polovinu spektra */
     for(size_t i = 0; i < max_freq; ++i)
-        ret.push_back(a.at(i)*b.at(i));
+        ret[i] = a[i]*b[i];
     /* Aplikování filtru na druhou polovinu spektra, která je zrcadlová k první. Proto aplikace probíha odzadu */
-    for(size_t i = max_freq,j = max_freq - 1; i < a.size() && j >= 0; ++i, --j)
-        ret.push_back(a.at(i)*b.at(j));
-    return ret;
+    for(size_t i = max_freq,j = max_freq - 1; i < a.size(); ++i, --j)
+        ret[i] = a[i]*b[j];
 }
 
 void Wave::loudnessNormalization()
@@ -1,8 +1,15 @@
 ﻿#ifndef WAVE_H
 #define WAVE_H
+#include "arena.h"
 #include "fft.h"
+#include "workspace.h"
+#include <utility>
 #include <vector>
 
+class SpectrumCache;
+class Denoiser;
+class ActivityMap;
+
 /**
  * @brief Třída reprezentující WAV soubor.
  *
@@ -58,7 +65,7 @@ public:
     /**
      * @brief Třída pro uložení DATA Chunku.
      *
-     * Zkopíruje si do sebe data z WAV podle délky z Data hlavičky.
+     * Zkopíruje si do sebe data z WAV podle délky z Data hlavičky. Data se alokují přes Arena.
      */
     class DataChunk
     {
@@ -69,7 +76,7 @@ public:
         /**
          * @brief       Konstruktor.
          * @param head  Odkaz na hlavičku data chunku.
-         * @param data  Data Data chunku.
+         * @param data  Data Data chunku z Arena::allocate(), chunk je převezme.
          */
         inline DataChunk(const DataChunkHeader &head, char *data) : head(head), data(data) {}
 
@@ -79,26 +86,65 @@ public:
          */
         DataChunk(const DataChunk &other) : head(other.head)
         {
-            data = new char[head.length];
+            data = static_cast<char*>(Arena::allocate(head.length));
             std::copy(other.data,other.data+head.length,data);
         }
 
+        /**
+         * @brief       Přesouvací konstruktor, data se nekopírují.
+         * @param other Data chunk, o data přijde.
+         */
+        DataChunk(DataChunk &&other) : head(other.head), data(other.data) { other.data = 0; }
+
         /**
          * @brief   Destruktor
          */
-        inline ~DataChunk() { delete [] data; }
+        inline ~DataChunk() { Arena::release(data); }
     } dchunk;
 
-    std::vector<complex> *PData;    /**< Rozparsové data, podle kanálů. */
+    ChannelData *PData;             /**< Rozparsové data, podle kanálů. */
+
+    /**
+     * @brief Způsob načtení WAV souboru.
+     */
+    enum LoadMode
+    {
+        Parsed,     /**< Načte raw data a rozparsuje je do PData. */
+        Raw,        /**< Načte jen raw data, PData zůstanou prázdná. */
+        Headers     /**< Načte jen hlavičky, raw data jsou vynulovaná. */
+    };
 
     /**
      * @brief                       Mění frekvenční složky wavu.
      * @param other                 Vstupní preset.
      * @param loudnessNormalization Udává, jestli se má po skončení Equalizace normalizovat zvuk.
+     * @param spectra               Uložená spektra bloků, nebo 0.
+     * @param denoiser              Odšumění s naučeným profilem, nebo 0.
+     * @param activity              Mapa aktivity, tiché bloky se přeskočí, nebo 0.
      *
      * Změní frekvenční složky wavu, podle zadaného presetu, eventulně normalizuje hlasitost.
+     * Pokud jsou spektra načtená, použijí se místo dopředné FFT a PData se nemusí předem parsovat.
+     * Pokud se do nich ukládá, uloží se do nich spektrum každého bloku.
+     * S odšuměním se šum potlačí ve stejném spektru bloku, ještě před presetem.
+     * Mapa aktivity se vyplní z rozparsovaných dat, se spektry se nepoužije.
+     */
+    void equalizeWith(std::vector<double> &other, bool loudnessNormalization = true, SpectrumCache *spectra = 0,
+                      const Denoiser *denoiser = 0, ActivityMap *activity = 0);
+
+    /**
+     * @brief                       Equalizuje wave několika presety najednou.
+     * @param presets               Vstupní presety.
+     * @param loudnessNormalization Udává, jestli se má každý výstup normalizovat.
+     * @param denoiser              Odšumění s naučeným profilem, nebo 0.
+     * @param activity              Mapa aktivity, tiché bloky se jen zkopírují, nebo 0.
+     * @return                      Vrací nové wavy s rozparsovanými daty, jeden pro každý preset.
+     *
+     * Výstupy jsou stejné, jako kdyby se pro každý preset zvlášť zavolalo equalizeWith(), dopředná FFT
+     * (a odšumění) se ale pro každý blok spočítá jen jednou. Filtr a inverzní FFT pro jednotlivé presety
+     * běží paralelně. Tento wave se nemění.
      */
-    void equalizeWith(std::vector<double> &other, bool loudnessNormalization = true);
+    std::vector<Wave*> equalizeMany(std::vector<std::vector<double> > &presets, bool loudnessNormalization = true,
+                                    const Denoiser *denoiser = 0, ActivityMap *activity = 0);
 
     /**
      * @brief                           Mění hlasitost wavu.
@@ -109,31 +155,137 @@ public:
      */
     void changeVolumeToPercentage(unsigned int per, bool loudnessNormalization = true);
 
+    /**
+     * @brief   Destruktor, uvolní rozparsovaná data.
+     */
+    inline ~Wave() { delete [] PData; }
+
+    /**
+     * @brief           Změní tempo a výšku tónu fázovým vokodérem.
+     * @param tempo     Nové tempo v procentech, 200 = dvakrát rychlejší (a kratší).
+     * @param semitones O kolik půltónů posunout výšku tónu, může být záporné i neceločíselné.
+     *
+     * Tempo a výška se mění nezávisle. Kanály se zpracovávají paralelně. Změní se délka PData
+     * a podle ní i raw data a délky v RIFF a DATA chunku.
+     */
+    void changeTempo(double tempo, double semitones);
+
+    /**
+     * @brief           Vytvoří nový wave z úseku raw dat.
+     * @param from      Index prvního samplu úseku.
+     * @param count     Počet samplů úseku.
+     * @return          Vrací nový nerozparsovaný wave se stejným formátem, nebo 0 při špatném rozsahu.
+     *
+     * Raw data se zkopírují jen pro daný úsek, rozparsovat je lze metodou parse().
+     */
+    Wave* extract(size_t from, size_t count) const;
+
+    /**
+     * @brief           Vloží zpracovaný úsek zpět do raw dat.
+     * @param region    Zpracovaný úsek vytvořený metodou extract(), délka se nesmí změnit.
+     * @param from      Index prvního samplu úseku v tomto wavu.
+     * @param fadeIn    Počet samplů na začátku úseku, ve kterých se prolíná původní signál do zpracovaného.
+     * @param fadeOut   Počet samplů na konci úseku, ve kterých se prolíná zpracovaný signál zpět do původního.
+     * @return          Vrací false, pokud úsek nesedí.
+     *
+     * Mimo prolínání se složená raw data úseku jen zkopírují. Tento wave nemusí být rozparsovaný.
+     */
+    bool splice(Wave &region, size_t from, size_t fadeIn, size_t fadeOut);
+
     /**
      * @brief           Uloží wave do WAV souboru.
      * @param filename  Jméno souboru, kam se Wave struktura uloží.
      *
      * Ukládá Wave strukturu do souboru, který je ve formatu WAV podle norem Microsoftu.
+     * Pokud wave není rozparsovaný, zapíšou se raw data beze změny.
+     * @return          Vrací false, pokud data nejde složit nebo zápis selhal.
+     */
+    bool saveToWaveFile(const char * filename);
+
+    /**
+     * @brief           Uloží wave do FLAC souboru.
+     * @param filename  Jméno souboru, kam se Wave struktura uloží.
+     *
+     * Data se skládají a kódují po skupinách rámců, rámce jedné skupiny paralelně na poolu vláken,
+     * a zapisují se na pozadí. Nikde se tedy nevytváří mezilehlý WAV. Na konci se vypíše kompresní
+     * poměr a rychlost kódování. Pokud wave není rozparsovaný, zakódují se raw data beze změny.
+     * @return          Vrací false, pokud formát nejde uložit do FLAC nebo zápis selhal.
      */
-    void saveToWaveFile(const char * filename);
+    bool saveToFlacFile(const char * filename);
+
+    /**
+     * @brief           Přepíše zdrojový WAV soubor na místě.
+     * @param filename  Jméno souboru, ze kterého byl wave načten. Délka dat se nesmí změnit.
+     * @return          Vrací, jestli se přepis podařil.
+     *
+     * Zapíšou se jen bloky, které se oproti souboru změnily, jejich původní obsah se předtím
+     * uloží do journalu (viz InPlaceWriter). Při chybě journal zůstane a soubor lze obnovit.
+     */
+    bool saveInPlace(const char * filename);
 
     /**
      * @brief           Načte wave z WAV souboru.
      * @param filename  Jméno souboru, z kterého se načte WAV soubor do Wave struktury.
+     * @param mode      Co všechno se má načíst.
      * @return          Vrací pointer na načtenou Wave strukturu.
      *
      * Slouží k načtení WAV souboru do Wave struktury, včetně rozparsování dat z Data chunku do přehledného formátu.
+     * Bez rozparsování jsou k dispozici jen chunky a raw data, rozparsovat je lze později metodou parse().
+     * FLAC soubor (podle značky na začátku) se dekóduje do raw dat a dál se s ním pracuje jako s WAV.
+     */
+    static Wave* fromFilename(const char* filename, LoadMode mode = Parsed);
+
+    /**
+     * @brief Rozparsuje raw data do PData, pokud ještě rozparsovaná nejsou.
+     */
+    void parse();
+
+    /**
+     * @brief           Načte a zkontroluje hlavičky WAV souboru.
+     * @param in        Vstupní stream nastavený na začátek souboru.
+     * @param[out] rch  RIFF chunk.
+     * @param[out] fch  FMT chunk.
+     * @param[out] dchh Hlavička DATA chunku.
+     * @return          Vrací, jestli jsou hlavičky v pořádku. Stream pak stojí na začátku dat.
      */
-    static Wave* fromFilename(const char* filename);
+    static bool readHeaders(std::istream &in, RiffChunk &rch, FmtChunk &fch, DataChunkHeader &dchh);
+
+    /**
+     * @brief                   Vytvoří nový wave s tichem.
+     * @param fmt               FMT chunk, použije se počet kanálů, vzorkovací frekvence a velikost samplu.
+     * @param numberOfSamples   Počet samplů v každém kanálu.
+     * @return                  Vrací nový wave s vynulovanými rozparsovanými daty.
+     */
+    static Wave* create(const FmtChunk &fmt, size_t numberOfSamples);
+
+    /**
+     * @brief           Aplikuje preset na wave.
+     * @param a         Vstup vektor komplexních čísel, který je transformovaný FFT funkcí. (Frekvenční spektrum)
+     * @param b         Vektor čísel, která vyfiltrují dané frekvence ze vstupu. Musí být doplněný pomocí padPreset().
+     * @param[out] ret  Vyfiltrovaný vektor komplexních čísel, který půjde do Inverzní FFT funkce. Musí mít velikost a.
+     */
+    static void applyFilter(const std::vector<complex> &a, const std::vector<double> &b, std::vector<complex> &ret);
+
+    /**
+     * @brief               Doplní preset neměnícími frekvencemi.
+     * @param preset        Preset k doplnění.
+     * @param countForFFT   Velikost FFT, pro kterou se bude preset používat.
+     *
+     * Volá se jednou před zpracováním bloků, aby applyFilter() nemusel preset měnit.
+     */
+    static void padPreset(std::vector<double> &preset, size_t countForFFT);
 
 private:
     /**
      * @brief           Konstruktor.
      * @param rchunk    Odkaz na RIFF Chunk.
      * @param fchunk    Odkaz na FMT Chunk.
-     * @param dchunk    Odkaz na DATA Chunk.
+     * @param dchunk    DATA Chunk, jeho data se převezmou bez kopírování.
      */
-    inline Wave(const RiffChunk& rchunk, const FmtChunk& fchunk, const DataChunk& dchunk): rchunk(rchunk), fchunk(fchunk), dchunk(dchunk) {}
+    inline Wave(const RiffChunk& rchunk, const FmtChunk& fchunk, DataChunk&& dchunk): rchunk(rchunk), fchunk(fchunk), dchunk(std::move(dchunk)), PData(0) {}
+
+    Wave(const Wave&);
+    Wave& operator=(const Wave&);
 
     /**
      * @brief               Vytáhne z PData část dat.
@@ -141,9 +293,9 @@ private:
      * @param from          Index odkud data zkopírovat.
      * @param countData     Počet dat, které se mají načíst ze vstupu.
      * @param countForFFT   Počet dat, které mají být na výstupu.
-     * @return              Vrací vektor komplexních čísel o velikosti coutForFFT. (Doplní nuly za countData)
+     * @param[out] out      Vektor komplexních čísel o velikosti alespoň countForFFT. (Doplní nuly za countData)
      */
-    std::vector<complex> getPieceOfChannel(size_t channel, size_t from, size_t countData, size_t countForFFT);
+    void getPieceOfChannel(size_t channel, size_t from, size_t countData, size_t countForFFT, std::vector<complex> &out);
 
     /**
      * @brief           Přepíše část dat v PData.
@@ -155,12 +307,60 @@ private:
     void setPieceOfChannel(const std::vector<complex> &data, size_t channel, size_t from, size_t countData);
 
     /**
-     * @brief   Aplikuje preset na wave.
-     * @param a Vstup vektor komplexních čísel, který je transformovaný FFT funkcí. (Frekvenční spektrum)
-     * @param b Vektor čísel, která vyfiltrují dané frekvence ze vstupu.
-     * @return  Vrací vyfiltrovaný vektor komplexních čísel, který půjde do Inverzní FFT funkce.
+     * @brief               Equalizuje jeden kanál po blocích.
+     * @param preset        Doplněný preset.
+     * @param channel       Číslo kanálu.
+     * @param ws            Pracovní prostor vlákna, které kanál zpracovává.
+     * @param spectra       Uložená spektra bloků, nebo 0.
+     * @param denoiser      Odšumění, nebo 0.
+     * @param activity      Mapa aktivity, nebo 0.
      */
-    static std::vector<complex> applyFilter(const std::vector<complex> &a, std::vector<double> &b);
+    void equalizeChannel(const std::vector<double> &preset, size_t channel, Workspace &ws, SpectrumCache *spectra,
+                         const Denoiser *denoiser, ActivityMap *activity);
+
+    /**
+     * @brief               Equalizuje několik sousedních kanálů najednou přes BatchFFT.
+     * @param preset        Doplněný preset.
+     * @param first         Číslo prvního kanálu.
+     * @param lanes         Počet kanálů, 2, 4 nebo 8.
+     * @param ws            Pracovní prostor vlákna připravený pro lanes kanálů.
+     * @param denoiser      Odšumění, nebo 0.
+     * @param activity      Mapa aktivity, nebo 0. Blok se přeskočí, jen když jsou tiché všechny kanály.
+     *
+     * Výsledek je stejný jako equalizeChannel() pro každý kanál zvlášť.
+     */
+    void equalizeChannels(const std::vector<double> &preset, size_t first, size_t lanes, Workspace &ws,
+                          const Denoiser *denoiser, ActivityMap *activity);
+
+    /**
+     * @brief           Rozdělí kanály do dávek pro BatchFFT.
+     * @param lanes     Největší počet kanálů v dávce.
+     * @return          Vrací dvojice (první kanál, počet kanálů), dávky jsou mocniny dvojky.
+     */
+    std::vector<std::pair<size_t,size_t> > channelGroups(size_t lanes) const;
+
+    /**
+     * @brief Připraví PData správné velikosti bez parsování raw dat.
+     */
+    void allocateData();
+
+    /**
+     * @brief   Přizpůsobí raw data a délky chunků délce PData.
+     * @return  Vrací false, pokud kanály PData nemají stejnou délku.
+     *
+     * Po změně tempa mají PData jinou délku než raw data, před složením se proto
+     * buffer raw dat znovu alokuje a opraví se délky v RIFF a DATA chunku.
+     */
+    bool resizeData();
+
+    /**
+     * @brief           Prolne jeden sampl zpracovaného úseku s původním samplem v raw datech.
+     * @param region    Zpracovaný úsek.
+     * @param from      Index prvního samplu úseku v tomto wavu.
+     * @param i         Index samplu v úseku.
+     * @param weight    Váha zpracovaného samplu, 0 = původní, 1 = zpracovaný.
+     */
+    void blendSample(const Wave &region, size_t from, size_t i, double weight);
 
     /**
      * @brief Ztlumí wave, pokud někde přesahuje max. hlasitost.
@@ -174,10 +374,30 @@ private:
 
     /**
      * @brief       Naparsuje WAV soubor.
-     * @param in    Vstupní file stream WAV souboru.
-     * @return      Vrací naparsovanou strukturu z WAV souboru.
+     * @param in        Vstupní file stream WAV souboru.
+     * @param readData  Jestli se mají načíst raw data, jinak zůstanou vynulovaná.
+     * @return          Vrací naparsovanou strukturu z WAV souboru.
      */
-    static Wave* fromFileStream(std::ifstream& in);
+    static Wave* fromFileStream(std::ifstream& in, bool readData = true);
+
+    /**
+     * @brief           Načte a dekóduje FLAC soubor.
+     * @param filename  Jméno souboru.
+     * @param mode      Co všechno se má načíst.
+     * @return          Vrací wave s hlavičkami odpovídajícími dekódovaným datům, nebo 0 při chybě.
+     */
+    static Wave* fromFlacFile(const char* filename, LoadMode mode);
+
+    /**
+     * @brief                   Vyplní hlavičky PCM wavu.
+     * @param fmt               FMT chunk, použije se počet kanálů, vzorkovací frekvence a velikost samplu.
+     * @param numberOfSamples   Počet samplů v každém kanálu.
+     * @param[out] rch          RIFF chunk.
+     * @param[out] fch          FMT chunk.
+     * @param[out] dchh         Hlavička DATA chunku.
+     */
+    static void makeHeaders(const FmtChunk &fmt, size_t numberOfSamples, RiffChunk &rch, FmtChunk &fch,
+                            DataChunkHeader &dchh);
 
     /**
      * @brief Rozparsuje Raw data do PData.
@@ -187,6 +407,13 @@ private:
      */
     void ParseData();
 
+    /**
+     * @brief       Rozparsuje část raw dat do již alokovaných PData.
+     * @param from  Index prvního samplu.
+     * @param count Počet samplů v každém kanálu.
+     */
+    void parseRange(size_t from, size_t count);
+
     /**
      * @brief   Složí PData zpět na Raw data.
      * @return  Vrací, jestli nenastala chyba.
@@ -195,5 +422,18 @@ private:
      * z kterého se bude skládat výstup.
      */
     bool ComposeData();
+
+    /**
+     * @brief   Zkontroluje, že délka PData odpovídá délce raw dat.
+     * @return  Vrací, jestli lze data složit.
+     */
+    bool composable() const;
+
+    /**
+     * @brief       Složí část PData zpět na raw data.
+     * @param from  Index prvního samplu.
+     * @param count Počet samplů v každém kanálu.
+     */
+    void composeRange(size_t from, size_t count);
 };
 #endif // WAVE_H
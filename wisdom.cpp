@@ -0,0 +1,288 @@
+﻿#include "wisdom.h"
+#include "batch_fft.h"
+#include "data_utility.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    /* Kolikrát se měření opakuje, bere se nejlepší čas */
+    const size_t Repeats = 3;
+
+    /* Kolik transformací se provede v jednom měření jádra */
+    const size_t Transforms = 8;
+
+    template<class F>
+    double bestTime(F f)
+    {
+        double best = 0;
+        for(size_t r = 0; r != Repeats; ++r)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            f();
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(r == 0 || t < best)
+                best = t;
+        }
+        return best;
+    }
+
+    /* Deterministický šum, na datech rychlost nezávisí, jen nesmí být nulová */
+    void fill(complex *data, size_t N)
+    {
+        unsigned int state = 12345;
+        for(size_t i = 0; i != N; ++i)
+        {
+            state = state * 1103515245 + 12345;
+            data[i] = complex(double(state >> 16) / 65536 - 0.5);
+        }
+    }
+
+    bool isPowerOf2(size_t x)
+    {
+        return x && (x & (x - 1)) == 0;
+    }
+
+    /* Nastavení CFFT podle záznamu: blocked jádro od N výš, jinak přímé jádro až do dvojnásobku N */
+    CFFT::Tuning tuningFor(const Wisdom::Entry &e)
+    {
+        CFFT::Tuning t;
+        if(e.block)
+        {
+            t.LargeN = e.N;
+            t.LargeBlock = e.block;
+            t.LargeTile = e.tile;
+        }
+        else
+            t.LargeN = e.N * 2;
+        return t;
+    }
+}
+
+bool Wisdom::load(const std::string &filename)
+{
+    std::ifstream in(filename.c_str());
+    if(!in.is_open())
+    {
+        std::cerr << "ERROR: Nelze nacist wisdom: " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while(std::getline(in, line))
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#')
+            continue;
+        Entry e = Entry();
+        e.tile = 16;
+        e.lanes = BatchFFT::MaxLanes;
+        std::istringstream fields(line);
+        std::string field;
+        bool valid = true;
+        while(fields >> field)
+        {
+            size_t eq = field.find('=');
+            if(eq == std::string::npos)
+            {
+                valid = false;
+                break;
+            }
+            std::string key = field.substr(0, eq);
+            size_t value = strtoul(field.c_str() + eq + 1, 0, 10);
+            if(key == "rate")
+                e.SampleRate = value;
+            else if(key == "fft")
+                e.N = value;
+            else if(key == "block")
+                e.block = value;
+            else if(key == "tile")
+                e.tile = value;
+            else if(key == "lanes")
+                e.lanes = value;
+            else if(key == "threads")
+                e.threads = value;
+        }
+        /* Bloky a dlaždice musí být mocniny dvojky, jinak by PerformLarge počítal špatně */
+        valid = valid && e.SampleRate && e.N == DataUtility::findNextTo2Exp(e.SampleRate)
+                && (e.block == 0 || (isPowerOf2(e.block) && e.block <= e.N
+                                     && isPowerOf2(e.tile) && e.tile <= e.block))
+                && (e.lanes == 1 || e.lanes == 2 || e.lanes == 4 || e.lanes == 8);
+        if(!valid)
+        {
+            std::cerr << "ERROR: Chybny radek wisdom: " << line << std::endl;
+            return false;
+        }
+        entries[e.SampleRate] = e;
+    }
+    return true;
+}
+
+bool Wisdom::save(const std::string &filename) const
+{
+    std::ofstream out(filename.c_str(), std::ios_base::out | std::ios_base::trunc);
+    out << "# rate fft block tile lanes threads, block=0 je prime jadro\n";
+    for(std::map<size_t, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        const Entry &e = it->second;
+        out << "rate=" << e.SampleRate << " fft=" << e.N << " block=" << e.block << " tile=" << e.tile
+            << " lanes=" << e.lanes << " threads=" << e.threads << '\n';
+    }
+    if(!out)
+    {
+        std::cerr << "ERROR: Nelze zapsat wisdom: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const Wisdom::Entry* Wisdom::find(size_t SampleRate) const
+{
+    std::map<size_t, Entry>::const_iterator it = entries.find(SampleRate);
+    return it == entries.end() ? 0 : &it->second;
+}
+
+bool Wisdom::apply(size_t SampleRate, bool lanes) const
+{
+    const Entry *e = find(SampleRate);
+    if(!e)
+        return false;
+    CFFT::tuning = tuningFor(*e);
+    if(lanes)
+        BatchFFT::maxLanes = e->lanes;
+    ThreadPool::instance().setActive(e->threads);
+    return true;
+}
+
+void Wisdom::tune(const std::vector<size_t> &rates, std::ostream &out)
+{
+    ThreadPool &pool = ThreadPool::instance();
+    const CFFT::Tuning defaults = CFFT::tuning;
+    const size_t lanesDefault = BatchFFT::maxLanes;
+
+    for(size_t r = 0; r != rates.size(); ++r)
+    {
+        Entry best = Entry();
+        best.SampleRate = rates[r];
+        best.N = DataUtility::findNextTo2Exp(rates[r]);
+        best.tile = 16;
+        const size_t N = best.N;
+        std::vector<complex> source(N), data(N);
+        fill(&source[0], N);
+
+        /* FFT jádro: přímé a všechny kombinace bloku a dlaždice, sériově na jednom vlákně */
+        double bestKernel = 0;
+        std::vector<std::pair<size_t, size_t> > kernels(1, std::make_pair(size_t(0), size_t(16)));
+        for(size_t block = 1024; block <= 16384 && block <= N / 2; block *= 2)
+            for(size_t tile = 8; tile <= 64; tile *= 2)
+                kernels.push_back(std::make_pair(block, tile));
+        for(size_t k = 0; k != kernels.size(); ++k)
+        {
+            Entry candidate = best;
+            candidate.block = kernels[k].first;
+            candidate.tile = kernels[k].second;
+            CFFT::tuning = tuningFor(candidate);
+            double t = bestTime([&]() {
+                for(size_t i = 0; i != Transforms; ++i)
+                {
+                    CFFT::Forward(&source[0], &data[0], N);
+                    CFFT::Inverse(&data[0], N, true);
+                }
+            });
+            if(k == 0 || t < bestKernel)
+            {
+                bestKernel = t;
+                best.block = candidate.block;
+                best.tile = candidate.tile;
+            }
+        }
+        CFFT::tuning = tuningFor(best);
+
+        /* Dávka BatchFFT: čas na jeden kanál, jedna dráha je CFFT jako ve Wave::equalizeChannel() */
+        double bestLane = 0;
+        std::vector<double> preset(N / 2 + 1, 0.5);
+        for(size_t lanes = 1; lanes <= BatchFFT::MaxLanes; lanes *= 2)
+        {
+            std::vector<double> batch(N * 2 * lanes);
+            for(size_t i = 0; i != N; ++i)
+                for(size_t l = 0; l != lanes; ++l)
+                {
+                    batch[i * 2 * lanes + l] = source[i].re();
+                    batch[i * 2 * lanes + lanes + l] = 0;
+                }
+            double t = bestTime([&]() {
+                for(size_t i = 0; i != Transforms; i += lanes)
+                {
+                    if(lanes == 1)
+                    {
+                        CFFT::Forward(&source[0], &data[0], N);
+                        for(size_t k = 0; k != N; ++k)
+                            data[k] *= preset[std::min(k, N - k)];
+                        CFFT::Inverse(&data[0], N, true);
+                    }
+                    else
+                    {
+                        BatchFFT::forward(&batch[0], N, lanes);
+                        BatchFFT::filter(&batch[0], &preset[0], N, lanes);
+                        BatchFFT::inverse(&batch[0], N, lanes, true);
+                    }
+                }
+            }) / std::max(Transforms, lanes);
+            if(lanes == 1 || t < bestLane)
+            {
+                bestLane = t;
+                best.lanes = lanes;
+            }
+        }
+
+        /* Vlákna: bloky equalizace rozdělené na poolu, mocniny dvojky a všechna vlákna */
+        std::vector<size_t> counts;
+        for(size_t t = 1; t < pool.capacity(); t *= 2)
+            counts.push_back(t);
+        counts.push_back(pool.capacity());
+        const size_t blocks = std::max<size_t>(Transforms, pool.capacity() * 4);
+        std::vector<std::vector<complex> > buffers(pool.capacity(), std::vector<complex>(N));
+        double bestThreads = 0;
+        for(size_t c = 0; c != counts.size(); ++c)
+        {
+            pool.setActive(counts[c]);
+            double t = bestTime([&]() {
+                pool.run(blocks, [&](size_t, size_t worker) {
+                    complex *block = &buffers[worker][0];
+                    CFFT::Forward(&source[0], block, N);
+                    for(size_t i = 0; i != N; ++i)
+                        block[i] *= preset[std::min(i, N - i)];
+                    CFFT::Inverse(block, N, true);
+                });
+            });
+            if(c == 0 || t < bestThreads)
+            {
+                bestThreads = t;
+                best.threads = counts[c];
+            }
+        }
+        pool.setActive(0);
+
+        entries[best.SampleRate] = best;
+        out << "Wisdom " << best.SampleRate << " Hz, FFT " << N << ": "
+            << (best.block ? "jadro po blocich " : "prime jadro");
+        if(best.block)
+            out << best.block << "/" << best.tile;
+        out << " (" << bestKernel / Transforms * 1e3 << " ms na FFT a IFFT), davka " << best.lanes
+            << " (" << bestLane * 1e3 << " ms na kanal), vlaken " << best.threads
+            << " (" << bestThreads * 1e3 << " ms na " << blocks << " bloku)" << std::endl;
+    }
+
+    CFFT::tuning = defaults;
+    BatchFFT::maxLanes = lanesDefault;
+}
+
+Wisdom& Wisdom::global()
+{
+    static Wisdom wisdom;
+    return wisdom;
+}
@@ -0,0 +1,85 @@
+﻿#ifndef WISDOM_H
+#define WISDOM_H
+#include "fft.h"
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Nejrychlejší nastavení FFT naměřené na tomto stroji, po vzoru wisdom z FFTW.
+ *
+ * Pro každou vzorkovací frekvenci (a tedy velikost FFT bloku equalizace) se změří varianty
+ * FFT jádra (přímé, nebo po blocích s různou délkou bloku a šířkou dlaždice), velikost dávky
+ * BatchFFT a počet vláken. Všechny varianty dávají bitově stejný výsledek, liší se jen rychlostí.
+ * Velikost FFT se neladí, ta určuje rozlišení presetu a tím i výsledek equalizace.
+ *
+ * Soubor je textový, jeden řádek na vzorkovací frekvenci:
+ *
+ *     rate=44100 fft=65536 block=4096 tile=16 lanes=4 threads=8
+ *
+ * block=0 znamená přímé jádro. Řádky začínající # se přeskočí.
+ */
+class Wisdom
+{
+public:
+    /**
+     * @brief Nastavení pro jednu vzorkovací frekvenci.
+     */
+    struct Entry
+    {
+        size_t SampleRate;      /**< Vzorkovací frekvence. */
+        size_t N;               /**< Velikost FFT bloku. */
+        size_t block;           /**< Délka bloku jádra po blocích, 0 = přímé jádro. */
+        size_t tile;            /**< Šířka dlaždice jádra po blocích. */
+        size_t lanes;           /**< Velikost dávky BatchFFT. */
+        size_t threads;         /**< Počet vláken. */
+    };
+
+    /**
+     * @brief           Načte soubor, záznamy se přidají ke stávajícím.
+     * @param filename  Jméno souboru.
+     * @return          Vrací false, pokud soubor nejde otevřít nebo obsahuje chybný řádek.
+     */
+    bool load(const std::string &filename);
+
+    /**
+     * @brief           Uloží všechny záznamy.
+     * @param filename  Jméno souboru.
+     * @return          Vrací false při chybě zápisu.
+     */
+    bool save(const std::string &filename) const;
+
+    /**
+     * @brief               Najde záznam pro vzorkovací frekvenci.
+     * @param SampleRate    Vzorkovací frekvence.
+     * @return              Vrací záznam, nebo 0.
+     */
+    const Entry* find(size_t SampleRate) const;
+
+    /**
+     * @brief               Nastaví FFT, BatchFFT a pool vláken podle záznamu pro vzorkovací frekvenci.
+     * @param SampleRate    Vzorkovací frekvence.
+     * @param lanes         Jestli se má nastavit i velikost dávky (uživatel ji nezadal sám).
+     * @return              Vrací false, pokud pro frekvenci nic naměřeno není, pak zůstane výchozí nastavení.
+     */
+    bool apply(size_t SampleRate, bool lanes) const;
+
+    /**
+     * @brief               Změří nejrychlejší nastavení pro vzorkovací frekvence a uloží ho do záznamů.
+     * @param rates         Vzorkovací frekvence.
+     * @param out           Stream pro průběžný výpis výsledků.
+     */
+    void tune(const std::vector<size_t> &rates, std::ostream &out);
+
+    /**
+     * @brief   Záznamy načtené při startu programu, sdílí je všechny úlohy démona.
+     */
+    static Wisdom& global();
+
+private:
+    std::map<size_t, Entry> entries;    /**< Záznamy podle vzorkovací frekvence. */
+};
+
+#endif // WISDOM_H
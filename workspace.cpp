@@ -0,0 +1,28 @@
+﻿#include "workspace.h"
+
+void Workspace::prepare(size_t countForFFT, size_t lanes, bool denoise)
+{
+    /* resize nealokuje, pokud už je kapacita dostatečná */
+    block.resize(countForFFT);
+    filtered.resize(countForFFT);
+    if(lanes > 1)
+        batch.resize(countForFFT * 2 * lanes);
+    if(denoise)
+    {
+        gains.resize(countForFFT / 2 + 1);
+        gainSums.resize(countForFFT / 2 + 2);
+    }
+}
+
+void Workspace::prepareAll(std::vector<Workspace> &workspaces, size_t threads, size_t countForFFT, size_t lanes, bool denoise)
+{
+    workspaces.resize(threads);
+    for(size_t i = 0; i != workspaces.size(); ++i)
+        workspaces[i].prepare(countForFFT, lanes, denoise);
+}
+
+std::vector<Workspace>& Workspace::shared()
+{
+    static std::vector<Workspace> workspaces;
+    return workspaces;
+}
@@ -0,0 +1,49 @@
+﻿#ifndef WORKSPACE_H
+#define WORKSPACE_H
+#include "complex.h"
+#include <vector>
+
+/**
+ * @brief Pracovní prostor jednoho vlákna.
+ *
+ * Obsahuje všechny pomocné buffery, které potřebuje zpracování jednoho bloku.
+ * Buffery se alokují jednou na začátku úlohy metodou prepare() a pak se jen přepisují,
+ * takže zpracování bloků v ustáleném stavu nealokuje na haldě.
+ */
+struct Workspace
+{
+    std::vector<complex> block;     /**< Blok dat z kanálu doplněný nulami, po FFT jeho spektrum. */
+    std::vector<complex> filtered;  /**< Vyfiltrované spektrum, po inverzní FFT výstup bloku. */
+    std::vector<double> batch;      /**< Proložené bloky více kanálů pro BatchFFT. */
+    std::vector<double> gains;      /**< Výkon a pak zesílení frekvencí bloku pro odšumění. */
+    std::vector<double> gainSums;   /**< Průběžné součty zesílení pro vyhlazení. */
+
+    /**
+     * @brief               Připraví buffery pro danou velikost FFT.
+     * @param countForFFT   Velikost FFT, tedy délka bloku doplněného nulami.
+     * @param lanes         Počet kanálů zpracovávaných najednou přes BatchFFT, 1 znamená bez dávkování.
+     * @param denoise       Jestli se připraví i buffery zesílení pro odšumění.
+     */
+    void prepare(size_t countForFFT, size_t lanes = 1, bool denoise = false);
+
+    /**
+     * @brief               Připraví pracovní prostor pro každé vlákno.
+     * @param workspaces    Vektor pracovních prostorů, jeden pro každé vlákno.
+     * @param threads       Počet vláken.
+     * @param countForFFT   Velikost FFT.
+     * @param lanes         Počet kanálů zpracovávaných najednou.
+     * @param denoise       Jestli se připraví i buffery zesílení pro odšumění.
+     */
+    static void prepareAll(std::vector<Workspace> &workspaces, size_t threads, size_t countForFFT, size_t lanes = 1, bool denoise = false);
+
+    /**
+     * @brief   Sdílené pracovní prostory pro celý program.
+     * @return  Vrací odkaz na globální vektor pracovních prostorů.
+     *
+     * Buffery zůstávají alokované mezi úlohami, takže další úloha (například v démonovi)
+     * už je jen přepíše. Úlohy, které je používají, nesmí běžet souběžně.
+     */
+    static std::vector<Workspace>& shared();
+};
+
+#endif // WORKSPACE_H
@@ -5,6 +5,7 @@ QT       -= gui
 TARGET = zapoctak
 CONFIG   += console
 CONFIG   -= app_bundle
+CONFIG   += c++17 thread
 
 TEMPLATE = app
 
@@ -13,10 +14,64 @@ SOURCES += main.cpp \
     wave.cpp \
     fft.cpp \
     data_utility.cpp \
-    complex.cpp
+    complex.cpp \
+    thread_pool.cpp \
+    workspace.cpp \
+    alloc_counter.cpp \
+    spectral_analysis.cpp \
+    result_cache.cpp \
+    mapped_file.cpp \
+    spectrum_cache.cpp \
+    async_io.cpp \
+    mixer.cpp \
+    batch_fft.cpp \
+    phase_vocoder.cpp \
+    in_place.cpp \
+    gain.cpp \
+    daemon.cpp \
+    denoise.cpp \
+    effects.cpp \
+    effect_graph.cpp \
+    pipeline.cpp \
+    flac.cpp \
+    peak_index.cpp \
+    activity_map.cpp \
+    arena.cpp \
+    channel_matrix.cpp \
+    catalog.cpp \
+    wisdom.cpp \
+    checkpoint.cpp
 
 HEADERS += \
     wave.h \
     fft.h \
     data_utility.h \
-    complex.h
+    complex.h \
+    thread_pool.h \
+    workspace.h \
+    alloc_counter.h \
+    spectral_analysis.h \
+    result_cache.h \
+    mapped_file.h \
+    spectrum_cache.h \
+    async_io.h \
+    mixer.h \
+    batch_fft.h \
+    phase_vocoder.h \
+    in_place.h \
+    gain.h \
+    daemon.h \
+    denoise.h \
+    effect_node.h \
+    effects.h \
+    effect_graph.h \
+    spsc_ring.h \
+    pipeline.h \
+    flac.h \
+    peak_index.h \
+    activity_map.h \
+    arena.h \
+    channel_matrix.h \
+    catalog.h \
+    wisdom.h \
+    checkpoint.h